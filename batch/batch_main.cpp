@@ -0,0 +1,355 @@
+// shademfm-batch: runs a SPLAT project on the native (CPU) backend without a window, gpu or gui, at full speed.
+// Compiles the project, resets the world with its Init() (or resumes a snapshot), steps it and writes population statistics, snapshots and images.
+// Build with 'make shademfm-batch', run from the repository root (it needs projects/, stdlib/ and shaders/):
+//   shademfm-batch <project> [options]
+#include "src/splat_compiler.h"
+#include "src/native.h"
+#include "src/snapshot.h"
+#include "src/trajectory.h"
+#include "src/world_image.h"
+#include "core/log.h"
+#include "core/cpu_timer.h"
+#include "core/jobs.h"
+#include "core/trace_export.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct BatchOptions {
+	const char* project = NULL;
+	ivec2 size = ivec2(256, 256);
+	u32 seed = 1;
+	int steps = 1000;
+	NativeSchedule schedule = NativeSchedule_tiled;
+	int threads = -1;
+	bool counter_prng = false;
+	bool shared_site_tests = false;
+	const char* stats_pathfile = NULL;    // csv, one row per stats_every steps and one for the end
+	int stats_every = 0;
+	const char* snapshot_pathfile = NULL; // the world at the end, plus '<pathfile>.<step>' every snapshot_every steps and/or snapshot_minutes
+	int snapshot_every = 0;
+	float snapshot_minutes = 0.0f;
+	const char* resume_pathfile = NULL;   // start from this snapshot instead of Init()
+	const char* trajectory_pathfile = NULL; // every step, see src/trajectory.h
+	int keyframe_every = 100;
+	const char* trace_pathfile = NULL;    // chrome trace of the setup and the first trace_frames steps
+	int trace_frames = 100;
+	const char* image_pathfile = NULL;    // png of the world at the end, plus one every image_every steps
+	int image_every = 0;
+	int image_max_side = 0;               // box filtered down to fit, 0 for a pixel per site
+	bool image_module_colors = false;
+};
+
+static void printUsage() {
+	printf(
+		"usage: shademfm-batch <project> [options]\n"
+		"  --size N | WxH          world size (default 256)\n"
+		"  --seed N                seed for the event scheduling (default 1)\n"
+		"  --steps N               steps to run, in AEPS for uniform and tiled, vote rounds for vote (default 1000)\n"
+		"  --schedule S            uniform, tiled or vote (default tiled)\n"
+		"  --threads N             worker threads besides the main one (default: one less than the hardware threads)\n"
+		"  --counter-prng          use the counter based prng (see README)\n"
+		"  --shared-site-tests     compile the rules with shared site tests (see README), same results\n"
+		"  --stats FILE            write the population of every element as csv\n"
+		"  --stats-every N         add a stats row every N steps (default: only at the end)\n"
+		"  --snapshot FILE         write a snapshot of the world at the end\n"
+		"  --snapshot-every N      also write FILE.<step> every N steps, in the background\n"
+		"  --snapshot-minutes M    also write FILE.<step> every M minutes, in the background\n"
+		"  --resume FILE           continue from a snapshot instead of starting with Init(), for another --steps steps\n"
+		"  --trajectory FILE       record the site bits of every step, as keyframes and deltas\n"
+		"  --keyframe-every N      frames between keyframes of the trajectory (default 100)\n"
+		"  --trace FILE            write a chrome trace (chrome://tracing, ui.perfetto.dev) of the compile and the first steps\n"
+		"  --trace-frames N        steps in the trace (default 100)\n"
+		"  --image FILE            write a png of the world at the end, rendered on the cpu\n"
+		"  --image-every N         also write one every N steps, with the step before the extension\n"
+		"  --image-size N          box filter the image down until it's at most N pixels wide and high\n"
+		"  --image-module-colors   color every site with its element's getColor instead of the palette, slower\n");
+}
+
+static bool parseOptions(int argc, char** argv, BatchOptions* opt) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+		bool needs_val = true;
+		if (arg[0] != '-') {
+			if (opt->project) {
+				printf("More than one project given: '%s' and '%s'\n", opt->project, arg);
+				return false;
+			}
+			opt->project = arg;
+			needs_val = false;
+		} else if (!strcmp(arg, "--counter-prng")) {
+			opt->counter_prng = true;
+			needs_val = false;
+		} else if (!strcmp(arg, "--shared-site-tests")) {
+			opt->shared_site_tests = true;
+			needs_val = false;
+		} else if (!strcmp(arg, "--image-module-colors")) {
+			opt->image_module_colors = true;
+			needs_val = false;
+		} else if (!val) {
+			printf("Missing value for '%s'\n", arg);
+			return false;
+		} else if (!strcmp(arg, "--size")) {
+			int x = 0, y = 0;
+			int n = sscanf(val, "%dx%d", &x, &y);
+			opt->size = n == 2 ? ivec2(x, y) : ivec2(x);
+		} else if (!strcmp(arg, "--seed")) {
+			opt->seed = u32(strtoul(val, NULL, 0));
+		} else if (!strcmp(arg, "--steps")) {
+			opt->steps = atoi(val);
+		} else if (!strcmp(arg, "--schedule")) {
+			if (!strcmp(val, "uniform")) opt->schedule = NativeSchedule_uniform;
+			else if (!strcmp(val, "tiled")) opt->schedule = NativeSchedule_tiled;
+			else if (!strcmp(val, "vote")) opt->schedule = NativeSchedule_vote;
+			else {
+				printf("Unknown schedule '%s'\n", val);
+				return false;
+			}
+		} else if (!strcmp(arg, "--threads")) {
+			opt->threads = atoi(val);
+		} else if (!strcmp(arg, "--stats")) {
+			opt->stats_pathfile = val;
+		} else if (!strcmp(arg, "--stats-every")) {
+			opt->stats_every = atoi(val);
+		} else if (!strcmp(arg, "--snapshot")) {
+			opt->snapshot_pathfile = val;
+		} else if (!strcmp(arg, "--snapshot-every")) {
+			opt->snapshot_every = atoi(val);
+		} else if (!strcmp(arg, "--snapshot-minutes")) {
+			opt->snapshot_minutes = float(atof(val));
+		} else if (!strcmp(arg, "--resume")) {
+			opt->resume_pathfile = val;
+		} else if (!strcmp(arg, "--trajectory")) {
+			opt->trajectory_pathfile = val;
+		} else if (!strcmp(arg, "--keyframe-every")) {
+			opt->keyframe_every = atoi(val);
+		} else if (!strcmp(arg, "--trace")) {
+			opt->trace_pathfile = val;
+		} else if (!strcmp(arg, "--trace-frames")) {
+			opt->trace_frames = atoi(val);
+		} else if (!strcmp(arg, "--image")) {
+			opt->image_pathfile = val;
+		} else if (!strcmp(arg, "--image-every")) {
+			opt->image_every = atoi(val);
+		} else if (!strcmp(arg, "--image-size")) {
+			opt->image_max_side = atoi(val);
+		} else {
+			printf("Unknown option '%s'\n", arg);
+			return false;
+		}
+		if (needs_val)
+			++i;
+	}
+	if (!opt->project) {
+		printf("No project given\n");
+		return false;
+	}
+	if (opt->size.x <= 0 || opt->size.y <= 0 || opt->steps < 0 || opt->stats_every < 0 || opt->snapshot_every < 0 || opt->snapshot_minutes < 0.0f || opt->trace_frames < 0 || opt->keyframe_every <= 0 || opt->image_every < 0 || opt->image_max_side < 0) {
+		printf("Size and keyframe interval have to be positive, steps and intervals can't be negative\n");
+		return false;
+	}
+	return true;
+}
+
+static void writeStatsHeader(FILE* f, const ProgramInfo* info) {
+	fprintf(f, "step,aeps,events,live_events,seconds");
+	for (int i = 0; i < info->elems.count; ++i)
+		fprintf(f, ",%.*s", int(info->elems[i].name.len), info->elems[i].name.str);
+	fprintf(f, "\n");
+}
+static void writeStatsRow(FILE* f, NativeWorld* world, const ProgramInfo* info, double sec) {
+	static Bunch<u32> counts;
+	world->countTypes(&counts);
+	double sites = double(world->size.x) * world->size.y;
+	fprintf(f, "%u,%.3f,%lld,%lld,%.3f", world->dispatch_counter, double(world->events_since_reset) / sites,
+		(long long)world->events_since_reset, (long long)world->live_events_since_reset, sec);
+	for (int i = 0; i < info->elems.count; ++i)
+		fprintf(f, ",%u", i < counts.count ? counts[i] : 0u);
+	fprintf(f, "\n");
+	fflush(f);
+}
+
+// 'out.png' becomes 'out.<step>.png'
+static bool writeImage(const char* pathfile, u32 step, bool with_step, const NativeWorld* world, const WorldImagePalette* palette, int max_side) {
+	int downsample = worldImageDownsample(world->size, max_side);
+	if (!with_step)
+		return worldImageSave(pathfile, world->site_bits.data.ptr, world->size, palette, downsample);
+	const char* ext = strrchr(pathfile, '.');
+	if (!ext || strchr(ext, '/')) ext = pathfile + strlen(pathfile);
+	return worldImageSave(TempStr("%.*s.%u%s", int(ext - pathfile), pathfile, step, ext), world->site_bits.data.ptr, world->size, palette, downsample);
+}
+
+// the stages of a step run back to back from its start, so their ranges can be laid out from the stage time they added
+static const char* stage_names[NativeStage_count] = { "vote", "exclusion", "event", "census" };
+static void traceStep(const NativeWorld* world, const s64* stage_time_before, s64 t_start, s64 t_stop) {
+	const double usec_per_tick = 1000000.0 / double(time_frequency());
+	traceRange(TraceTrack_cpu, "step", t_start, t_stop, usec_per_tick);
+	s64 t = t_start;
+	for (int i = 0; i < NativeStage_count; ++i) {
+		s64 dt = world->stage_time[i] - stage_time_before[i];
+		if (dt <= 0) continue;
+		traceRange(TraceTrack_cpu, stage_names[i], t, t + dt, usec_per_tick);
+		t += dt;
+	}
+}
+
+int main(int argc, char** argv) {
+	timeSetStart();
+
+	BatchOptions opt;
+	if (!parseOptions(argc, argv, &opt)) {
+		printUsage();
+		return 1;
+	}
+	// frame 0 of the trace is the setup, every step after that is a frame
+	if (opt.trace_pathfile && !traceBegin(opt.trace_pathfile, opt.trace_frames + 1, 1u << TraceTrack_cpu))
+		return 1;
+	const double usec_per_tick = 1000000.0 / double(time_frequency());
+
+	jobsInit(opt.threads);
+	setNativeBackendEnabled(true);
+	setCounterPrngEnabled(opt.counter_prng);
+	setSharedSiteTestsEnabled(opt.shared_site_tests);
+	ProgramInfo info;
+	s64 time_compile = time_counter();
+	if (!compileSplatProject(StringRange(opt.project), &info)) {
+		StringRange build_log = nativeBuildLog();
+		if (build_log.len)
+			log("%.*s\n", build_log.len, build_log.str);
+		traceEnd();
+		nativeDestroy();
+		jobsTerm();
+		return 1;
+	}
+	traceRange(TraceTrack_cpu, "compile", time_compile, time_counter(), usec_per_tick);
+	logInfo("BATCH", "Native build took %.2f sec, exclusion radius %u", nativeBuildTime(), nativeModule()->exclusion_radius);
+
+	FILE* stats = NULL;
+	if (opt.stats_pathfile) {
+		stats = fopen(opt.stats_pathfile, "wb");
+		if (!stats) {
+			logError("BATCH", 0, "Couldn't open '%s' for writing", opt.stats_pathfile);
+			traceEnd();
+			nativeDestroy();
+			jobsTerm();
+			return 1;
+		}
+		writeStatsHeader(stats, &info);
+	}
+
+	NativeWorld world;
+	world.seed = opt.seed;
+	world.schedule = opt.schedule;
+	s64 time_reset = time_counter();
+	if (opt.resume_pathfile) {
+		if (!snapshotLoad(opt.resume_pathfile, &world, &info)) {
+			if (stats) fclose(stats);
+			traceEnd();
+			nativeDestroy();
+			jobsTerm();
+			return 1;
+		}
+	} else {
+		world.resize(opt.size);
+		world.reset();
+	}
+	traceRange(TraceTrack_cpu, opt.resume_pathfile ? "resume" : "reset", time_reset, time_counter(), usec_per_tick);
+
+	// stats, snapshots and the trajectory are written between steps, but not counted into the run time
+	TrajectoryWriter trajectory;
+	if (opt.trajectory_pathfile && !trajectory.open(opt.trajectory_pathfile, &world, &info, opt.keyframe_every)) {
+		if (stats) fclose(stats);
+		traceEnd();
+		world.destroy();
+		nativeDestroy();
+		jobsTerm();
+		return 1;
+	}
+	// periodic snapshots are copied at the step boundary and written on another thread while stepping goes on
+	SnapshotWriter checkpoint_writer;
+	CheckpointSchedule checkpoints;
+	checkpoints.every_steps = opt.snapshot_every;
+	checkpoints.every_minutes = opt.snapshot_minutes;
+	checkpoints.restart();
+	WorldImagePalette palette;
+	palette.build(&info, opt.image_module_colors ? nativeModule() : NULL);
+	s64 run_time = 0;
+	s64 trajectory_time = 0;
+	if (stats && opt.stats_every)
+		writeStatsRow(stats, &world, &info, 0.0);
+	if (trajectory.isOpen())
+		trajectory.record(&world);
+	traceFrameEnd(TraceTrack_cpu);
+	u32 last_step = world.dispatch_counter + u32(opt.steps);
+	while (world.dispatch_counter < last_step) {
+		s64 stage_time_before[NativeStage_count];
+		memcpy(stage_time_before, world.stage_time, sizeof(stage_time_before));
+		s64 time_start = time_counter();
+		world.step();
+		s64 time_stop = time_counter();
+		run_time += time_stop - time_start;
+		if (traceActive(TraceTrack_cpu))
+			traceStep(&world, stage_time_before, time_start, time_stop);
+
+		u32 step = world.dispatch_counter; // counts on from the snapshot when resuming
+		if (stats && opt.stats_every && step % opt.stats_every == 0) {
+			s64 time_stats = time_counter();
+			writeStatsRow(stats, &world, &info, time_to_sec(run_time));
+			traceRange(TraceTrack_cpu, "stats", time_stats, time_counter(), usec_per_tick);
+		}
+		if (opt.snapshot_pathfile && checkpoints.due(step)) {
+			s64 time_snapshot = time_counter();
+			checkpoint_writer.take(TempStr("%s.%u", opt.snapshot_pathfile, step), &world, &info);
+			traceRange(TraceTrack_cpu, "snapshot", time_snapshot, time_counter(), usec_per_tick);
+		}
+		if (trajectory.isOpen()) {
+			s64 time_trajectory = time_counter();
+			trajectory.record(&world);
+			trajectory_time += time_counter() - time_trajectory;
+			traceRange(TraceTrack_cpu, "trajectory", time_trajectory, time_counter(), usec_per_tick);
+		}
+		if (opt.image_pathfile && opt.image_every && step % opt.image_every == 0) {
+			s64 time_image = time_counter();
+			writeImage(opt.image_pathfile, step, true, &world, &palette, opt.image_max_side);
+			traceRange(TraceTrack_cpu, "image", time_image, time_counter(), usec_per_tick);
+		}
+		traceFrameEnd(TraceTrack_cpu);
+	}
+	traceEnd(); // fewer steps than trace frames
+	double sec = time_to_sec(run_time);
+
+	bool ok = true;
+	if (stats) {
+		if (!opt.stats_every || world.dispatch_counter % opt.stats_every != 0)
+			writeStatsRow(stats, &world, &info, sec);
+		fclose(stats);
+	}
+	checkpoint_writer.flush();
+	ok &= checkpoint_writer.failed() == 0;
+	if (checkpoint_writer.waitedSec() >= 0.01f)
+		logInfo("BATCH", "Waited %.2f sec for snapshots to be written", checkpoint_writer.waitedSec());
+	checkpoint_writer.destroy();
+	if (opt.snapshot_pathfile)
+		ok &= snapshotSave(opt.snapshot_pathfile, &world, &info);
+	if (opt.image_pathfile)
+		ok &= writeImage(opt.image_pathfile, world.dispatch_counter, false, &world, &palette, opt.image_max_side);
+	if (opt.trajectory_pathfile) {
+		ok &= trajectory.isOpen(); // it stops on write errors
+		ok &= trajectory.close();
+		logInfo("BATCH", "Recording the trajectory took %.3f sec, %.1f%% of the run time", time_to_sec(trajectory_time),
+			run_time ? double(trajectory_time) / double(run_time) * 100.0 : 0.0);
+	}
+
+	double sites = double(world.size.x) * world.size.y;
+	logInfo("BATCH", "%s %dx%d, %d steps in %.3f sec: %.3f M events/sec, %.2f AEPS/sec, %.1f%% live events",
+		opt.project, world.size.x, world.size.y, opt.steps, sec,
+		sec > 0.0 ? double(world.events_since_reset) / sec / 1000000.0 : 0.0,
+		sec > 0.0 ? double(world.events_since_reset) / sites / sec : 0.0,
+		world.events_since_reset ? double(world.live_events_since_reset) / double(world.events_since_reset) * 100.0 : 0.0);
+
+	world.destroy();
+	nativeDestroy();
+	jobsTerm();
+	return ok ? 0 : 1;
+}
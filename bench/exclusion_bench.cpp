@@ -0,0 +1,88 @@
+// Microbenchmark for the exclusion kernels in src/native_exclusion.cpp.
+// Fills a padded vote map with random votes, checks every kernel against the per site reference and times them.
+// Build with 'make exclusion_bench', run as: exclusion_bench [world size] [rounds] [exclusion radius]
+#include "src/native_exclusion.h"
+#include "shaders/cpu_gpu_shared.inl"
+#include "shaders/defines.inl" // for EVENT_WINDOW_RADIUS
+#include "core/cpu_timer.h"
+#include "core/container.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static u32 xorshift32(u32& s) {
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+int main(int argc, char** argv) {
+	int world_size = argc > 1 ? atoi(argv[1]) : 1024;
+	int rounds = argc > 2 ? atoi(argv[2]) : 10;
+	int radius = argc > 3 ? atoi(argv[3]) : EVENT_WINDOW_RADIUS * 2;
+	if (world_size <= 0 || rounds <= 0 || radius < 0 || radius > EVENT_WINDOW_RADIUS * 2) {
+		printf("usage: exclusion_bench [world size] [rounds] [exclusion radius, 0 to %d]\n", EVENT_WINDOW_RADIUS * 2);
+		return 1;
+	}
+	ivec2 vote_size = ivec2(world_size + EVENT_WINDOW_RADIUS * 2 * 2);
+	s64 site_count = s64(world_size) * world_size;
+
+	Bunch<u32> vote;
+	vote.setgarbage(s64(vote_size.x) * vote_size.y);
+	Bunch<u8> expected, active;
+	expected.setgarbage(site_count);
+	active.setgarbage(site_count);
+
+	u32 rng = 0x2545f491;
+	for (int i = 0; i < vote.count; ++i)
+		vote[i] = xorshift32(rng) & 0xffff; // narrow range, so ties (where both sites lose) actually happen
+
+	// every radius a program can end up with has to match the reference, whole and in two bands split in the middle
+	int failures = 0;
+	int mid = world_size / 2;
+	for (int r = 0; r <= EVENT_WINDOW_RADIUS * 2; ++r) {
+		exclusionComputeMask(ExclusionKernel_reference, vote.ptr, vote_size, r, 0, world_size, expected.ptr);
+		for (int k = ExclusionKernel_reference + 1; k < ExclusionKernel_count; ++k) {
+			ExclusionKernel kernel = ExclusionKernel(k);
+			if (!exclusionKernelSupported(kernel))
+				continue;
+			memset(active.ptr, 0xff, size_t(active.bytes()));
+			exclusionComputeMask(kernel, vote.ptr, vote_size, r, 0, world_size, active.ptr);
+			bool match = memcmp(active.ptr, expected.ptr, size_t(active.bytes())) == 0;
+			memset(active.ptr, 0xff, size_t(active.bytes()));
+			exclusionComputeMask(kernel, vote.ptr, vote_size, r, 0, mid, active.ptr);
+			exclusionComputeMask(kernel, vote.ptr, vote_size, r, mid, world_size, active.ptr + s64(mid) * world_size);
+			match &= memcmp(active.ptr, expected.ptr, size_t(active.bytes())) == 0;
+			if (!match) {
+				printf("  %-10s MISMATCH at radius %d\n", exclusionKernelName(kernel), r);
+				failures += 1;
+			}
+		}
+	}
+
+	exclusionComputeMask(ExclusionKernel_reference, vote.ptr, vote_size, radius, 0, world_size, expected.ptr);
+	s64 winners = 0;
+	for (s64 i = 0; i < site_count; ++i)
+		winners += expected[i];
+	printf("%dx%d world, exclusion radius %d, %lld winners (%.2f%%), %d rounds\n", world_size, world_size, radius,
+		(long long)winners, double(winners) / double(site_count) * 100.0, rounds);
+
+	double reference_ms = 0.0;
+	for (int k = 0; k < ExclusionKernel_count; ++k) {
+		ExclusionKernel kernel = ExclusionKernel(k);
+		if (!exclusionKernelSupported(kernel)) {
+			printf("  %-10s not supported on this cpu\n", exclusionKernelName(kernel));
+			continue;
+		}
+		s64 time_start = time_counter();
+		for (int r = 0; r < rounds; ++r)
+			exclusionComputeMask(kernel, vote.ptr, vote_size, radius, 0, world_size, active.ptr);
+		double ms = time_to_msec(time_counter() - time_start) / rounds;
+		if (kernel == ExclusionKernel_reference)
+			reference_ms = ms;
+		printf("  %-10s %8.3f ms  %7.2f Msites/s  %6.1fx\n", exclusionKernelName(kernel), ms,
+			double(site_count) / (ms * 1000.0), ms > 0.0 ? reference_ms / ms : 0.0);
+	}
+	return failures ? 1 : 0;
+}
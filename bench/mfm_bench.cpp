@@ -0,0 +1,341 @@
+// Standard benchmark: every project in projects/ on the native backend, over a fixed matrix of world sizes.
+// Reports events/sec, AEPS per wall second, per stage times and memory as csv and/or json, and can compare against
+// a csv from an earlier run, flagging every configuration that got slower by more than the tolerance.
+// Build with 'make mfm_bench', run from the repository root: mfm_bench [options], see printUsage.
+#include "src/splat_compiler.h"
+#include "src/native.h"
+#include "core/log.h"
+#include "core/cpu_timer.h"
+#include "core/dir.h"
+#include "core/jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h> // for GetProcessMemoryInfo
+#else
+#include <sys/resource.h> // for getrusage
+#endif
+
+#define BENCH_NAME_MAX 64
+
+// one row of the report, per project and world size
+struct BenchResult {
+	char project[BENCH_NAME_MAX];
+	char schedule[16];
+	int size;
+	int steps;
+	double sec;
+	double events_per_sec;
+	double aeps_per_sec;
+	double live_fraction;
+	double stage_ms[NativeStage_count]; // per step
+	s64 world_bytes;
+	s64 peak_rss_bytes; // of the whole process so far, so it only ever grows over a run
+};
+
+static const char* stage_names[NativeStage_count] = { "vote", "exclusion", "event", "census" };
+
+struct BenchOptions {
+	const char* projects = NULL; // comma separated, all of projects/ if NULL
+	const char* sizes = "64,256,1024,4096";
+	s64 events_per_config = 1 << 24; // steps per size are picked to get about this many events, at least 1
+	int steps = 0;                   // overrides the above if > 0
+	NativeSchedule schedule = NativeSchedule_tiled;
+	int threads = -1;
+	bool shared_site_tests = false;
+	const char* csv_pathfile = NULL;
+	const char* json_pathfile = NULL;
+	const char* baseline_pathfile = NULL;
+	double tolerance = 0.1; // events/sec may drop by this fraction before it counts as a regression
+};
+
+static void printUsage() {
+	printf(
+		"usage: mfm_bench [options]\n"
+		"  --projects A,B,...   projects to run (default: all of projects/, stdlib/ is part of every project)\n"
+		"  --sizes N,N,...      square world sizes (default 64,256,1024,4096)\n"
+		"  --events N           steps per size are picked to run about N events (default 16M)\n"
+		"  --steps N            fixed number of steps for every size instead\n"
+		"  --schedule S         uniform, tiled or vote (default tiled)\n"
+		"  --threads N          worker threads besides the main one\n"
+		"  --shared-site-tests B 1 to compile the rules with shared site tests, 0 without (default), for\n"
+		"                       comparing the two: --csv a run with 0, then --baseline it with 1\n"
+		"  --csv FILE           write the results as csv\n"
+		"  --json FILE          write the results as json\n"
+		"  --baseline FILE      compare events/sec against a csv from an earlier run\n"
+		"  --tolerance F        slowdown that counts as a regression (default 0.1 = 10%%)\n");
+}
+
+static const char* scheduleName(NativeSchedule schedule) {
+	switch (schedule) {
+	case NativeSchedule_uniform: return "uniform";
+	case NativeSchedule_tiled: return "tiled";
+	case NativeSchedule_vote: return "vote";
+	}
+	return "unknown";
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions* opt) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* val = i + 1 < argc ? argv[++i] : NULL;
+		if (!val) {
+			printf("Missing value for '%s'\n", arg);
+			return false;
+		}
+		if (!strcmp(arg, "--projects")) opt->projects = val;
+		else if (!strcmp(arg, "--sizes")) opt->sizes = val;
+		else if (!strcmp(arg, "--events")) opt->events_per_config = strtoll(val, NULL, 0);
+		else if (!strcmp(arg, "--steps")) opt->steps = atoi(val);
+		else if (!strcmp(arg, "--threads")) opt->threads = atoi(val);
+		else if (!strcmp(arg, "--shared-site-tests")) opt->shared_site_tests = atoi(val) != 0;
+		else if (!strcmp(arg, "--csv")) opt->csv_pathfile = val;
+		else if (!strcmp(arg, "--json")) opt->json_pathfile = val;
+		else if (!strcmp(arg, "--baseline")) opt->baseline_pathfile = val;
+		else if (!strcmp(arg, "--tolerance")) opt->tolerance = atof(val);
+		else if (!strcmp(arg, "--schedule")) {
+			if (!strcmp(val, "uniform")) opt->schedule = NativeSchedule_uniform;
+			else if (!strcmp(val, "tiled")) opt->schedule = NativeSchedule_tiled;
+			else if (!strcmp(val, "vote")) opt->schedule = NativeSchedule_vote;
+			else {
+				printf("Unknown schedule '%s'\n", val);
+				return false;
+			}
+		} else {
+			printf("Unknown option '%s'\n", arg);
+			return false;
+		}
+	}
+	return true;
+}
+
+// splits a comma separated list, skipping empty entries
+static void splitList(const char* list, Bunch<StringRange>* out) {
+	const char* start = list;
+	for (const char* c = list; ; ++c) {
+		if (*c == ',' || *c == 0) {
+			if (c != start)
+				out->push(StringRange(start, c - start));
+			if (*c == 0) break;
+			start = c + 1;
+		}
+	}
+}
+
+static Bunch<StringRange> all_projects;
+static Bunch<char*> all_project_names; // owns the strings above, dirScan's go away after the callback
+static void projectCallback(const char* pathfile, const char* name) {
+	if (name[0] == '.') return;
+	size_t len = strlen(name);
+	char* copy = (char*)malloc(len + 1);
+	memcpy(copy, name, len + 1);
+	all_project_names.push(copy);
+	all_projects.push(StringRange(copy, len));
+}
+
+static s64 peakRssBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+	return s64(pmc.PeakWorkingSetSize);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	return s64(usage.ru_maxrss) * 1024; // in KiB on Linux
+#endif
+}
+
+static void runConfig(NativeWorld* world, const BenchOptions* opt, StringRange project, int size, BenchResult* r) {
+	memset(r, 0, sizeof(*r));
+	snprintf(r->project, sizeof(r->project), "%.*s", int(project.len), project.str);
+	snprintf(r->schedule, sizeof(r->schedule), "%s", scheduleName(opt->schedule));
+	r->size = size;
+	s64 sites = s64(size) * size;
+	r->steps = opt->steps > 0 ? opt->steps : int(max(s64(1), opt->events_per_config / sites));
+
+	world->schedule = opt->schedule;
+	world->resize(ivec2(size));
+	world->reset();
+
+	s64 time_start = time_counter();
+	for (int i = 0; i < r->steps; ++i)
+		world->step();
+	r->sec = time_to_sec(time_counter() - time_start);
+
+	r->events_per_sec = r->sec > 0.0 ? double(world->events_since_reset) / r->sec : 0.0;
+	r->aeps_per_sec = r->sec > 0.0 ? double(world->events_since_reset) / double(sites) / r->sec : 0.0;
+	r->live_fraction = world->events_since_reset ? double(world->live_events_since_reset) / double(world->events_since_reset) : 0.0;
+	for (int s = 0; s < NativeStage_count; ++s)
+		r->stage_ms[s] = time_to_msec(world->stage_time[s]) / r->steps;
+	r->world_bytes = world->bytes();
+	r->peak_rss_bytes = peakRssBytes();
+	world->resize(ivec2(0)); // don't let a big world linger into the next config's peak memory
+}
+
+static void writeCsv(FILE* f, const Bunch<BenchResult>& results) {
+	fprintf(f, "project,schedule,size,steps,sec,events_per_sec,aeps_per_sec,live_fraction");
+	for (int s = 0; s < NativeStage_count; ++s)
+		fprintf(f, ",%s_ms", stage_names[s]);
+	fprintf(f, ",world_bytes,peak_rss_bytes\n");
+	for (int i = 0; i < results.count; ++i) {
+		const BenchResult& r = results[i];
+		fprintf(f, "%s,%s,%d,%d,%.6f,%.1f,%.4f,%.4f", r.project, r.schedule, r.size, r.steps, r.sec, r.events_per_sec, r.aeps_per_sec, r.live_fraction);
+		for (int s = 0; s < NativeStage_count; ++s)
+			fprintf(f, ",%.4f", r.stage_ms[s]);
+		fprintf(f, ",%lld,%lld\n", (long long)r.world_bytes, (long long)r.peak_rss_bytes);
+	}
+}
+static void writeJson(FILE* f, const Bunch<BenchResult>& results) {
+	fprintf(f, "{\n  \"threads\": %d,\n  \"exclusion_kernel\": \"%s\",\n  \"shared_site_tests\": %s,\n  \"results\": [\n", jobsThreadCount(),
+		exclusionKernelName(exclusionBestKernel()), getSharedSiteTestsEnabled() ? "true" : "false");
+	for (int i = 0; i < results.count; ++i) {
+		const BenchResult& r = results[i];
+		fprintf(f, "    {\"project\": \"%s\", \"schedule\": \"%s\", \"size\": %d, \"steps\": %d, \"sec\": %.6f, \"events_per_sec\": %.1f, \"aeps_per_sec\": %.4f, \"live_fraction\": %.4f, \"stage_ms\": {",
+			r.project, r.schedule, r.size, r.steps, r.sec, r.events_per_sec, r.aeps_per_sec, r.live_fraction);
+		for (int s = 0; s < NativeStage_count; ++s)
+			fprintf(f, "%s\"%s\": %.4f", s ? ", " : "", stage_names[s], r.stage_ms[s]);
+		fprintf(f, "}, \"world_bytes\": %lld, \"peak_rss_bytes\": %lld}%s\n", (long long)r.world_bytes, (long long)r.peak_rss_bytes, i + 1 < results.count ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+// Reads project, schedule, size and events_per_sec back from a csv written by writeCsv.
+static bool readBaseline(const char* pathfile, Bunch<BenchResult>* out) {
+	FILE* f = fopen(pathfile, "rb");
+	if (!f) {
+		logError("BENCH", 0, "Couldn't open baseline '%s'", pathfile);
+		return false;
+	}
+	char line[1024];
+	bool header = true;
+	while (fgets(line, sizeof(line), f)) {
+		if (header) {
+			header = false;
+			continue;
+		}
+		BenchResult r;
+		memset(&r, 0, sizeof(r));
+		if (sscanf(line, "%63[^,],%15[^,],%d,%d,%lf,%lf", r.project, r.schedule, &r.size, &r.steps, &r.sec, &r.events_per_sec) == 6)
+			out->push(r);
+	}
+	fclose(f);
+	return true;
+}
+// returns the number of regressions
+static int compareToBaseline(const Bunch<BenchResult>& results, const Bunch<BenchResult>& baseline, double tolerance) {
+	int regressions = 0;
+	printf("\n%-16s %-8s %6s %14s %14s %8s\n", "project", "schedule", "size", "baseline ev/s", "events/sec", "ratio");
+	for (int i = 0; i < results.count; ++i) {
+		const BenchResult& r = results[i];
+		const BenchResult* b = NULL;
+		for (int j = 0; j < baseline.count && !b; ++j)
+			if (!strcmp(baseline[j].project, r.project) && !strcmp(baseline[j].schedule, r.schedule) && baseline[j].size == r.size)
+				b = &baseline[j];
+		if (!b || b->events_per_sec <= 0.0) {
+			printf("%-16s %-8s %6d %14s %14.0f %8s\n", r.project, r.schedule, r.size, "-", r.events_per_sec, "new");
+			continue;
+		}
+		double ratio = r.events_per_sec / b->events_per_sec;
+		bool regressed = ratio < 1.0 - tolerance;
+		regressions += regressed ? 1 : 0;
+		printf("%-16s %-8s %6d %14.0f %14.0f %8.3f%s\n", r.project, r.schedule, r.size, b->events_per_sec, r.events_per_sec, ratio, regressed ? "  REGRESSION" : "");
+	}
+	return regressions;
+}
+
+int main(int argc, char** argv) {
+	timeSetStart();
+
+	BenchOptions opt;
+	if (!parseOptions(argc, argv, &opt)) {
+		printUsage();
+		return 1;
+	}
+	Bunch<StringRange> projects;
+	if (opt.projects)
+		splitList(opt.projects, &projects);
+	else {
+		dirScan("projects/", projectCallback);
+		projects = all_projects;
+	}
+	Bunch<StringRange> size_list;
+	splitList(opt.sizes, &size_list);
+	Bunch<int> sizes;
+	for (int i = 0; i < size_list.count; ++i) {
+		int size = atoi(TempStr("%.*s", int(size_list[i].len), size_list[i].str));
+		if (size <= 0) {
+			printf("Bad world size '%.*s'\n", int(size_list[i].len), size_list[i].str);
+			return 1;
+		}
+		sizes.push(size);
+	}
+	if (projects.count == 0 || sizes.count == 0) {
+		printf("Nothing to run\n");
+		return 1;
+	}
+
+	Bunch<BenchResult> baseline;
+	if (opt.baseline_pathfile && !readBaseline(opt.baseline_pathfile, &baseline))
+		return 1;
+
+	jobsInit(opt.threads);
+	setNativeBackendEnabled(true);
+	setSharedSiteTestsEnabled(opt.shared_site_tests);
+
+	int failures = 0;
+	Bunch<BenchResult> results;
+	NativeWorld world;
+	world.seed = 1;
+	for (int p = 0; p < projects.count; ++p) {
+		ProgramInfo info;
+		if (!compileSplatProject(projects[p], &info)) {
+			logError("BENCH", 0, "Skipping '%.*s', it doesn't compile", int(projects[p].len), projects[p].str);
+			failures += 1;
+			continue;
+		}
+		for (int s = 0; s < sizes.count; ++s) {
+			BenchResult& r = results.push();
+			runConfig(&world, &opt, projects[p], sizes[s], &r);
+			logInfo("BENCH", "%s %s %dx%d, %d steps: %.3f sec, %.3f M events/sec, %.3f AEPS/sec, %.1f%% live, %.1f MiB world",
+				r.project, r.schedule, r.size, r.size, r.steps, r.sec, r.events_per_sec / 1000000.0, r.aeps_per_sec, r.live_fraction * 100.0, double(r.world_bytes) / (1024.0 * 1024.0));
+		}
+	}
+	world.destroy();
+
+	if (opt.csv_pathfile) {
+		FILE* f = fopen(opt.csv_pathfile, "wb");
+		if (f) {
+			writeCsv(f, results);
+			fclose(f);
+		} else {
+			logError("BENCH", 0, "Couldn't open '%s' for writing", opt.csv_pathfile);
+			failures += 1;
+		}
+	}
+	if (opt.json_pathfile) {
+		FILE* f = fopen(opt.json_pathfile, "wb");
+		if (f) {
+			writeJson(f, results);
+			fclose(f);
+		} else {
+			logError("BENCH", 0, "Couldn't open '%s' for writing", opt.json_pathfile);
+			failures += 1;
+		}
+	}
+	if (!opt.csv_pathfile && !opt.json_pathfile)
+		writeCsv(stdout, results);
+
+	int regressions = 0;
+	if (opt.baseline_pathfile) {
+		regressions = compareToBaseline(results, baseline, opt.tolerance);
+		printf("%d regressions (more than %.0f%% slower)\n", regressions, opt.tolerance * 100.0);
+	}
+
+	nativeDestroy();
+	jobsTerm();
+	for (int i = 0; i < all_project_names.count; ++i)
+		free(all_project_names[i]);
+	return (failures || regressions) ? 1 : 0;
+}
@@ -25,7 +25,7 @@ static __inline int64_t time_counter() {
          assert("Can't clock :( where's my clock?");
          return -1L;
      }
-	 return ts1.tv_nsec;
+	 return (int64_t)ts1.tv_sec * 1000000000LL + ts1.tv_nsec;
 }
 static __inline int64_t time_frequency() {
 	return 1000000000L;
@@ -69,5 +69,8 @@ void dirCreate(const char* directory) {
 	CreateDirectory(directory, NULL);
 }
 #else
-#error "Need a CreateDirectory equivalent (something that makes a directory of a given name, if it doesn't already exist)"
+#include <sys/stat.h>
+void dirCreate(const char* directory) {
+	mkdir(directory, 0755);
+}
 #endif
\ No newline at end of file
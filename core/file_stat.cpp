@@ -24,7 +24,10 @@ void fileDelete(const char* filename) {
 	DeleteFile(filename);
 }
 #else
-#error "Need a DeleteFile equivalent"
+#include <unistd.h>
+void fileDelete(const char* filename) {
+	unlink(filename);
+}
 #endif
 
 char* fileReadBinaryIntoMem(const char* pathfile, size_t* bytesize_out) {
@@ -68,4 +71,20 @@ bool fileWriteBinary(const char* pathfile, char* bytes, size_t bytesize) {
 	} else {
 		return false;
 	}
-}
\ No newline at end of file
+}
+bool fileSeek(FILE* f, u64 offset) {
+#ifdef _WIN32
+	return _fseeki64(f, s64(offset), SEEK_SET) == 0;
+#else
+	return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+u64 fileSize(FILE* f) {
+#ifdef _WIN32
+	_fseeki64(f, 0, SEEK_END);
+	return u64(_ftelli64(f));
+#else
+	fseeko(f, 0, SEEK_END);
+	return u64(ftello(f));
+#endif
+}
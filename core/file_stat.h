@@ -1,6 +1,7 @@
 #pragma once
 #include "basic_types.h"
 #include "stdlib.h" // for size_t
+#include <stdio.h>  // for FILE
 #include "string_range.h"
 
 struct FileStats {
@@ -12,4 +13,7 @@ void fileDelete(const char* filename);
 
 char* fileReadBinaryIntoMem(const char* pathfile, size_t* bytesize = 0); 
 char* fileReadCStringIntoMem(const char* pathfile, size_t* bytesize = 0); 
-bool fileWriteBinary(const char* pathfile, char* bytes, size_t bytesize);
\ No newline at end of file
+bool fileWriteBinary(const char* pathfile, char* bytes, size_t bytesize);
+// 64 bit offsets, so files past 2 GiB work with 32 bit longs (windows) too
+bool fileSeek(FILE* f, u64 offset);
+u64 fileSize(FILE* f); // leaves the position at the end
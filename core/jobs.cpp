@@ -0,0 +1,215 @@
+#include "jobs.h"
+#include "core/log.h"
+#include "core/maths.h" // for max
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <deque>
+
+struct Job {
+	JobFunc func = 0;
+	JobFunc2D func_2d = 0;
+	void* data = 0;
+	int count = 0;
+	int width = 1;   // for 2D jobs, to turn indices back into coordinates
+	int grain = 1;   // ranges up to this size aren't split any further
+
+	std::atomic<int> remaining;     // indices that haven't finished yet
+	std::atomic<int> blockers;      // unfinished deps, +1 until submission is done
+	std::atomic<bool> finished;
+	std::mutex mutex;               // guards dependents and the transition to finished
+	std::vector<Job*> dependents;
+};
+
+namespace {
+
+struct Task {
+	Job* job;
+	int begin, end;
+};
+
+struct TaskQueue {
+	std::mutex mutex;
+	std::deque<Task> tasks;
+};
+
+};
+
+// queue 0 belongs to threads that aren't workers (the main thread, or anyone else submitting)
+static std::vector<std::thread> workers;
+static TaskQueue* queues = 0;
+static int queue_count = 0;
+static thread_local int queue_idx = 0;
+static std::atomic<bool> shutting_down;
+static std::atomic<unsigned> work_signal; // bumped on every push, so sleepers know to look again
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_cv;
+
+static void pushTask(Task t) {
+	TaskQueue& q = queues[queue_idx];
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks.push_back(t);
+	}
+	{ // under the sleep lock, so a worker between checking the signal and blocking can't miss it
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		work_signal.fetch_add(1);
+	}
+	sleep_cv.notify_one();
+}
+static bool popTask(Task* t) {
+	{ // newest first from our own queue, it's the most likely to still be in cache
+		TaskQueue& q = queues[queue_idx];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			*t = q.tasks.back();
+			q.tasks.pop_back();
+			return true;
+		}
+	}
+	// oldest first from everyone else, those are the biggest ranges
+	for (int i = 1; i < queue_count; ++i) {
+		TaskQueue& q = queues[(queue_idx + i) % queue_count];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			*t = q.tasks.front();
+			q.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void scheduleJob(Job* job);
+static void finishJob(Job* job) {
+	std::vector<Job*> dependents;
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		dependents.swap(job->dependents);
+		job->finished = true; // the waiter may free the job as soon as the lock is released
+	}
+	for (size_t i = 0; i < dependents.size(); ++i)
+		if (dependents[i]->blockers.fetch_sub(1) == 1)
+			scheduleJob(dependents[i]);
+}
+static void scheduleJob(Job* job) {
+	if (job->count == 0)
+		finishJob(job);
+	else
+		pushTask({ job, 0, job->count });
+}
+static void runTask(Task t) {
+	Job* job = t.job;
+	// keep half of anything big enough for others to steal
+	while (t.end - t.begin > job->grain) {
+		int mid = t.begin + (t.end - t.begin) / 2;
+		pushTask({ job, mid, t.end });
+		t.end = mid;
+	}
+	for (int i = t.begin; i < t.end; ++i) {
+		if (job->func_2d)
+			job->func_2d(job->data, ivec2(i % job->width, i / job->width));
+		else
+			job->func(job->data, i);
+	}
+	int n = t.end - t.begin;
+	if (job->remaining.fetch_sub(n) == n)
+		finishJob(job);
+}
+static bool runOneTask() {
+	Task t;
+	if (!popTask(&t)) return false;
+	runTask(t);
+	return true;
+}
+
+static void workerMain(int idx) {
+	queue_idx = idx;
+	while (!shutting_down) {
+		unsigned seen_signal = work_signal;
+		if (runOneTask()) continue;
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleep_cv.wait(lock, [&] { return shutting_down || work_signal != seen_signal; });
+	}
+}
+
+void jobsInit(int worker_count) {
+	if (queues) return;
+	if (worker_count < 0)
+		worker_count = max(int(std::thread::hardware_concurrency()) - 1, 0);
+	shutting_down = false;
+	work_signal = 0;
+	queue_count = worker_count + 1;
+	queues = new TaskQueue[queue_count];
+	for (int i = 0; i < worker_count; ++i)
+		workers.push_back(std::thread(workerMain, i + 1));
+	logInfo("JOBS", "Started %d worker threads", worker_count);
+}
+void jobsTerm() {
+	if (!queues) return;
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		shutting_down = true;
+	}
+	sleep_cv.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+	while (runOneTask()) {} // what's still queued runs here, so a job submitted before can still be waited on after
+	delete[] queues;
+	queues = 0;
+	queue_count = 0;
+}
+int jobsThreadCount() {
+	return int(workers.size()) + 1;
+}
+
+static Job* submit(Job* job, Job* const* deps, int dep_count) {
+	if (!queues) jobsInit(0); // nobody set us up, run everything on the calling thread
+	job->remaining = job->count;
+	job->finished = false;
+	job->grain = max(1, job->count / (jobsThreadCount() * 4));
+	job->blockers = 1;
+	for (int i = 0; i < dep_count; ++i) {
+		std::lock_guard<std::mutex> lock(deps[i]->mutex);
+		if (!deps[i]->finished) {
+			deps[i]->dependents.push_back(job);
+			job->blockers.fetch_add(1);
+		}
+	}
+	if (job->blockers.fetch_sub(1) == 1)
+		scheduleJob(job);
+	return job;
+}
+Job* jobsSubmit(int count, JobFunc func, void* data, Job* const* deps, int dep_count) {
+	Job* job = new Job;
+	job->func = func;
+	job->data = data;
+	job->count = max(count, 0);
+	return submit(job, deps, dep_count);
+}
+Job* jobsSubmit2D(ivec2 count, JobFunc2D func, void* data, Job* const* deps, int dep_count) {
+	Job* job = new Job;
+	job->func_2d = func;
+	job->data = data;
+	job->width = max(count.x, 1);
+	job->count = max(count.x, 0) * max(count.y, 0);
+	return submit(job, deps, dep_count);
+}
+void jobsWait(Job* job) {
+	while (!job->finished) {
+		if (!runOneTask())
+			std::this_thread::yield();
+	}
+	{ std::lock_guard<std::mutex> lock(job->mutex); } // make sure finishJob has let go of it
+	delete job;
+}
+
+void jobsParallelFor(int count, JobFunc func, void* data) {
+	jobsWait(jobsSubmit(count, func, data));
+}
+void jobsParallelFor2D(ivec2 count, JobFunc2D func, void* data) {
+	jobsWait(jobsSubmit2D(count, func, data));
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "core/vec2.h"
+
+// Work stealing job system for data parallel work on the CPU.
+// Every thread (workers and whoever submits) has its own deque of tasks. Owners pop from the back, idle threads steal
+// from the front of someone else's, and big index ranges are split in half on the fly, so uneven work spreads itself out.
+// Waiting threads help out, so everything also works with 0 workers.
+
+struct Job;
+
+typedef void(*JobFunc)(void* data, int index);
+typedef void(*JobFunc2D)(void* data, ivec2 index);
+
+void jobsInit(int worker_count = -1); // -1 = one less than the number of hardware threads
+void jobsTerm(); // runs whatever is still queued, its jobs can still be waited on afterwards
+int  jobsThreadCount(); // workers + the calling thread
+
+// Runs func(data, i) for i in [0, count) once every job in 'deps' has finished, in no particular order and on any thread.
+// Every submitted job has to be waited on exactly once, which also releases it, so deps must not have been waited on yet.
+Job* jobsSubmit(int count, JobFunc func, void* data, Job* const* deps = 0, int dep_count = 0);
+Job* jobsSubmit2D(ivec2 count, JobFunc2D func, void* data, Job* const* deps = 0, int dep_count = 0); // row major over [0, count)
+void jobsWait(Job* job);
+
+// blocking versions of the above
+void jobsParallelFor(int count, JobFunc func, void* data);
+void jobsParallelFor2D(ivec2 count, JobFunc2D func, void* data);
@@ -14,7 +14,7 @@ void log(const char * format, ...) {
 	va_list args;
 	va_start(args, format);
 
-	static char buff[4096]; 
+	static thread_local char buff[4096]; 
 	
 #ifdef _WIN32
 	vsprintf_s(buff, format, args);
@@ -31,7 +31,7 @@ void logError(const char* system, int code, const char * format, ...) {
 	va_list args;
 	va_start(args, format);
 
-	static char buff[4096]; 
+	static thread_local char buff[4096]; 
 	char* str = buff;
 	int64_t t = timeCounterSinceStart();
 	int64_t f = time_frequency();
@@ -54,7 +54,7 @@ void logInfo(const char* system, const char * format, ...) {
 	va_list args;
 	va_start(args, format);
 
-	static char buff[4096]; 
+	static thread_local char buff[4096]; 
 	char* str = buff;
 	int64_t t = timeCounterSinceStart();
 	int64_t f = time_frequency();
@@ -71,8 +71,8 @@ void logInfo(const char* system, const char * format, ...) {
 }
 
 #define TEMPSTR_STACK_COUNT 4
-static char tempstr_stack[TEMPSTR_STACK_COUNT][2048];
-static int tempstr_idx = 0;
+static thread_local char tempstr_stack[TEMPSTR_STACK_COUNT][2048]; // per thread, so jobs can format strings too
+static thread_local int tempstr_idx = 0;
 static const char* error_str = "Out of temp strings :(";
 TempStr::TempStr(const char* format, ...) {
 	if (tempstr_idx < (TEMPSTR_STACK_COUNT - 1)) {
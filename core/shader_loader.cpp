@@ -6,6 +6,8 @@
 #include "core/string_range.h"
 #include "core/file_stat.h"
 #include "core/dir.h"
+#include "core/crc.h"
+#include "core/jobs.h"
 
 #include "wrap/evk.h"
 #include <GLFW/glfw3.h>
@@ -24,6 +26,8 @@
 
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
 
 static void guiSetErroredFile(int idx);
 static void guiSetErroredProg(int idx);
@@ -61,6 +65,7 @@ namespace {
 		std::vector<int> prog_idxs;             // the indecies of programs to notify of changes
 		String log;
 		String final_text;
+		String spirv_pathfile;                  // content addressed cache entry for final_text, see checkAllFilesForUpdates
 		s64 time_to_compile = 0;
 		char** source_dump_location = 0;
 	};
@@ -364,11 +369,185 @@ static void listShaderFiles(int file_idx, std::vector<const char*>* texts, std::
 		}
 	}
 }
+namespace {
+	struct CompileRequest {
+		int shader_idx;
+		StringRange name;           // of the main file, picks the stage
+		StringRange text;           // the shader's final_text, which isn't touched while its batch runs
+		StringRange spirv_pathfile;
+		String log;
+		VkShaderModule module;
+		s64 t_start;
+	};
+}
+// Changed shaders compile as a job while the old modules keep running. A finished batch is only taken once shadersPoll
+// has seen it done at the start of a frame, so everyone sees the new modules in the same frame.
+static std::vector<CompileRequest> requests;
+static Job* compile_job = NULL;
+static std::atomic<int> compiles_running(0);
+static bool batch_running = false;
+static bool batch_collectable = false;
+
+#define SPIRV_CACHE_KEEP 4 // entries per shader, so going back to a recent edit or another project is still a hit
+
+namespace {
+	struct CacheEntry {
+		char pathfile[256];
+		s64 mtime;
+	};
+}
+static thread_local StringRange prune_name; // dirScan callbacks take no user data, and compile jobs prune in parallel
+static thread_local std::vector<CacheEntry>* prune_entries;
+static bool isHex(const char* str, size_t len) {
+	for (size_t i = 0; i < len; ++i)
+		if (!((str[i] >= '0' && str[i] <= '9') || (str[i] >= 'a' && str[i] <= 'f')))
+			return false;
+	return len > 0;
+}
+static void pruneCallback(const char* pathfile, const char* name, const char* ext) {
+	// name is <shader>.<crc>.<text length>, and shader names have dots of their own
+	size_t name_len = strlen(name);
+	if (name_len <= prune_name.len + 1 || memcmp(name, prune_name.str, prune_name.len) != 0 || name[prune_name.len] != '.')
+		return;
+	const char* key = name + prune_name.len + 1;
+	const char* dot = strchr(key, '.');
+	if (!dot || dot - key != 8 || !isHex(key, 8) || !isHex(dot + 1, strlen(dot + 1)))
+		return;
+	FileStats stats;
+	if (fileStat(pathfile, &stats) != 0)
+		return;
+	CacheEntry e;
+	snprintf(e.pathfile, sizeof(e.pathfile), "%s", pathfile);
+	e.mtime = stats.fs_mtime;
+	prune_entries->push_back(e);
+}
+// Keeps the SPIRV_CACHE_KEEP newest entries of the shader, the one just written being one of them, and deletes the rest.
+static void pruneSpirvCache(StringRange name, StringRange keep_pathfile) {
+	std::vector<CacheEntry> entries;
+	prune_name = name;
+	prune_entries = &entries;
+	dirScan("shaders_bin/cache/", ".spv", pruneCallback);
+	prune_entries = NULL;
+	std::sort(entries.begin(), entries.end(), [&](const CacheEntry& a, const CacheEntry& b) {
+		bool a_keep = keep_pathfile == StringRange(a.pathfile);
+		bool b_keep = keep_pathfile == StringRange(b.pathfile);
+		if (a_keep != b_keep) return a_keep;
+		return a.mtime > b.mtime;
+	});
+	for (size_t i = SPIRV_CACHE_KEEP; i < entries.size(); ++i) {
+		fileDelete(entries[i].pathfile);
+		log("[SHADER LOADER] Removed old cache entry %s\n", entries[i].pathfile);
+	}
+}
+
+#ifdef EVK_SHADERC
+// in glslc's format, so the shader's log reads the same with either backend. Frees the diagnostics' strings
+static void formatDiagnostics(Bunch<EvkShaderDiagnostic>* diagnostics, String* out) {
+	static const char* severity_names[] = { "error", "warning", "note" };
+	for (int i = 0; i < diagnostics->count; ++i) {
+		EvkShaderDiagnostic& d = (*diagnostics)[i];
+		if (d.severity != EvkShaderSeverity_note) {
+			out->append(d.file.range());
+			if (d.line)
+				out->append(TempStr(":%d", d.line));
+			out->append(TempStr(": %s: ", severity_names[d.severity]));
+		}
+		out->append(d.text.range());
+		out->append("\n");
+		d.free();
+	}
+	diagnostics->clear();
+}
+#endif
+
+static bool isSpirv(const char* code, size_t bytes) {
+	return bytes >= 4 && bytes % 4 == 0 && *(const u32*)code == 0x07230203; // a cache file cut short by a crash shouldn't be used
+}
+static void compileJob(void* data, int index) {
+	CompileRequest* req = (CompileRequest*)data + index;
+	size_t spirv_bytes = 0;
+	char* spirv = fileReadBinaryIntoMem(req->spirv_pathfile.str, &spirv_bytes);
+	if (spirv && isSpirv(spirv, spirv_bytes)) {
+		req->module = evkCreateShaderFromSpirv(spirv, spirv_bytes);
+		free(spirv);
+		log("[SHADER LOADER] %s from %s\n", req->name.str, req->spirv_pathfile.str);
+		compiles_running -= 1;
+		return;
+	}
+	free(spirv);
+
+	// only clean compiles are kept, a shader with warnings is reported as failed and has to show its log again next time
+#ifdef EVK_SHADERC
+	String code;
+	Bunch<EvkShaderDiagnostic> diagnostics;
+	req->module = evkCreateShaderFromText(req->name.str, req->text.str, req->text.len, &diagnostics, &code);
+	formatDiagnostics(&diagnostics, &req->log);
+	if (req->log.len)
+		log("--- Output ---\n\n%.*s--------------\n", int(req->log.len), req->log.str);
+	if (req->module != VK_NULL_HANDLE && req->log.len == 0 && fileWriteBinary(req->spirv_pathfile.str, code.str, code.len))
+		pruneSpirvCache(req->name, req->spirv_pathfile);
+	code.free();
+#else
+	// Write the final text to file, so that the compiler can read it.
+	fileWriteBinary(TempStr("shaders_bin/%s", req->name.str), (char*)req->text.str, req->text.len);
+	req->module = evkCreateShaderFromFile(TempStr("shaders_bin/%s", req->name.str), &req->log);
+
+	if (req->module != VK_NULL_HANDLE && req->log.len == 0) {
+		spirv = fileReadBinaryIntoMem(TempStr("shaders_bin/%s.spv", req->name.str), &spirv_bytes);
+		if (spirv) {
+			if (fileWriteBinary(req->spirv_pathfile.str, spirv, spirv_bytes))
+				pruneSpirvCache(req->name, req->spirv_pathfile);
+			free(spirv);
+		}
+	}
+#endif
+	compiles_running -= 1;
+}
+static void collectCompileBatch() {
+	jobsWait(compile_job);
+	compile_job = NULL;
+
+	for (CompileRequest& req : requests) {
+		ShaderEntry& s = shader_entries[req.shader_idx];
+		VkShaderModule module = req.module;
+		s.log.clear();
+		s.log.append(req.log.range());
+		req.log.free();
+		if (s.log.len > 0) { // errors or warnings
+			if (module != VK_NULL_HANDLE)
+				vkDestroyShaderModule(evk.dev, module, evk.alloc);
+			s.stale_module = true;
+			guiSetErroredFile(s.file_idx);
+			any_errors_since_last_check = true;
+		} else {
+			s.stale_module = false;
+			if (s.module != VK_NULL_HANDLE)
+				vkDestroyShaderModule(evk.dev, s.module, evk.alloc);
+			s.module = module;
+			s.changed_module = true;
+		}
+		
+		s.time_to_compile = time_counter() - req.t_start;
+	}
+	requests.clear();
+	batch_running = false;
+	batch_collectable = false;
+}
 static void checkAllFilesForUpdates() {
 	for (int i = 0; i < (int)file_entries.size(); ++i)
 		checkForUpdates(i, file_entries[i].path);
-	for (ShaderEntry& s : shader_entries) {
+	for (ShaderEntry& s : shader_entries)
 		s.changed_module = false;
+
+	// changes wait for the running batch, since it reads the final texts
+	if (batch_running) {
+		if (!batch_collectable)
+			return;
+		collectCompileBatch();
+	}
+
+	bool wait_for_batch = false;
+	for (ShaderEntry& s : shader_entries) {
 		if (s.stale_file) {
 			//PrintTimer t(file_entries[s.file_idx].name.str);
 			s.stale_file = false;
@@ -444,29 +623,35 @@ static void checkAllFilesForUpdates() {
 			}
 
 			dirCreate("shaders_bin");
+			dirCreate("shaders_bin/cache");
 
-			// Write the final text to file, so that the compiler can read it.
-			fileWriteBinary(TempStr("shaders_bin/%s", f.file.str), s.final_text.str, s.final_text.len);
+			// the compiler only runs if there's no spir-v for this exact text, compiler and flags yet, eg. on startup or when switching back to a project
+			static const char* compiler = EVK_SHADER_BACKEND " " EVK_GLSLC_FLAGS;
+			u32 crc = crc32(0, compiler, strlen(compiler));
+			crc = crc32(crc, s.final_text.str, s.final_text.len);
+			s.spirv_pathfile.set(TempStr("shaders_bin/cache/%s.%08x.%x.spv", f.file.str, crc, unsigned(s.final_text.len)));
 
-			// Run compiler
-			VkShaderModule module = evkCreateShaderFromFile(TempStr("shaders_bin/%s", f.file.str), &s.log);
-			if (s.log.len > 0) { // errors or warnings
-				if (module != VK_NULL_HANDLE)
-					vkDestroyShaderModule(evk.dev, module, evk.alloc);
-				s.stale_module = true;
-				guiSetErroredFile(s.file_idx);
-				any_errors_since_last_check = true;
-			} else {
-				s.stale_module = false;
-				if (s.module != VK_NULL_HANDLE)
-					vkDestroyShaderModule(evk.dev, s.module, evk.alloc);
-				s.module = module;
-				s.changed_module = true;
-			}
-			
-			s.time_to_compile = time_counter() - t_start; // do this after Get COMPILE_STATUS because that seems to actually block waiting for compiler to finish
+			CompileRequest req;
+			req.shader_idx = int(&s - shader_entries.data());
+			req.name = StringRange(f.file.str);
+			req.text = s.final_text.range();
+			req.spirv_pathfile = s.spirv_pathfile.range();
+			req.module = VK_NULL_HANDLE;
+			req.t_start = t_start;
+			requests.push_back(req);
+			wait_for_batch |= s.module == VK_NULL_HANDLE; // nothing to keep running in the meantime, eg. on startup
 		}
 	}
+
+	// every shader is an index of the job, so the workers spread a batch over the cores
+	if (!requests.empty()) {
+		batch_running = true;
+		batch_collectable = false;
+		compiles_running = int(requests.size());
+		compile_job = jobsSubmit(int(requests.size()), compileJob, requests.data());
+		if (wait_for_batch || jobsThreadCount() == 1) // without workers, nothing runs the job until it's waited on
+			collectCompileBatch();
+	}
 #if 0 //#PORT delete
 	for (int i = 0; i < (int)prog_entries.size(); ++i) {
 		ProgEntry& p = prog_entries[i];
@@ -582,6 +767,21 @@ static void programStats(ProgramStats* stats, int prog_idx) {
 		stats->comp_log = 0;
 }
 
+void shadersPoll() {
+	if (batch_running && compiles_running.load() == 0)
+		batch_collectable = true;
+}
+bool shadersCompiling() {
+	if (batch_running && !batch_collectable)
+		return true;
+	for (const FileEntry& f : file_entries)
+		if (f.is_procedural && f.procedurally_modified)
+			return true;
+	for (const ShaderEntry& s : shader_entries)
+		if (s.stale_file)
+			return true;
+	return false;
+}
 VkShaderModule shaderGet(const char* pathfile, bool* changed) {
 	int idx = getShaderEntry(pathfile);
 	checkAllFilesForUpdates();
@@ -589,6 +789,9 @@ VkShaderModule shaderGet(const char* pathfile, bool* changed) {
 	return shader_entries[idx].module;
 }
 void shadersDestroy() {
+	if (batch_running) {
+		collectCompileBatch();
+	}
 	for (int i = 0; i < shader_entries.size(); ++i) {
 		if (shader_entries[i].module != VK_NULL_HANDLE)
 			vkDestroyShaderModule(evk.dev, shader_entries[i].module, evk.alloc);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <stddef.h>     /* For size_t */
+#ifndef MFM_HEADLESS // headless builds only want the defines below
 #include <vulkan/vulkan.h>
+#endif
 
 // should work on Win/Linux now since we are using the same compiler
 #define C_STYLE_LINE_DIRECTIVES // #line n "filename" instead of #line n k
@@ -16,9 +18,15 @@ struct ProgramStats {
 };
 
 void shadersDestroy();
+// Changed shaders compile in the background, call this once at the start of every frame to take finished ones from then on
+void shadersPoll();
+// true while changed or injected shader text hasn't turned into modules yet
+bool shadersCompiling();
 
 void injectProceduralFile(const char* pathfile, const char* text, size_t text_len);
+#ifndef MFM_HEADLESS
 VkShaderModule shaderGet(const char* pathfile, bool* changed);
+#endif
 bool useProgram(const char* vert, const char* frag, ProgramStats* stats = 0);
 bool useProgram(const char* comp, ProgramStats* stats = 0);
 void guiShader(bool* open = 0);
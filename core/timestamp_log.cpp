@@ -1,5 +1,6 @@
 #include "timestamp_log.h"
 #include "cpu_timer.h"
+#include "trace_export.h"
 #include "imgui/imgui.h"
 
 
@@ -352,9 +353,18 @@ void timestampReportGui(const char* id, const TimestampReport* report, bool* sho
 //   CPU/GPU specific implementations      //
 //-----------------------------------------//
 
+// hands the ranges of a finished report to a running trace capture, see core/trace_export.h
+static void traceReport(int track, const TimestampReport* report, double usec_per_count) {
+	if (!traceActive(track)) return;
+	for (int i = 0; i < report->ranges.count; ++i)
+		traceRange(track, report->ranges[i].label.str, report->ranges[i].t_start, report->ranges[i].t_stop, usec_per_count);
+	traceFrameEnd(track);
+}
+
 void CpuTimestampLog::newFrame() {
 	s64 t_frame_start_next = time_counter();
 	log.report(t_frame_start, t_frame_start_next, timestamps.ptr, timestamps.count, &report);
+	traceReport(TraceTrack_cpu, &report, 1000000.0 / double(time_frequency()));
 	timestamps.clear();
 	log.clear();
 	t_frame_start = t_frame_start_next;
@@ -385,6 +395,29 @@ void chashtimer_stop() {
 }
 void ctimer_gui() {
 	timestampReportGui("CPU TIMERS", &ctimer.report, &ctimer.show_timeline, 1000.0f / evk.win.RefreshRate, 1000.0 / double(time_frequency())); // ticks per second -> milliseconds per tick
+
+	// capture the next frames of both timers into a trace file, for chrome://tracing or ui.perfetto.dev
+	static char trace_pathfile[256] = "trace.json";
+	static int trace_frames = 60;
+	if (gui::Begin("CPU TIMERS")) {
+		if (traceActive(TraceTrack_cpu) || traceActive(TraceTrack_gpu)) {
+			gui::Text("Capturing trace...");
+			gui::SameLine();
+			if (gui::Button("stop"))
+				traceEnd();
+		} else {
+			gui::SetNextItemWidth(gui::GetFontSize() * 6.0f);
+			gui::InputInt("frames", &trace_frames);
+			trace_frames = clamp(trace_frames, 1, 10000);
+			gui::SetNextItemWidth(gui::GetFontSize() * 10.0f);
+			gui::InputText("##trace file", trace_pathfile, sizeof(trace_pathfile));
+			gui::SameLine();
+			if (gui::Button("capture trace"))
+				traceBegin(trace_pathfile, trace_frames, (1u << TraceTrack_cpu) | (1u << TraceTrack_gpu));
+			if (traceLastPathfile()[0] && gui::IsItemHovered())
+				gui::SetTooltip("last trace: %s", traceLastPathfile());
+		}
+	} gui::End();
 }
 
 
@@ -472,6 +505,7 @@ void GpuTimestampLog::newFrame(VkCommandBuffer frame_cb) {
 		if (frames[r].timestamps.count && frames[n].timestamps.count) {
 			//log("Composing from r=%d n=%d timestamps, log has %d entries\n", frames[r].timestamps.count, frames[n].timestamps.count, frames[r].log.entries.count);
 			frames[r].log.report(frames[r].timestamps[0], frames[n].timestamps[0], frames[r].timestamps.ptr + 1, frames[r].timestamps.count - 1, &report);
+			traceReport(TraceTrack_gpu, &report, evk.phys_props.limits.timestampPeriod / 1000.0); // nanoseconds per tick -> microseconds
 			frames[r].log.clear();
 			frames[r].timestamps.clear();
 			r = n;
@@ -535,6 +569,7 @@ void gtimer_gui() {
 	timestampReportGui("GPU TIMERS", &gpu_timer.report, &gpu_timer.show_timeline, 1000.0f / evk.win.RefreshRate, evk.phys_props.limits.timestampPeriod / 1000000.0);
 }
 void gtimer_term() {
+	traceEnd();
 	gpu_timer.destroy();
 }
 
@@ -0,0 +1,90 @@
+#include "trace_export.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+
+struct TraceState {
+	FILE* f = NULL;
+	int frame_count = 0;
+	u32 track_mask = 0;
+	int frames[TraceTrack_count];
+	bool has_origin[TraceTrack_count];
+	s64 origin[TraceTrack_count];
+	int event_count = 0;
+	char pathfile[256] = "";
+};
+static TraceState trace;
+
+static const char* track_names[TraceTrack_count] = { "CPU", "GPU" };
+
+static void writeEscaped(FILE* f, const char* s) {
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if (u8(*s) < 0x20)
+			fprintf(f, "\\u%04x", u8(*s));
+		else
+			fputc(*s, f);
+	}
+}
+
+bool traceBegin(const char* pathfile, int frame_count, u32 track_mask) {
+	traceEnd();
+	if (frame_count <= 0 || !(track_mask & ((1u << TraceTrack_count) - 1)))
+		return false;
+	trace.f = fopen(pathfile, "wb");
+	if (!trace.f) {
+		logError("TRACE", 0, "Couldn't open '%s' for writing", pathfile);
+		return false;
+	}
+	snprintf(trace.pathfile, sizeof(trace.pathfile), "%s", pathfile);
+	trace.frame_count = frame_count;
+	trace.track_mask = track_mask;
+	trace.event_count = 0;
+	memset(trace.frames, 0, sizeof(trace.frames));
+	memset(trace.has_origin, 0, sizeof(trace.has_origin));
+
+	// name the process rows, pid is the track + 1
+	fprintf(trace.f, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (int t = 0; t < TraceTrack_count; ++t) {
+		if (!(track_mask & (1u << t))) continue;
+		fprintf(trace.f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", t + 1, track_names[t]);
+		first = false;
+	}
+	return true;
+}
+bool traceActive(int track) {
+	return trace.f && (trace.track_mask & (1u << track)) && trace.frames[track] < trace.frame_count;
+}
+void traceRange(int track, const char* label, s64 t_start, s64 t_stop, double usec_per_tick) {
+	if (!traceActive(track)) return;
+	if (!trace.has_origin[track]) {
+		trace.has_origin[track] = true;
+		trace.origin[track] = t_start;
+	}
+	double ts = double(t_start - trace.origin[track]) * usec_per_tick;
+	double dur = double(t_stop - t_start) * usec_per_tick;
+	fprintf(trace.f, ",\n{\"name\":\"");
+	writeEscaped(trace.f, label);
+	fprintf(trace.f, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"frame\":%d}}", ts, dur, track + 1, trace.frames[track]);
+	trace.event_count += 1;
+}
+void traceFrameEnd(int track) {
+	if (!traceActive(track)) return;
+	trace.frames[track] += 1;
+	for (int t = 0; t < TraceTrack_count; ++t)
+		if (traceActive(t))
+			return;
+	traceEnd();
+}
+void traceEnd() {
+	if (!trace.f) return;
+	fprintf(trace.f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(trace.f);
+	trace.f = NULL;
+	logInfo("TRACE", "Wrote %d ranges to '%s'", trace.event_count, trace.pathfile);
+}
+const char* traceLastPathfile() {
+	return trace.pathfile;
+}
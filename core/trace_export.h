@@ -0,0 +1,26 @@
+#pragma once
+#include "core/basic_types.h"
+
+// Writes timer ranges of a number of frames as a Chrome trace (the JSON "traceEvents" format), which loads in
+// chrome://tracing and https://ui.perfetto.dev. Every track gets its own process row in the viewer and its own time
+// origin, since the CPU and GPU clocks can't be lined up. Events are streamed to the file as they come in.
+// No Vulkan or gui in here, so the headless batch runner can use it too.
+
+enum TraceTrack {
+	TraceTrack_cpu,
+	TraceTrack_gpu,
+	TraceTrack_count
+};
+
+// Starts recording frame_count frames of every track in track_mask (1 << TraceTrack_x) into pathfile, closing any previous trace.
+bool traceBegin(const char* pathfile, int frame_count, u32 track_mask);
+// The trace is open and still wants frames of this track.
+bool traceActive(int track);
+// t_start and t_stop are in ticks of the track's clock, usec_per_tick converts them to microseconds. Nesting follows from the times.
+void traceRange(int track, const char* label, s64 t_start, s64 t_stop, double usec_per_tick);
+// Ends the current frame of the track. Once every track has its frames the file gets closed.
+void traceFrameEnd(int track);
+// Closes the file early, with whatever frames were recorded so far.
+void traceEnd();
+// The last trace written, to show in the gui.
+const char* traceLastPathfile();
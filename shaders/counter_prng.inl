@@ -0,0 +1,49 @@
+// Stateless alternative to xoroshiro128**: Philox2x32-10 from "Parallel Random Numbers: As Easy as 1, 2, 3" (Salmon et al.)
+// Every number is a pure function of (site, key, stream, call), so there is no per site state to seed, load or store.
+// Used when the SPLAT compiler's counter prng switch puts '#define PRNG_COUNTER' into atom_decls.inl.
+// _XORO doubles as the counter and key: [0] = site, [1] = stream in the top 2 bits + calls so far, [2] = key, [3] unused.
+
+#define PRNG_STREAM_RESET 0u
+#define PRNG_STREAM_VOTE  1u
+#define PRNG_STREAM_EVENT 2u
+
+// prng_idx is the site in the padded prng/vote map, 'key' is the dispatch counter (or anything else unique per use of the site)
+XoroshiroState CounterPrngKey(ivec2 prng_idx, uint key, uint stream) {
+	return XoroshiroState(uint(prng_idx.x) | (uint(prng_idx.y) << 16), stream << 30, key, 0u);
+}
+
+#ifdef NATIVE_SHIM_TYPES
+uint PhiloxMulHi(uint a, uint b) {
+	return uint((unsigned long long)(a) * b >> 32);
+}
+#else
+uint PhiloxMulHi(uint a, uint b) {
+	uint hi, lo;
+	umulExtended(a, b, hi, lo);
+	return hi;
+}
+#endif
+
+uint CounterNext32() {
+	uint c0 = _XORO[0];
+	uint c1 = _XORO[1];
+	uint k = _XORO[2];
+	_XORO[1] = c1 + 1u;
+	for (int i = 0; i < 10; ++i) {
+		uint hi = PhiloxMulHi(0xD256D193u, c0);
+		uint lo = 0xD256D193u * c0;
+		c0 = hi ^ k ^ c1;
+		c1 = lo;
+		k += 0x9E3779B9u;
+	}
+	return c0;
+}
+
+// what random_create and friends in prng.inl draw from
+uint PrngNext32() {
+#ifdef PRNG_COUNTER
+	return CounterNext32();
+#else
+	return XoroshiroNext32();
+#endif
+}
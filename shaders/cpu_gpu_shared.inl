@@ -1,9 +1,11 @@
 #if defined(_WIN32) || defined(__GNUC__)
 #pragma once
+#ifndef NATIVE_SHIM_TYPES // the native backend brings its own GLSL-like vector types
 typedef unsigned int uint;
 struct uvec4 {
 	unsigned int x,y,z,w;
 };
+#endif
 #else
 #endif
 
@@ -62,7 +64,7 @@ struct ControlState {
 typedef unsigned int uint;
 #endif
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(__GNUC__)
 struct ComputeUPC {
 #else
 layout(push_constant) uniform UPC {
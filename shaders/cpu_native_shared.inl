@@ -0,0 +1,44 @@
+// Interface between the host and the native (CPU) build of a SPLAT program.
+// Included by both src/native.cpp and shaders/staged_update_native.cpp, so keep it to plain C types.
+#pragma once
+
+#define NATIVE_ABI_VERSION 5
+#define NATIVE_MODULE_ENTRY "nativeGetModule"
+
+struct NativeWorldView {
+	unsigned int* site_bits;   // 4 components per site, size_x * size_y sites
+	unsigned int* prng_state;  // 4 components per site, padded by EVENT_WINDOW_RADIUS*2 on each side (same as the gpu prng image). NULL in counter prng mode
+	unsigned int* event_count; // 1 per site
+	int size_x, size_y;
+	int prng_size_x, prng_size_y; // padded size, also for the vote map
+	unsigned int dispatch_counter;
+};
+
+struct NativeRect {
+	int x0, y0; // inclusive
+	int x1, y1; // exclusive
+};
+
+struct NativeModule {
+	unsigned int abi_version;
+	unsigned int type_count;
+	unsigned int prng_state_size; // uints of prng state per padded site, 0 when built with the counter prng
+	unsigned int exclusion_radius; // votes within this taxicab distance have to lose for an event to run, twice the widest event window
+
+	// STAGE_RESET over rows [prng_y_begin, prng_y_end) of the padded prng map
+	void (*reset)(const NativeWorldView* world, int prng_y_begin, int prng_y_end);
+	// runs 'count' events at uniformly random sites inside 'rect', picked with the xoroshiro state in 'sched_state' (4 uints)
+	// returns the number of events that landed on something other than Void or Empty
+	// every store that changes a site's type adds -1 to the old and +1 to the new type in 'type_deltas' (type_count ints)
+	unsigned int (*events)(const NativeWorldView* world, NativeRect rect, unsigned int count, unsigned int* sched_state, int* type_deltas);
+	// STAGE_VOTE over rows [prng_y_begin, prng_y_end) of the padded prng map: draws the next number from every site's prng
+	// into 'vote' (1 uint per prng site, same layout as the gpu vote image)
+	void (*vote)(const NativeWorldView* world, unsigned int* vote, int prng_y_begin, int prng_y_end);
+	// STAGE_EVENT for the sites of row 'y' whose 'active' byte is set (size_x bytes), with each site's own prng, like the gpu
+	// returns the number of events that landed on something other than Void or Empty, type_deltas like events
+	unsigned int (*eventsActive)(const NativeWorldView* world, int y, const unsigned char* active, int* type_deltas);
+	// STAGE_RENDER for a single site, packed as 0xAARRGGBB
+	unsigned int (*color)(const NativeWorldView* world, int x, int y);
+};
+
+typedef const NativeModule* (*NativeGetModuleFunc)();
@@ -37,3 +37,4 @@
 #define InvalidAtom (Atom(0))
 
 uint XoroshiroNext32();
+uint PrngNext32(); // counter_prng.inl
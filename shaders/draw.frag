@@ -1,3 +1,4 @@
+//include "world_layout.inl"
 //include "defines.inl"
 //include "draw_shared.inl"
 //include "hash.inl"
@@ -6,6 +7,12 @@
 layout(binding = 0) uniform  sampler2D color_img;
 layout(binding = 1) uniform usampler2D dev_img;
 
+#ifdef WORLD_COMPACT_LAYOUT
+#define DEV_UPDATED(d) ((d).x) // dev is a single 8 bit flag
+#else
+#define DEV_UPDATED(d) ((d).z)
+#endif
+
 layout(location = 0) in vec2 st;
 layout(location = 0) out vec4 out_col;
 
@@ -61,7 +68,7 @@ void main() {
 	col = col_sum;
 
 	if (event_window_vis > 0.0) {
-		if (texture(dev_img, site_uv).z != 1) { // colorize around the active site
+		if (DEV_UPDATED(texture(dev_img, site_uv)) != 1) { // colorize around the active site
 			const int R = 4;
 			int near_active_count = 0;
 			vec2 uv_active;
@@ -70,7 +77,7 @@ void main() {
 					int m = abs(x) + abs(y);
 					if (m <= R) {
 						vec2 other_uv = site_uv + vec2(x,-y) / textureSize(dev_img,0);
-						if (texture(dev_img, other_uv).z == 1) {
+						if (DEV_UPDATED(texture(dev_img, other_uv)) == 1) {
 							near_active_count++;
 							uv_active = other_uv;
 						}
@@ -1,3 +1,3 @@
 ivec2 _SITE_IDX;
 XoroshiroState _XORO;
-uint _SYMMETRY;
\ No newline at end of file
+uint _SYMMETRY;
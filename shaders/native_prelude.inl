@@ -0,0 +1,152 @@
+// C++ stand-ins for the GLSL builtins, globals and engine functions that emitted SPLAT code relies on.
+// This is the native counterpart of uniforms.inl + globals.inl + prng.inl, and gets included by
+// staged_update_native.cpp ahead of the C++ flavoured atom_decls.inl. native_sites.inl follows the decls.
+// Anything that affects the simulation result (prng, symmetry mapping, out of bounds behaviour) has to match
+// the GLSL exactly, otherwise the native and gpu paths drift apart.
+#pragma once
+#include <stdlib.h> // for abs(int)
+#include <string.h>
+
+#ifdef _WIN32
+#define NATIVE_EXPORT extern "C" __declspec(dllexport)
+#define NATIVE_TLS __declspec(thread)
+#else
+#define NATIVE_EXPORT extern "C" __attribute__((visibility("default")))
+#define NATIVE_TLS __thread __attribute__((tls_model("initial-exec"))) // a single pointer, so it fits in the static tls surplus of dlopen'ed libs
+#endif
+
+typedef unsigned int uint;
+
+// GLSL vector types, just the parts the generated code uses
+
+struct ivec2 {
+	int x, y;
+	ivec2() { }
+	explicit ivec2(int s) : x(s), y(s) { }
+	ivec2(int x_, int y_) : x(x_), y(y_) { }
+};
+inline ivec2 operator+(ivec2 a, ivec2 b) { return ivec2(a.x + b.x, a.y + b.y); }
+inline ivec2 operator-(ivec2 a, ivec2 b) { return ivec2(a.x - b.x, a.y - b.y); }
+inline ivec2 operator*(ivec2 a, ivec2 b) { return ivec2(a.x * b.x, a.y * b.y); }
+inline ivec2 operator/(ivec2 a, ivec2 b) { return ivec2(a.x / b.x, a.y / b.y); }
+inline ivec2 operator*(ivec2 a, int s) { return ivec2(a.x * s, a.y * s); }
+inline ivec2 operator/(ivec2 a, int s) { return ivec2(a.x / s, a.y / s); }
+inline ivec2 operator-(ivec2 a) { return ivec2(-a.x, -a.y); }
+inline bool operator==(ivec2 a, ivec2 b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(ivec2 a, ivec2 b) { return !(a == b); }
+
+struct uvec2 {
+	uint x, y;
+	uvec2() { }
+	explicit uvec2(uint s) : x(s), y(s) { }
+	uvec2(uint x_, uint y_) : x(x_), y(y_) { }
+	uvec2(ivec2 v) : x(uint(v.x)), y(uint(v.y)) { } // implicit, like GLSL's int -> uint promotion
+};
+inline uvec2 operator+(uvec2 a, uvec2 b) { return uvec2(a.x + b.x, a.y + b.y); }
+inline uvec2 operator-(uvec2 a, uvec2 b) { return uvec2(a.x - b.x, a.y - b.y); }
+inline uvec2 operator*(uvec2 a, uvec2 b) { return uvec2(a.x * b.x, a.y * b.y); }
+inline uvec2 operator/(uvec2 a, uvec2 b) { return uvec2(a.x / b.x, a.y / b.y); }
+inline uvec2 operator*(uvec2 a, uint s) { return uvec2(a.x * s, a.y * s); }
+inline uvec2 operator/(uvec2 a, uint s) { return uvec2(a.x / s, a.y / s); }
+inline bool operator==(uvec2 a, uvec2 b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(uvec2 a, uvec2 b) { return !(a == b); }
+
+struct uvec4 {
+	uint x, y, z, w;
+	uvec4() { }
+	explicit uvec4(uint s) : x(s), y(s), z(s), w(s) { }
+	uvec4(uint x_, uint y_, uint z_, uint w_) : x(x_), y(y_), z(z_), w(w_) { }
+	uint& operator[](int i) { return (&x)[i]; }
+	uint  operator[](int i) const { return (&x)[i]; }
+};
+inline bool operator==(const uvec4& a, const uvec4& b) { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; }
+inline bool operator!=(const uvec4& a, const uvec4& b) { return !(a == b); }
+
+#define NATIVE_SHIM_TYPES
+#include "shaders/cpu_gpu_shared.inl"
+#include "shaders/cpu_native_shared.inl"
+#include "shaders/defines.inl"
+
+// GLSL builtins
+
+inline int  min(int a, int b) { return a < b ? a : b; }
+inline uint min(uint a, uint b) { return a < b ? a : b; }
+inline int  max(int a, int b) { return a > b ? a : b; }
+inline uint max(uint a, uint b) { return a > b ? a : b; }
+inline int  clamp(int v, int lo, int hi) { return min(max(v, lo), hi); }
+inline uint clamp(uint v, uint lo, uint hi) { return min(max(v, lo), hi); }
+
+inline uint bitfieldExtract(uint value, int offset, int bits) {
+	if (bits == 0) return 0;
+	return (value >> offset) & (bits == 32 ? 0xffffffffu : ((1u << bits) - 1u));
+}
+inline int bitfieldExtract(int value, int offset, int bits) { // sign extends, like GLSL
+	if (bits == 0) return 0;
+	return int(uint(value) << (32 - offset - bits)) >> (32 - bits);
+}
+inline uint bitfieldInsert(uint base, uint insert, int offset, int bits) {
+	if (bits == 0) return base;
+	uint mask = (bits == 32 ? 0xffffffffu : ((1u << bits) - 1u)) << offset;
+	return (base & ~mask) | ((insert << offset) & mask);
+}
+
+// globals.inl
+// Everything an event touches lives in one struct per thread, so tiles can be stepped in parallel.
+
+struct NativeEventState {
+	const NativeWorldView* world;
+	ivec2 site_idx;
+	XoroshiroState xoro;
+	uint symmetry;
+
+	int nvotes[8];
+	SiteNum winsn[8];
+	Atom winatom[8];
+
+	int* type_deltas; // population changes per type, NULL outside of events
+};
+static NATIVE_TLS NativeEventState* _EV;
+
+#define _SITE_IDX (_EV->site_idx)
+#define _XORO     (_EV->xoro)
+#define _SYMMETRY (_EV->symmetry)
+
+#define _nvotes_0 (_EV->nvotes[0])
+#define _nvotes_1 (_EV->nvotes[1])
+#define _nvotes_2 (_EV->nvotes[2])
+#define _nvotes_3 (_EV->nvotes[3])
+#define _nvotes_4 (_EV->nvotes[4])
+#define _nvotes_5 (_EV->nvotes[5])
+#define _nvotes_6 (_EV->nvotes[6])
+#define _nvotes_7 (_EV->nvotes[7])
+#define _winsn_0 (_EV->winsn[0])
+#define _winsn_1 (_EV->winsn[1])
+#define _winsn_2 (_EV->winsn[2])
+#define _winsn_3 (_EV->winsn[3])
+#define _winsn_4 (_EV->winsn[4])
+#define _winsn_5 (_EV->winsn[5])
+#define _winsn_6 (_EV->winsn[6])
+#define _winsn_7 (_EV->winsn[7])
+#define _winatom_0 (_EV->winatom[0])
+#define _winatom_1 (_EV->winatom[1])
+#define _winatom_2 (_EV->winatom[2])
+#define _winatom_3 (_EV->winatom[3])
+#define _winatom_4 (_EV->winatom[4])
+#define _winatom_5 (_EV->winatom[5])
+#define _winatom_6 (_EV->winatom[6])
+#define _winatom_7 (_EV->winatom[7])
+
+// prng.inl and xoroshiro128starstar.inl are plain enough to be shared verbatim
+
+#include "shaders/prng.inl"
+#include "shaders/xoroshiro128starstar.inl"
+
+uint SplitMix32(uint& state) {
+	uint b = (state += 0x9e3779b9);
+	b ^= b >> 15;
+	b *= 0x85ebca6b;
+	b ^= b >> 13;
+	b *= 0xc2b2ae3d;
+	b ^= b >> 16;
+	return b;
+}
@@ -0,0 +1,178 @@
+// Native counterpart of bit_packing.inl + sites.inl. Needs the type ids from atom_decls.inl, so it is included
+// between the C++ flavoured atom_decls.inl and atoms.inl, same order as the GLSL.
+#pragma once
+
+// bit_packing.inl
+
+inline uint _UNPACK_TYPE(const Atom& A) { return (A[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK; }
+inline void _PACK_TYPE(Atom& A, uint t) { A[ATOM_TYPE_COMPONENT] |= t << ATOM_TYPE_LOCAL_OFFSET; }
+
+inline Atom _NEW_ATOM(uint type) {
+	Atom A = Atom(0);
+	_PACK_TYPE(A, type);
+	return A;
+}
+#define new(type) _NEW_ATOM(type) // no system headers past this point
+
+// sites.inl
+// Off-world sites behave like imageLoad/imageStore out of bounds: loads return 0 (Void), stores are dropped.
+
+inline int taxilen(ivec2 v) { return abs(v.x) + abs(v.y); }
+
+inline bool _SITE_IN_WORLD(ivec2 idx) {
+	return idx.x >= 0 && idx.y >= 0 && idx.x < _EV->world->size_x && idx.y < _EV->world->size_y;
+}
+inline uint* _SITE_PTR(ivec2 idx) {
+	return _EV->world->site_bits + (size_t(idx.y) * _EV->world->size_x + idx.x) * 4;
+}
+#ifdef SHARED_SITE_TESTS
+// The site type cache behind ew_type. Anything that writes the window or changes the symmetry forgets it.
+// atom_decls.inl only says whether it's on after the prelude, so the events run on a NativeEvent that adds it.
+struct NativeEvent : NativeEventState {
+	uint ew_known[2];  // bit per site number, set once ew_types has it
+	uint ew_types[41]; // type of each site this event, see ew_type
+};
+#define _EW_KNOWN (static_cast<NativeEvent*>(_EV)->ew_known)
+#define _EW_TYPES (static_cast<NativeEvent*>(_EV)->ew_types)
+
+void ew_forgetTypes() {
+	_EW_KNOWN[0] = 0u;
+	_EW_KNOWN[1] = 0u;
+}
+#else
+typedef NativeEventState NativeEvent;
+#endif
+
+Atom _SITE_LOAD(ivec2 relative_idx) {
+	if (taxilen(relative_idx) <= EVENT_WINDOW_RADIUS) {
+		ivec2 idx = _SITE_IDX + relative_idx;
+		if (!_SITE_IN_WORLD(idx)) return Atom(0);
+		const uint* p = _SITE_PTR(idx);
+		return Atom(p[0], p[1], p[2], p[3]);
+	} else {
+		return new(Void);
+	}
+}
+void _SITE_STORE(ivec2 relative_idx, Atom S) {
+#ifdef SHARED_SITE_TESTS
+	ew_forgetTypes();
+#endif
+	if (taxilen(relative_idx) <= EVENT_WINDOW_RADIUS) {
+		ivec2 idx = _SITE_IDX + relative_idx;
+		if (!_SITE_IN_WORLD(idx)) return;
+		uint* p = _SITE_PTR(idx);
+		if (_EV->type_deltas) {
+			// the census follows the events instead of rescanning the world, out of range types count as the last one like there
+			uint old_type = min((p[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK, uint(TYPE_COUNT - 1));
+			uint new_type = min(_UNPACK_TYPE(S), uint(TYPE_COUNT - 1));
+			if (old_type != new_type) {
+				_EV->type_deltas[old_type] -= 1;
+				_EV->type_deltas[new_type] += 1;
+			}
+		}
+		p[0] = S.x; p[1] = S.y; p[2] = S.z; p[3] = S.w;
+	}
+}
+void _SITE_SWAP(ivec2 a_idx, ivec2 b_idx) {
+	Atom A = _SITE_LOAD(a_idx);
+	Atom B = _SITE_LOAD(b_idx);
+	if (_UNPACK_TYPE(A) != Void && _UNPACK_TYPE(B) != Void) {
+		_SITE_STORE(a_idx, B);
+		_SITE_STORE(b_idx, A);
+	}
+}
+
+// EventWindow
+
+C2D ew_getCoordRaw(SiteNum i) {
+	static const int coords[41][2] = {
+		{ 0, 0},
+		{-1, 0}, { 0,-1}, { 0, 1}, { 1, 0},
+		{-1,-1}, {-1, 1}, { 1,-1}, { 1, 1},
+		{-2, 0}, { 0,-2}, { 0, 2}, { 2, 0},
+		{-2,-1}, {-2, 1}, {-1,-2}, {-1, 2}, { 1,-2}, { 1, 2}, { 2,-1}, { 2, 1},
+		{-3, 0}, { 0,-3}, { 0, 3}, { 3, 0},
+		{-2,-2}, {-2, 2}, { 2,-2}, { 2, 2},
+		{-3,-1}, {-3, 1}, {-1,-3}, {-1, 3}, { 1,-3}, { 1, 3}, { 3,-1}, { 3, 1},
+		{-4, 0}, { 0,-4}, { 0, 4}, { 4, 0},
+	};
+	if (i > 40) return ivec2(0, 0);
+	return ivec2(coords[i][0], coords[i][1]);
+}
+C2D ew_mapSym(C2D c) {
+	switch(_SYMMETRY) {
+		case cSYMMETRY_000L: return C2D( c.x, c.y);
+		case cSYMMETRY_090L: return C2D(-c.y, c.x);
+		case cSYMMETRY_180L: return C2D(-c.x,-c.y);
+		case cSYMMETRY_270L: return C2D( c.y,-c.x);
+		case cSYMMETRY_000R: return C2D( c.x,-c.y);
+		case cSYMMETRY_090R: return C2D( c.y, c.x);
+		case cSYMMETRY_180R: return C2D(-c.x, c.y);
+		case cSYMMETRY_270R: return C2D(-c.y,-c.x);
+		default: return c;
+	};
+}
+C2D ew_mapSym(SiteNum i) { return ew_mapSym(ew_getCoordRaw(i)); }
+
+Atom ew(C2D idx) {
+	return _SITE_LOAD(ew_mapSym(idx));
+}
+void ew(C2D idx, Atom S) {
+	_SITE_STORE(ew_mapSym(idx), S);
+}
+Atom ew(SiteNum i) {
+	return _SITE_LOAD(ew_mapSym(i));
+}
+void ew(SiteNum i, Atom S) {
+	_SITE_STORE(ew_mapSym(i), S);
+}
+void ew_swap(C2D a, C2D b) {
+	_SITE_SWAP(ew_mapSym(a), ew_mapSym(b));
+}
+void ew_swap(SiteNum a, SiteNum b) {
+	_SITE_SWAP(ew_mapSym(a), ew_mapSym(b));
+}
+void ew_changeSymmetry(Symmetry s) {
+	_SYMMETRY = s;
+#ifdef SHARED_SITE_TESTS
+	ew_forgetTypes();
+#endif
+}
+Symmetry ew_getSymmetry() {
+	return _SYMMETRY;
+}
+bool ew_isLive(C2D c) {
+	return _UNPACK_TYPE(_SITE_LOAD(c)) != Void;
+}
+bool ew_isLive(SiteNum n) {
+	return ew_isLive(ew_mapSym(n));
+}
+bool ew_isEmpty(C2D c) {
+	return _UNPACK_TYPE(_SITE_LOAD(c)) == Empty;
+}
+bool ew_isEmpty(SiteNum n) {
+	return ew_isEmpty(ew_mapSym(n));
+}
+
+#ifdef SHARED_SITE_TESTS
+// Type of site n, loaded at most once per event. Used by the shared site tests of the SPLAT compiler.
+AtomType ew_type(SiteNum n) {
+	uint bit = 1u << (n & 31u);
+	if ((_EW_KNOWN[n >> 5] & bit) == 0u) {
+		_EW_TYPES[n] = _UNPACK_TYPE(ew(n));
+		_EW_KNOWN[n >> 5] |= bit;
+	}
+	return _EW_TYPES[n];
+}
+#endif
+
+Bool ew_isLegal(C2D c) { return taxilen(c) <= EVENT_WINDOW_RADIUS; }
+Bool ew_isLegal(SiteNum n) { return ew_isLegal(ew_mapSym(n)); }
+
+// ColorUtils
+ARGB cu_color(Byte red, Byte green, Byte blue) {
+	return ARGB(255, red, green, blue);
+}
+ARGB cu_color(Unsigned col) {
+	return ARGB((col >> 24) & 0xff, (col >> 16) & 0xff, (col >> 8) & 0xff, col & 0xff);
+}
@@ -1,6 +1,6 @@
 
 uint random_bits(uint bitsize) {
-	uint bits = XoroshiroNext32();
+	uint bits = PrngNext32();
 	return bitsize == 32 ? bits : bits & ((1 << bitsize) - 1);
 }
 
@@ -14,7 +14,7 @@ uint random_create(uint val_max) {
 	// so it's safe to say for "most" cases, it will return without actually looping.
     uint threshold = -val_max % val_max;
     for (;;) {
-        uint r = XoroshiroNext32();
+        uint r = PrngNext32();
         if (r >= threshold)
             return r % val_max;
     }
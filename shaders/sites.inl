@@ -3,6 +3,17 @@
 
 int taxilen(ivec2 v) { return abs(v.x) + abs(v.y); }
 
+#ifdef SHARED_SITE_TESTS
+// The site type cache behind ew_type. Anything that writes the window or changes the symmetry forgets it.
+uint _EW_KNOWN[2]; // bit per site number, set once _EW_TYPES has it
+AtomType _EW_TYPES[41]; // type of each site this event, see ew_type
+
+void ew_forgetTypes() {
+	_EW_KNOWN[0] = 0u;
+	_EW_KNOWN[1] = 0u;
+}
+#endif
+
 Atom _SITE_LOAD(ivec2 relative_idx) {
 	if (taxilen(relative_idx) <= EVENT_WINDOW_RADIUS) {
 		return imageLoad(img_site_bits, _SITE_IDX + relative_idx);
@@ -11,6 +22,9 @@ Atom _SITE_LOAD(ivec2 relative_idx) {
 	}
 }
 void _SITE_STORE(ivec2 relative_idx, Atom S) {
+#ifdef SHARED_SITE_TESTS
+	ew_forgetTypes();
+#endif
 	if (taxilen(relative_idx) <= EVENT_WINDOW_RADIUS) {
 		imageStore(img_site_bits, _SITE_IDX + relative_idx, S);
 	}
@@ -107,6 +121,9 @@ void ew_swap(SiteNum a, SiteNum b) {
 }
 void ew_changeSymmetry(Symmetry s) {
 	_SYMMETRY = s;
+#ifdef SHARED_SITE_TESTS
+	ew_forgetTypes();
+#endif
 }
 Symmetry ew_getSymmetry() {
 	return _SYMMETRY;
@@ -124,6 +141,18 @@ bool ew_isEmpty(SiteNum n) {
 	return ew_isEmpty(ew_mapSym(n));
 }
 
+#ifdef SHARED_SITE_TESTS
+// Type of site n, loaded at most once per event. Used by the shared site tests of the SPLAT compiler.
+AtomType ew_type(SiteNum n) {
+	uint bit = 1u << (n & 31u);
+	if ((_EW_KNOWN[n >> 5] & bit) == 0u) {
+		_EW_TYPES[n] = _UNPACK_TYPE(ew(n));
+		_EW_KNOWN[n >> 5] |= bit;
+	}
+	return _EW_TYPES[n];
+}
+#endif
+
 Bool ew_isLegal(C2D c) { return taxilen(c) <= EVENT_WINDOW_RADIUS; }
 Bool ew_isLegal(SiteNum n) { return ew_isLegal(ew_mapSym(n)); }
 
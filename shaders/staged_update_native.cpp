@@ -0,0 +1,204 @@
+// Native (CPU) counterpart of staged_update_direct.comp.
+// Not part of the app build: src/native.cpp compiles this into a shared object together with the C++ flavoured
+// atom_decls.inl and atoms.inl that the SPLAT compiler writes into native_bin/, and loads it at runtime.
+#include "shaders/native_prelude.inl"
+#include "atom_decls.inl"
+#include "shaders/counter_prng.inl"
+#include "shaders/native_sites.inl"
+#include "atoms.inl"
+
+static void nativeReset(const NativeWorldView* world, int prng_y_begin, int prng_y_end) {
+	NativeEvent ev;
+	_EV = &ev;
+	ev.world = world;
+	ev.type_deltas = NULL; // the host counts the types after a reset
+	ivec2 world_size = ivec2(world->size_x, world->size_y);
+	ivec2 prng_size = ivec2(world->prng_size_x, world->prng_size_y);
+	for (int y = prng_y_begin; y < prng_y_end; ++y) {
+		for (int x = 0; x < prng_size.x; ++x) {
+			ivec2 prng_idx = ivec2(x, y);
+			// seed the prng state, same as STAGE_RESET
+			uint state = prng_idx.x + prng_idx.y * prng_size.x;
+			uint smix = SplitMix32(state);
+			(void)smix; // only goes into the dev image on the gpu
+#ifdef PRNG_COUNTER
+			_XORO = CounterPrngKey(prng_idx, 0u, PRNG_STREAM_RESET);
+#else
+			_XORO[0] = SplitMix32(state);
+			_XORO[1] = SplitMix32(state);
+			_XORO[2] = SplitMix32(state);
+			_XORO[3] = SplitMix32(state);
+			// crank it a bit just in case to decorrelate
+			for (int i = 0; i < 128; ++i)
+				XoroshiroNext32();
+#endif
+
+			if (prng_idx.x >= EVENT_WINDOW_RADIUS && prng_idx.y >= EVENT_WINDOW_RADIUS &&
+				prng_idx.x < (prng_size.x - EVENT_WINDOW_RADIUS) && prng_idx.y < (prng_size.y - EVENT_WINDOW_RADIUS)) {
+
+				ivec2 site_idx = prng_idx - ivec2(EVENT_WINDOW_RADIUS);
+				// the gpu resets the padding ring too, but those sites are off the image so their stores are dropped
+				if (site_idx.x < world_size.x && site_idx.y < world_size.y) {
+					_SITE_IDX = site_idx;
+					_SYMMETRY = cSYMMETRY_000L;
+
+					ew(0, new(Empty));
+					Init(site_idx, world_size);
+
+					world->event_count[size_t(site_idx.y) * world_size.x + site_idx.x] = 0;
+				}
+			}
+
+#ifndef PRNG_COUNTER
+			uint* P = world->prng_state + (size_t(prng_idx.y) * prng_size.x + prng_idx.x) * 4;
+			P[0] = _XORO[0]; P[1] = _XORO[1]; P[2] = _XORO[2]; P[3] = _XORO[3];
+#endif
+		}
+	}
+	_EV = NULL;
+}
+
+// random_create from prng.inl, but always on xoroshiro, since site picking has to go on in counter prng mode too
+static uint schedRandom(XoroshiroState* sched, uint val_max) {
+	_XORO = *sched;
+	uint threshold = -val_max % val_max;
+	uint r;
+	do {
+		r = XoroshiroNext32();
+	} while (r < threshold);
+	*sched = _XORO;
+	return r % val_max;
+}
+
+static uint nativeEvents(const NativeWorldView* world, NativeRect rect, uint count, uint* sched_state, int* type_deltas) {
+	NativeEvent ev;
+	_EV = &ev;
+	ev.world = world;
+	ev.type_deltas = type_deltas;
+
+	XoroshiroState sched = XoroshiroState(sched_state[0], sched_state[1], sched_state[2], sched_state[3]);
+	uint w = uint(rect.x1 - rect.x0);
+	uint h = uint(rect.y1 - rect.y0);
+	uint live_events = 0;
+	for (uint e = 0; e < count; ++e) {
+		// pick the site with the scheduling state, then swap in the site's own state for the event itself
+		int x = int(schedRandom(&sched, w));
+		int y = int(schedRandom(&sched, h));
+		ivec2 center_idx = ivec2(rect.x0 + x, rect.y0 + y);
+
+		_SITE_IDX = center_idx;
+		ivec2 vote_idx = _SITE_IDX + ivec2(EVENT_WINDOW_RADIUS*2);
+		uint* E = world->event_count + size_t(center_idx.y) * world->size_x + center_idx.x;
+#ifdef PRNG_COUNTER
+		// a site can get several events per step here, so it's keyed on the site's own event count instead of the step
+		_XORO = CounterPrngKey(vote_idx, *E, PRNG_STREAM_EVENT);
+#else
+		uint* P = world->prng_state + (size_t(vote_idx.y) * world->prng_size_x + vote_idx.x) * 4;
+		_XORO = XoroshiroState(P[0], P[1], P[2], P[3]);
+#endif
+
+		Atom S = _SITE_LOAD(ivec2(0,0));
+		AtomType T = _UNPACK_TYPE(S);
+		_BEHAVE_DISPATCH(T);
+		if (T != Void && T != Empty)
+			live_events += 1;
+
+		*E += 1;
+#ifndef PRNG_COUNTER
+		P[0] = _XORO[0]; P[1] = _XORO[1]; P[2] = _XORO[2]; P[3] = _XORO[3];
+#endif
+	}
+	sched_state[0] = sched[0]; sched_state[1] = sched[1]; sched_state[2] = sched[2]; sched_state[3] = sched[3];
+	_EV = NULL;
+	return live_events;
+}
+
+static void nativeVote(const NativeWorldView* world, uint* vote, int prng_y_begin, int prng_y_end) {
+	NativeEvent ev;
+	_EV = &ev;
+	ev.world = world;
+	ev.type_deltas = NULL;
+	for (int y = prng_y_begin; y < prng_y_end; ++y) {
+		for (int x = 0; x < world->prng_size_x; ++x) {
+			size_t prng_i = size_t(y) * world->prng_size_x + x;
+#ifdef PRNG_COUNTER
+			_XORO = CounterPrngKey(ivec2(x, y), world->dispatch_counter, PRNG_STREAM_VOTE);
+			vote[prng_i] = CounterNext32();
+#else
+			uint* P = world->prng_state + prng_i * 4;
+			_XORO = XoroshiroState(P[0], P[1], P[2], P[3]);
+			vote[prng_i] = XoroshiroNext32();
+			P[0] = _XORO[0]; P[1] = _XORO[1]; P[2] = _XORO[2]; P[3] = _XORO[3];
+#endif
+		}
+	}
+	_EV = NULL;
+}
+
+static uint nativeEventsActive(const NativeWorldView* world, int y, const unsigned char* active, int* type_deltas) {
+	NativeEvent ev;
+	_EV = &ev;
+	ev.world = world;
+	ev.type_deltas = type_deltas;
+	uint live_events = 0;
+	for (int x = 0; x < world->size_x; ++x) {
+		if (!active[x]) continue;
+		ivec2 center_idx = ivec2(x, y);
+		_SITE_IDX = center_idx;
+		ivec2 vote_idx = _SITE_IDX + ivec2(EVENT_WINDOW_RADIUS*2);
+#ifdef PRNG_COUNTER
+		_XORO = CounterPrngKey(vote_idx, world->dispatch_counter, PRNG_STREAM_EVENT);
+#else
+		uint* P = world->prng_state + (size_t(vote_idx.y) * world->prng_size_x + vote_idx.x) * 4;
+		_XORO = XoroshiroState(P[0], P[1], P[2], P[3]);
+#endif
+
+		Atom S = _SITE_LOAD(ivec2(0,0));
+		AtomType T = _UNPACK_TYPE(S);
+		_BEHAVE_DISPATCH(T);
+		if (T != Void && T != Empty)
+			live_events += 1;
+
+		world->event_count[size_t(center_idx.y) * world->size_x + center_idx.x] += 1;
+#ifndef PRNG_COUNTER
+		P[0] = _XORO[0]; P[1] = _XORO[1]; P[2] = _XORO[2]; P[3] = _XORO[3];
+#endif
+	}
+	_EV = NULL;
+	return live_events;
+}
+
+static uint nativeColor(const NativeWorldView* world, int x, int y) {
+	NativeEvent ev;
+	_EV = &ev;
+	ev.world = world;
+	ev.type_deltas = NULL;
+	// rendering does not support rng, reading from any site other than 0, and hence doesn't require symmetry randomization
+	_SITE_IDX = ivec2(x, y);
+	_SYMMETRY = cSYMMETRY_000L;
+	ARGB argb = _COLOR_DISPATCH(_UNPACK_TYPE(_SITE_LOAD(ivec2(0))));
+	_EV = NULL;
+	return (min(argb.x, 255u) << 24) | (min(argb.y, 255u) << 16) | (min(argb.z, 255u) << 8) | min(argb.w, 255u);
+}
+
+#ifdef PRNG_COUNTER
+#define NATIVE_PRNG_STATE_SIZE 0
+#else
+#define NATIVE_PRNG_STATE_SIZE 4
+#endif
+
+static const NativeModule native_module = {
+	NATIVE_ABI_VERSION,
+	TYPE_COUNT,
+	NATIVE_PRNG_STATE_SIZE,
+	EXCLUSION_RADIUS,
+	nativeReset,
+	nativeEvents,
+	nativeVote,
+	nativeEventsActive,
+	nativeColor,
+};
+
+NATIVE_EXPORT const NativeModule* nativeGetModule() {
+	return &native_module;
+}
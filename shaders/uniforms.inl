@@ -2,8 +2,15 @@ layout (binding = 0, rgba32ui) uniform uimage2D img_prng_state;
 layout (binding = 1, rgba32ui) uniform uimage2D img_site_bits;
 layout (binding = 2, r32ui)    uniform uimage2D img_vote;
 layout (binding = 3, rgba8ui)  uniform uimage2D img_color;
+#ifdef WORLD_COMPACT_LAYOUT
+layout (binding = 4, r16ui)    uniform uimage2D img_event_count; // saturates at EVENT_COUNT_MAX
+layout (binding = 5, r8ui)     uniform uimage2D img_dev;         // only the 'site updated' flag
+#define EVENT_COUNT_MAX 0xffffu
+#else
 layout (binding = 4, r32ui)    uniform uimage2D img_event_count;
 layout (binding = 5, rgba32ui) uniform uimage2D img_dev;
+#define EVENT_COUNT_MAX 0xffffffffu
+#endif
 
 /*
 layout(std430, binding = 0) coherent 
@@ -98,10 +98,11 @@ void computeBegin(VkCommandBuffer command_buffer, ComputeArgs args) {
 	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, g_ComputePipelineLayout, 0, 1, &g_ComputeDescriptorSet, 0, 0);
 	
 }
-void computeStage(VkCommandBuffer command_buffer, int stage, ivec2 size) {
+void computeStage(VkCommandBuffer command_buffer, int stage, ivec2 size, u32 dispatch_counter) {
 	if (!g_ComputePipeline) return;
 	ivec2 dispatch = ivec2((size.x / GROUP_SIZE_X) + 1, (size.y / GROUP_SIZE_Y) + 1);
 	upc.stage = stage;
+	upc.dispatch_counter = dispatch_counter;
 	vkCmdPushConstants(command_buffer, g_ComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputeUPC) , &upc);
 	vkCmdDispatch(command_buffer, dispatch.x, dispatch.y, 1);
 	evkMemoryBarrier(command_buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
@@ -1,5 +1,6 @@
 #pragma once
 #include "core/vec2.h"
+#include "core/basic_types.h"
 #include "wrap/evk.h"
 
 struct ComputeArgs {
@@ -10,4 +11,4 @@ bool computeRecreatePipelineIfNeeded();
 VkDescriptorSet computeGetDescriptorSet();
 void computeDestroy();
 void computeBegin(VkCommandBuffer command_buffer, ComputeArgs args);
-void computeStage(VkCommandBuffer command_buffer, int stage, ivec2 state_size);
\ No newline at end of file
+void computeStage(VkCommandBuffer command_buffer, int stage, ivec2 state_size, u32 dispatch_counter = 0);
\ No newline at end of file
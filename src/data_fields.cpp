@@ -90,15 +90,15 @@ void DataField::appendDataFunctions(String& text, StringRange class_name) {
 	}
 	text.append("}\n");
 
-	// ops
+	// ops, one load and one store of the atom, returning the new (clamped) value so there's no need to _get it again
 	if (type == BASIC_TYPE_Unsigned || type == BASIC_TYPE_Int) {
 		for (int o = 0; o < ARRSIZE(INTEGER_OPS); ++o) {
 			text.append(TempStr("%s %.*s_%.*s_%s(SiteNum sn, int v) {\n", BASIC_TYPE_NAME(type), class_name.len, class_name.str, name.len, name.str, INTEGER_OP_NAMES[o]));
 			if (global_offset != NO_OFFSET) {
 				text.append(TempStr("\tAtom A = ew(sn);\n"));
 				text.append(TempStr("\tint a = int(bitfieldExtract(%s(A[%d]), %d, %d));\n", BASIC_TYPE_NAME(type), global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
-				text.append(TempStr("\ta = clamp(a %s v, %d, %d) << %d;\n", INTEGER_OPS[o], minof, maxof, global_offset%BITS_PER_COMPONENT));
-				text.append(TempStr("\tA[%d] = bitfieldInsert(A[%d], a, %d, %d);\n", global_offset / BITS_PER_COMPONENT, global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
+				text.append(TempStr("\ta = clamp(a %s v, %d, %d);\n", INTEGER_OPS[o], minof, maxof));
+				text.append(TempStr("\tA[%d] = bitfieldInsert(A[%d], uint(a), %d, %d);\n", global_offset / BITS_PER_COMPONENT, global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
 				text.append(TempStr("\tew(sn, A);\n"));
 				text.append(TempStr("\treturn %s(a);\n", BASIC_TYPE_NAME(type)));
 			} else {
@@ -110,8 +110,8 @@ void DataField::appendDataFunctions(String& text, StringRange class_name) {
 			if (global_offset != NO_OFFSET) {
 				text.append(TempStr("\tAtom A = ew(0);\n"));
 				text.append(TempStr("\tint a = int(bitfieldExtract(%s(A[%d]), %d, %d));\n", BASIC_TYPE_NAME(type), global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
-				text.append(TempStr("\ta = clamp(a %s v, %d, %d) << %d;\n", INTEGER_OPS[o], minof, maxof, global_offset%BITS_PER_COMPONENT));
-				text.append(TempStr("\tA[%d] = bitfieldInsert(A[%d], a, %d, %d);\n", global_offset / BITS_PER_COMPONENT, global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
+				text.append(TempStr("\ta = clamp(a %s v, %d, %d);\n", INTEGER_OPS[o], minof, maxof));
+				text.append(TempStr("\tA[%d] = bitfieldInsert(A[%d], uint(a), %d, %d);\n", global_offset / BITS_PER_COMPONENT, global_offset / BITS_PER_COMPONENT, global_offset%BITS_PER_COMPONENT, bitsize));
 				text.append(TempStr("\tew(0, A);\n"));
 				text.append(TempStr("\treturn %s(a);\n", BASIC_TYPE_NAME(type)));
 			} else {
@@ -156,8 +156,28 @@ void DataField::appendTo(Atom A, String& text) const {
 	}
 }
 
-void dataAddInternalAndPickOffsets(Bunch<DataField>& data) {
-	const int UNUSED = -1;
+static const int UNUSED = -1;
+
+// Lowest offset in 'component' with bitsize free bits in a row, or NO_OFFSET
+static int findFreeRun(const int* bit_owners, int component, int bitsize) {
+	int start = component * BITS_PER_COMPONENT;
+	int end = min(start + BITS_PER_COMPONENT, ATOM_BITS);
+	int run = 0;
+	for (int b = start; b < end; ++b) {
+		run = bit_owners[b] == UNUSED ? run + 1 : 0;
+		if (run == bitsize)
+			return b + 1 - bitsize;
+	}
+	return NO_OFFSET;
+}
+static int countFreeBits(const int* bit_owners, int component) {
+	int count = 0;
+	for (int b = component * BITS_PER_COMPONENT; b < min((component + 1) * BITS_PER_COMPONENT, ATOM_BITS); ++b)
+		count += bit_owners[b] == UNUSED ? 1 : 0;
+	return count;
+}
+
+DataLayout dataAddInternalAndPickOffsets(Bunch<DataField>& data) {
 	int bit_owners[ATOM_BITS];
 	for (int i = 0; i < ATOM_BITS; ++i)
 		bit_owners[i] = UNUSED;
@@ -180,44 +200,48 @@ void dataAddInternalAndPickOffsets(Bunch<DataField>& data) {
 	for (int i = atype.global_offset; i < (atype.global_offset+atype.bitsize); ++i)
 		bit_owners[i] = &atype - data.ptr;
 
+	// Best fit decreasing: the biggest fields go first, each into the component it leaves the fewest free bits in, so the
+	// small fields fill up the gaps instead of taking room a big one needs. Equal sizes keep their declaration order.
+	// A field never straddles two components, the accessors read and write a single one (see appendDataFunctions).
+	Bunch<int> order;
 	for (int i = 0; i < data.count; ++i) {
-		DataField& f = data[i];
-		if (f.global_offset != NO_OFFSET)
+		if (data[i].global_offset != NO_OFFSET)
 			continue;
-			
-		log("Trying to allocate %.*s\n", f.name.len, f.name.str);
-		int global_offset = 0;
-		while (true) {
-			if (global_offset >= ATOM_BITS) {
-				log("Unable to allocate %.*s\n",  f.name.len, f.name.str);
-				break;
-			}
-			if (bit_owners[global_offset] != UNUSED) {
-				global_offset++;
-				continue;
-			}
-			bool usable = true;
-			int component = global_offset / BITS_PER_COMPONENT; // the vector component of this spot
-			for (int b = global_offset; b < (global_offset + f.bitsize); ++b) {
-				if (bit_owners[b] != UNUSED) { // someone else is here already
-					usable = false;
-					break;
-				}
-				if ((b / BITS_PER_COMPONENT) != component) { // we changed components
-					usable = false;
-					break;
-				}
-			}
-			if (usable) {
-				// set my bits
-				for (int b = global_offset; b < (global_offset + f.bitsize); ++b)
-					bit_owners[b] = i;
-				f.global_offset = global_offset;
-				log("Put %.*s at %d to %d\n", f.name.len, f.name.str, global_offset, global_offset + f.bitsize);
-				break;
-			} else {
-				global_offset += 1;
+		int at = order.count;
+		order.push(i);
+		while (at > 0 && data[order[at - 1]].bitsize < data[i].bitsize) {
+			order[at] = order[at - 1];
+			order[at - 1] = i;
+			at -= 1;
+		}
+	}
+	DataLayout layout = { };
+	const int component_count = (ATOM_BITS + BITS_PER_COMPONENT - 1) / BITS_PER_COMPONENT;
+	for (int o = 0; o < order.count; ++o) {
+		DataField& f = data[order[o]];
+		int best_offset = NO_OFFSET;
+		int best_left = ATOM_BITS + 1;
+		for (int c = 0; c < component_count && f.bitsize > 0; ++c) {
+			int offset = findFreeRun(bit_owners, c, f.bitsize);
+			int left = countFreeBits(bit_owners, c) - f.bitsize;
+			if (offset != NO_OFFSET && left < best_left) {
+				best_offset = offset;
+				best_left = left;
 			}
 		}
+		if (best_offset == NO_OFFSET) {
+			layout.unplaced += 1;
+			continue;
+		}
+		for (int b = best_offset; b < (best_offset + f.bitsize); ++b)
+			bit_owners[b] = order[o];
+		f.global_offset = best_offset;
+		layout.used_bits += f.bitsize;
+	}
+	for (int c = 0; c < component_count; ++c) {
+		layout.free_bits += countFreeBits(bit_owners, c);
+		for (int size = layout.largest_gap + 1; findFreeRun(bit_owners, c, size) != NO_OFFSET; ++size)
+			layout.largest_gap = size;
 	}
-}
\ No newline at end of file
+	return layout;
+}
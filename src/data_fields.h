@@ -47,4 +47,11 @@ inline int unpackInt(Atom A, int global_offset, int bitsize) {
 	return int(b);
 }
 
-void dataAddInternalAndPickOffsets(Bunch<DataField>& data);
\ No newline at end of file
+struct DataLayout {
+	int used_bits;  // by the fields that found a place
+	int free_bits;  // left over in the atom
+	int largest_gap; // biggest field that would still fit, the rest of free_bits is lost to component boundaries
+	int unplaced;   // fields that didn't fit anywhere, they keep NO_OFFSET
+};
+// Adds the internal fields (type and ECC) and picks an offset for every other field of an element.
+DataLayout dataAddInternalAndPickOffsets(Bunch<DataField>& data);
\ No newline at end of file
@@ -100,6 +100,7 @@ static void imguiNewFrame() {
     ImGui::NewFrame();
 }
 
+extern void mfmInit();
 extern void mfmTerm();
 extern void mfmUpdate(Input* main_in);
 extern void mfmCompute(VkCommandBuffer cb);
@@ -156,6 +157,7 @@ int main(int, char**)
 
 	Input in;
 	imguiInit(appGetWindow());
+	mfmInit();
 
     while (!appShouldClose())
     {
@@ -176,6 +178,7 @@ int main(int, char**)
 			//ImGui::ShowDemoWindow();
 			mfmUpdate(&in);
 			guiShader();
+			recUI(in.key.press[KEY_F12]);
 
 			ImGui::Render();
 
@@ -196,12 +199,14 @@ int main(int, char**)
 				evkRenderEnd();
 
 				evkFramePresent();
+				recUpdate();
 			}
 		} else {
 			appWaitForEvents();
 		}
 	}
 	evkWaitUntilReadyToTerm();
+	recTerm();
 	mfmTerm();
 	imguiTerm();
 	shadersDestroy();
@@ -3,15 +3,21 @@
 #include "core/log.h"
 #include "core/maths.h"
 #include "wrap/input_wrap.h"
+#include "wrap/recorder_wrap.h"
 #include "core/shader_loader.h"
 #include "core/dir.h"
 #include "core/gpu_timer.h"
 #include "core/cpu_timer.h"
+#include "core/jobs.h"
 
 #include "shaders/cpu_gpu_shared.inl"
 #include "shaders/defines.inl" // for RADIUS
 //#include "shaders/splitmix32.inl"
 #include "splat_compiler.h"
+#include "native.h"
+#include "snapshot.h"
+#include "trajectory.h"
+#include "world_image.h"
 #include "world.h"
 #include "render.h"
 #include "compute.h"
@@ -89,6 +95,20 @@ static bool dont_reset_when_code_changes = false;
 static bool gui_break_on_event = false;
 static float event_window_vis = 0.0f;
 
+// native (cpu) backend state, runs alongside the gpu world when enabled
+static NativeWorld native_world;
+static float native_sec_per_batch = 0.0f;
+static s64 native_events_this_batch = 0;
+static char native_snapshot_pathfile[256] = "snapshots/native.mfms";
+static bool native_load_pending = false; // loaded in nativeUpdate, once the worlds have the snapshot's size
+static char native_trajectory_pathfile[256] = "snapshots/native.mfmt";
+static int native_keyframe_every = 100;
+static int native_trajectory_step = 0;
+static TrajectoryWriter native_trajectory;      // records every step of the native world while open
+static TrajectoryReader native_trajectory_view; // kept open, so going through the steps in order only decodes deltas
+static CheckpointSchedule native_checkpoints;    // periodic snapshots to '<native_snapshot_pathfile>.<step>'
+static SnapshotWriter native_checkpoint_writer;
+
 
 static void initStatsIfNeeded() {
 	/* #PORT
@@ -250,10 +270,18 @@ struct GuiSettings {
 	int run_speed = 1;
 	int size_option = 7;
 	ivec2 size_custom = ivec2(80, 60);
+	bool compact_layout = false;
+	bool checkpoints = false;
 };
 
 static GuiSettings gui_set;
 
+// tells the shaders which World layout to expect, see WorldLayoutFlags in world.h
+static void injectWorldLayout(bool compact) {
+	const char* text = compact ? "#define WORLD_COMPACT_LAYOUT\n" : "// full world layout\n";
+	injectProceduralFile("shaders/world_layout.inl", text, strlen(text));
+}
+
 static void guiControl(bool* reset, bool* run, bool* step, ivec2* size_request, int dispatch_counter, float AEPS, float AER) {
 	bool size_change = false;
 	gui::Text("Size:");
@@ -279,6 +307,8 @@ static void guiControl(bool* reset, bool* run, bool* step, ivec2* size_request,
 		//*run = false;
 		*reset = true;
 	}
+	if (gui::Checkbox("Compact layout (16 bit event counts, 8 bit dev)", &gui_set.compact_layout))
+		injectWorldLayout(gui_set.compact_layout); // the world follows once the shaders are rebuilt
 	
 	if (gui_set.enable_break_at_step && dispatch_counter == (unsigned)gui_set.break_at_step_number) 
 		*run = false;
@@ -353,6 +383,25 @@ static void guiControl(bool* reset, bool* run, bool* step, ivec2* size_request,
 
 	gui::Checkbox("Don't reset when code changes", &dont_reset_when_code_changes);
 
+	// the native world is copied at a step boundary and written in the background, see SnapshotWriter
+	if (getNativeBackendEnabled()) {
+		if (gui::Checkbox("Checkpoint every", &gui_set.checkpoints)) {
+			dirCreate("snapshots/");
+			native_checkpoints.restart();
+		}
+		gui::SameLine();
+		gui::PushItemWidth(80.0f);
+		gui::InputInt("steps or##checkpoint", &native_checkpoints.every_steps, 0);
+		gui::SameLine();
+		gui::InputFloat("minutes##checkpoint", &native_checkpoints.every_minutes, 0.0f, 0.0f, "%.1f");
+		gui::PopItemWidth();
+		native_checkpoints.every_steps = max(native_checkpoints.every_steps, 0);
+		native_checkpoints.every_minutes = max(native_checkpoints.every_minutes, 0.0f);
+		if (gui::IsItemHovered()) gui::SetTooltip("Snapshots of the native world to %s.<step>, 0 turns either off", native_snapshot_pathfile);
+		if (native_checkpoint_writer.pending() || native_checkpoint_writer.failed())
+			gui::Text("Checkpoints: %d being written, %d failed", native_checkpoint_writer.pending(), native_checkpoint_writer.failed());
+	}
+
 	gui::NextColumn();
 
 	if (AEPS < 1000.0)
@@ -429,10 +478,179 @@ void guiAtomInspector(Atom A) {
 	}
 }
 
-void mfmInit() {
+static void guiNative() {
+	bool enabled = getNativeBackendEnabled();
+	if (gui::Checkbox("Run on CPU as well", &enabled))
+		setNativeBackendEnabled(enabled);
+	if (!enabled) return;
+
+	int schedule = native_world.schedule;
+	bool schedule_change = false;
+	schedule_change |= gui::RadioButton("Uniform", &schedule, NativeSchedule_uniform); gui::SameLine();
+	schedule_change |= gui::RadioButton(TempStr("Tiled (%d threads)", jobsThreadCount()), &schedule, NativeSchedule_tiled); gui::SameLine();
+	schedule_change |= gui::RadioButton("Vote", &schedule, NativeSchedule_vote);
+	native_world.schedule = NativeSchedule(schedule);
+	if (native_world.schedule == NativeSchedule_tiled) {
+		gui::PushItemWidth(100.0f);
+		schedule_change |= gui::InputInt("Tile size", &native_world.tile_size);
+		gui::PopItemWidth();
+		schedule_change |= gui::Checkbox("Skip dormant tiles", &native_world.skip_dormant_tiles);
+		native_world.tile_size = max(native_world.tile_size, NATIVE_TILE_SIZE_MIN);
+	}
+	if (native_world.schedule == NativeSchedule_vote) {
+		gui::Text("Exclusion kernel:"); gui::SameLine();
+		int kernel = native_world.exclusion_kernel;
+		for (int i = 0; i < ExclusionKernel_count; ++i) {
+			if (!exclusionKernelSupported(ExclusionKernel(i))) continue;
+			gui::RadioButton(exclusionKernelName(ExclusionKernel(i)), &kernel, i); gui::SameLine();
+		}
+		gui::NewLine();
+		native_world.exclusion_kernel = ExclusionKernel(kernel); // every kernel gives the same mask, so no reset needed
+	}
+	if (schedule_change)
+		native_world.reset();
+
+	const NativeModule* module = nativeModule();
+	if (!module) {
+		gui::TextColored(COLOR_ERROR, "No native module loaded");
+	} else {
+		gui::Text("Build time:         %3.2f sec", nativeBuildTime());
+		gui::Text("Step:               %u", native_world.dispatch_counter);
+		gui::Text("AEPS:               %.1f", native_world.size.x == 0 ? 0.0 : double(native_world.events_since_reset) / (double(native_world.size.x) * native_world.size.y));
+		gui::Text("Events per second:  %3.3fM", native_sec_per_batch == 0.0f ? 0.0f : native_events_this_batch / native_sec_per_batch / 1000000.0f);
+		gui::Text("Batch:              %3.3f ms", native_sec_per_batch * 1000.0f);
+		if (native_world.schedule == NativeSchedule_tiled && native_world.skip_dormant_tiles)
+			gui::Text("Occupied tiles:     %d / %d", native_world.occupied_tiles, native_world.tile_count.x * native_world.tile_count.y);
+	}
+	if (module && gui::CollapsingHeader("Atom counts (native world)")) {
+		// the native world's own census, kept up to date by its events. the Statistics window is the gpu world's
+		static Bunch<u32> counts;
+		counts.clear();
+		if (!native_world.needsReset())
+			native_world.countTypes(&counts);
+		int total_sites = native_world.size.x * native_world.size.y;
+		gui::Text("Sites of the CPU world at step %u:", native_world.dispatch_counter);
+		for (int i = 0; i < counts.count && i < prog_info.elems.count; ++i) {
+			if (counts[i] == 0) continue;
+			ElementInfo& einfo = prog_info.elems[i];
+			gui::Text("[%-2.*s]: %9u (%7.3f%%)", einfo.symbol.len, einfo.symbol.str, counts[i], float(counts[i]) / float(max(total_sites, 1)) * 100.0f);
+		}
+	}
+	if (module && gui::CollapsingHeader("Snapshot")) {
+		gui::InputText("File", native_snapshot_pathfile, sizeof(native_snapshot_pathfile));
+		if (gui::Button("Save")) {
+			dirCreate("snapshots/");
+			snapshotSave(native_snapshot_pathfile, &native_world, &prog_info);
+		}
+		gui::SameLine();
+		if (gui::Button("Load")) {
+			SnapshotHeader header;
+			if (snapshotReadHeader(native_snapshot_pathfile, &header)) {
+				// the gpu world follows the snapshot's size, so the resize doesn't reset the native world after loading
+				gui_set.size_option = 0;
+				gui_set.size_custom = ivec2(header.size_x, header.size_y);
+				gui_world_res = gui_set.size_custom;
+				native_load_pending = true;
+			}
+		}
+		gui::SameLine();
+		if (gui::Button("Save PNG")) { // rendered on the cpu, no need for the gpu world to match
+			WorldImagePalette palette;
+			palette.build(&prog_info);
+			dirCreate("screenshots/");
+			worldImageSave(TempStr("screenshots/native.%u.png", native_world.dispatch_counter), native_world.site_bits.data.ptr, native_world.size, &palette, 1);
+		}
+	}
+	if (module && gui::CollapsingHeader("Trajectory")) {
+		gui::InputText("File##trajectory", native_trajectory_pathfile, sizeof(native_trajectory_pathfile));
+		if (native_trajectory.isOpen()) {
+			gui::Text("Recording, %d frames", int(native_trajectory.index.count));
+			gui::SameLine();
+			if (gui::Button("Stop"))
+				native_trajectory.close();
+		} else {
+			gui::PushItemWidth(100.0f);
+			gui::InputInt("Keyframe every", &native_keyframe_every);
+			gui::PopItemWidth();
+			native_keyframe_every = max(native_keyframe_every, 1);
+			if (gui::Button("Record")) {
+				native_trajectory_view.close();
+				dirCreate("snapshots/");
+				if (native_trajectory.open(native_trajectory_pathfile, &native_world, &prog_info, native_keyframe_every))
+					native_trajectory.record(&native_world); // the world as it is now is the first keyframe
+			}
+		}
+		// puts a recorded step into the native world, to look at it
+		gui::PushItemWidth(100.0f);
+		gui::InputInt("Step##trajectory", &native_trajectory_step);
+		gui::PopItemWidth();
+		native_trajectory_step = max(native_trajectory_step, 0);
+		gui::SameLine();
+		if (gui::Button("Show") && !native_trajectory.isOpen()) {
+			if (native_trajectory_view.f || native_trajectory_view.open(native_trajectory_pathfile)) {
+				const TrajectoryHeader& h = native_trajectory_view.header;
+				if (ivec2(h.size_x, h.size_y) != native_world.size)
+					logError("TRAJECTORY", 0, "The trajectory is %dx%d, the world %dx%d", h.size_x, h.size_y, native_world.size.x, native_world.size.y);
+				else if (native_trajectory_view.seek(u32(native_trajectory_step))) {
+					memcpy(native_world.site_bits.data.ptr, native_trajectory_view.site_bits.ptr, size_t(native_trajectory_view.site_bits.bytes()));
+					native_world.dispatch_counter = u32(native_trajectory_step);
+					native_world.rescanTiles();
+				}
+			}
+		}
+		if (native_trajectory_view.f) {
+			gui::SameLine();
+			if (gui::Button("Close"))
+				native_trajectory_view.close();
+		}
+	}
+	StringRange build_log = nativeBuildLog();
+	if (build_log.len && gui::CollapsingHeader("Build log"))
+		gui::TextUnformatted(build_log.str, build_log.str + build_log.len);
+}
+static void nativeUpdate(bool do_reset) {
+	native_sec_per_batch = 0.0f;
+	native_events_this_batch = 0;
+	if (!getNativeBackendEnabled() || !nativeModule()) {
+		native_world.destroy();
+		return;
+	}
+	do_reset |= native_world.resize(gui_world_res);
+	do_reset |= native_world.needsReset();
+	if (do_reset)
+		native_world.reset();
+	if (native_load_pending) {
+		snapshotLoad(native_snapshot_pathfile, &native_world, &prog_info);
+		native_load_pending = false;
+	}
 
+	s64 time_start = time_counter();
+	s64 events_start = native_world.events_since_reset;
+	for (int i = 0; i < ctrl.dispatches_per_batch; ++i) {
+		if (ctrl.stop_at_n_dispatches != 0 && native_world.dispatch_counter == (u32)ctrl.stop_at_n_dispatches) break;
+		native_world.step();
+		if (native_trajectory.isOpen())
+			native_trajectory.record(&native_world);
+		if (gui_set.checkpoints && native_checkpoints.due(native_world.dispatch_counter))
+			native_checkpoint_writer.take(TempStr("%s.%u", native_snapshot_pathfile, native_world.dispatch_counter), &native_world, &prog_info);
+	}
+	native_sec_per_batch = float(time_to_sec(time_counter() - time_start));
+	native_events_this_batch = native_world.events_since_reset - events_start;
+}
+
+void mfmInit() {
+	jobsInit();
+	native_checkpoints.every_minutes = 10.0f;
+	injectWorldLayout(gui_set.compact_layout);
 }
 void mfmTerm() {
+	splatCompilerDestroy();
+	native_trajectory.close();
+	native_trajectory_view.close();
+	native_checkpoint_writer.destroy();
+	native_world.destroy();
+	nativeDestroy();
+	jobsTerm();
 	world.destroy();
 	computeDestroy();
 	renderDestroy();
@@ -446,8 +664,9 @@ void mfmUpdate(Input* main_in) {
 
 	ctrl.do_reset = false;
 
-	/* Check for Splat code changes and compile them */
+	/* Check for Splat code changes and compile them, the new code starts running once its shaders are ready too */
 	ctimer_start("splat");
+	shadersPoll();
 	bool file_change = false;
 	bool project_change = false;
 	checkForSplatProgramChanges(&file_change, &project_change, &prog_info);
@@ -460,6 +679,9 @@ void mfmUpdate(Input* main_in) {
 	bool pipelines_rebuilt = false;
 	pipelines_rebuilt |= computeRecreatePipelineIfNeeded();
 	pipelines_rebuilt |= renderRecreatePipelineIfNeeded();
+	static u32 world_layout = 0; // follows the shaders that are actually running, not the settings
+	if (pipelines_rebuilt)
+		world_layout = (getCounterPrngEnabled() ? WorldLayout_counter_prng : 0) | (gui_set.compact_layout ? WorldLayout_compact : 0);
 
 	ctimer_start("controls");
 	ivec2 screen_res = ivec2(evk.win.Width, evk.win.Height);
@@ -599,13 +821,18 @@ void mfmUpdate(Input* main_in) {
 		gui::Text("Time:               %3.1f sec", sim_time_since_reset);
 	} gui::End(); 
 
+	if (gui::Begin("Native")) {
+		guiNative();
+	} gui::End();
+
 	bool world_has_changed = false;
 	if (mfmComputeAndRenderPipelinesOk()) {
 		ivec2 prev_world_size = world.size;
-		bool resized = world.resize(gui_world_res);
+		bool resized = world.resize(gui_world_res, world_layout);
 		if (resized || pipelines_rebuilt)
 			world.updateDescriptorSets(computeGetDescriptorSet(), renderGetDescriptorSet(), renderGetSampler());
 		world_has_changed |= world.size != prev_world_size;
+		ctrl.do_reset |= resized; // also when only the layout changed
 	}
 	initStatsIfNeeded();
 
@@ -618,6 +845,10 @@ void mfmUpdate(Input* main_in) {
 
 	/* GL UPDATE WAS HERE */
 
+	ctimer_start("native");
+	nativeUpdate(ctrl.do_reset);
+	ctimer_stop();
+
 	if (site_info.event_ocurred_signal != 0) {
 		log("Break!\n");
 		run = false;
@@ -702,7 +933,7 @@ void mfmCompute(VkCommandBuffer cb) {
 		events_since_reset = 0;
 		sim_time_since_reset = 0.0;
 		wall_time_since_reset = 0.0;
-		computeStage(cb, STAGE_RESET, world.voteMapSize());
+		computeStage(cb, STAGE_RESET, world.voteMapSize(), 0);
 		time_of_reset = time_counter();
 		ctrl.do_reset = false;
 	}
@@ -718,11 +949,11 @@ void mfmCompute(VkCommandBuffer cb) {
 			if (ctrl.stop_at_n_dispatches != 0 && ctrl.dispatch_counter == ctrl.stop_at_n_dispatches) break;
 
 			gtimer_start("vote");
-			computeStage(cb, STAGE_VOTE, world.voteMapSize());
+			computeStage(cb, STAGE_VOTE, world.voteMapSize(), ctrl.dispatch_counter);
 			gtimer_stop();
 		
 			gtimer_start("tick");
-			computeStage(cb, STAGE_EVENT, world.size);
+			computeStage(cb, STAGE_EVENT, world.size, ctrl.dispatch_counter);
 			gtimer_stop();
 
 			ctrl.dispatch_counter++;
@@ -740,6 +971,8 @@ void mfmCompute(VkCommandBuffer cb) {
 	computeStage(cb, STAGE_RENDER, world.size);
 	gtimer_stop();
 
+	recFrame(cb, "world", world.color.image, world.color.size);
+
 	gtimer_start("read stats");
 	mfmReadStats();
 	gtimer_stop();
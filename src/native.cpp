@@ -0,0 +1,510 @@
+#include "native.h"
+#include "core/log.h"
+#include "core/dir.h"
+#include "core/file_stat.h"
+#include "core/runprog.h"
+#include "core/cpu_timer.h"
+#include "core/jobs.h"
+
+#include "shaders/cpu_gpu_shared.inl" // for the atom type layout
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define NATIVE_BIN_DIRECTORY "native_bin/"
+
+// Overridable from the build, eg. to point at a different compiler or add -march flags.
+// %s is the output library path. Include paths are relative to the working directory, same as the shaders.
+#ifndef NATIVE_COMPILE_COMMAND
+#ifdef _WIN32
+#define NATIVE_LIB_EXTENSION ".dll"
+#define NATIVE_COMPILE_COMMAND "cl /nologo /O2 /LD /EHsc /w /I. /I" NATIVE_BIN_DIRECTORY " shaders/staged_update_native.cpp /Fo" NATIVE_BIN_DIRECTORY " /Fe%s"
+#else
+#define NATIVE_LIB_EXTENSION ".so"
+#define NATIVE_COMPILE_COMMAND "g++ -std=c++11 -O2 -shared -fPIC -fvisibility=hidden -w -I. -I" NATIVE_BIN_DIRECTORY " shaders/staged_update_native.cpp -o %s 2>&1"
+#endif
+#endif
+
+static void* native_lib = NULL;
+static const NativeModule* native_module = NULL;
+static u32 native_generation = 0;
+static int native_build_counter = 0;
+static String native_log;
+static float native_time_to_build = 0.0f;
+
+static void* libOpen(const char* pathfile) {
+#ifdef _WIN32
+	return (void*)LoadLibraryA(pathfile);
+#else
+	return dlopen(pathfile, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+static void* libSymbol(void* lib, const char* name) {
+#ifdef _WIN32
+	return (void*)GetProcAddress((HMODULE)lib, name);
+#else
+	return dlsym(lib, name);
+#endif
+}
+static void libClose(void* lib) {
+#ifdef _WIN32
+	FreeLibrary((HMODULE)lib);
+#else
+	dlclose(lib);
+#endif
+}
+
+bool nativeBuild(StringRange decl_code, StringRange elem_code) {
+	s64 time_start = time_counter();
+	native_log.clear();
+
+	dirCreate(NATIVE_BIN_DIRECTORY);
+	if (!fileWriteBinary(NATIVE_BIN_DIRECTORY "atom_decls.inl", (char*)decl_code.str, decl_code.len) ||
+		!fileWriteBinary(NATIVE_BIN_DIRECTORY "atoms.inl", (char*)elem_code.str, elem_code.len)) {
+		native_log.set("Couldn't write the generated code into " NATIVE_BIN_DIRECTORY);
+		logError("NATIVE", 0, "%s", native_log.str);
+		return false;
+	}
+
+	// every build gets its own name, since a library can't be reliably reopened under the same name while the old one is loaded
+	TempStr lib_pathfile = TempStr(NATIVE_BIN_DIRECTORY "atoms_%d" NATIVE_LIB_EXTENSION, native_build_counter++);
+	fileDelete(lib_pathfile);
+	runProg(TempStr(NATIVE_COMPILE_COMMAND, lib_pathfile.str), &native_log);
+	native_time_to_build = float(time_to_sec(time_counter() - time_start));
+
+	void* lib = libOpen(lib_pathfile);
+	if (!lib) {
+		logError("NATIVE", 0, "Build of '%s' failed:\n%.*s", lib_pathfile.str, native_log.len, native_log.str);
+		return false;
+	}
+	NativeGetModuleFunc get_module = (NativeGetModuleFunc)libSymbol(lib, NATIVE_MODULE_ENTRY);
+	const NativeModule* module = get_module ? get_module() : NULL;
+	if (!module || module->abi_version != NATIVE_ABI_VERSION) {
+		logError("NATIVE", 0, "'%s' is not a compatible native module", lib_pathfile.str);
+		libClose(lib);
+		return false;
+	}
+
+	if (native_lib) {
+		libClose(native_lib);
+		fileDelete(TempStr(NATIVE_BIN_DIRECTORY "atoms_%d" NATIVE_LIB_EXTENSION, native_build_counter - 2));
+	}
+	native_lib = lib;
+	native_module = module;
+	native_generation += 1;
+	logInfo("NATIVE", "Built '%s' in %.2f sec, %d types", lib_pathfile.str, native_time_to_build, module->type_count);
+	return true;
+}
+const NativeModule* nativeModule() {
+	return native_module;
+}
+u32 nativeModuleGeneration() {
+	return native_generation;
+}
+StringRange nativeBuildLog() {
+	return native_log.range();
+}
+float nativeBuildTime() {
+	return native_time_to_build;
+}
+void nativeDestroy() {
+	if (native_lib) libClose(native_lib);
+	native_lib = NULL;
+	native_module = NULL;
+	native_log.free();
+}
+
+static ivec2 paddedSize(ivec2 world_size) {
+	return world_size + ivec2(EVENT_WINDOW_RADIUS * 2 * 2);
+}
+static u32 splitMix32(u32& state) {
+	u32 b = (state += 0x9e3779b9);
+	b ^= b >> 15;
+	b *= 0x85ebca6b;
+	b ^= b >> 13;
+	b *= 0xc2b2ae3d;
+	b ^= b >> 16;
+	return b;
+}
+
+void NativeWorld::destroy() {
+	 prng_state.destroy();
+	  site_bits.destroy();
+	event_count.destroy();
+	vote.destroy();
+	active.clear();
+	row_live_events.clear();
+	tile_sched_state.clear();
+	tile_occupied.clear();
+	tile_halo.clear();
+	tile_live_events.clear();
+	tile_type_counts.clear();
+	type_counts.clear();
+	type_counts_valid = false;
+	type_deltas.clear();
+	type_delta_dirty.clear();
+
+	size = ivec2(0,0);
+	tile_count = ivec2(0,0);
+}
+bool NativeWorld::resize(ivec2 new_size) {
+	if (size == new_size) return false;
+	destroy();
+	if (new_size == ivec2(0, 0)) return true;
+
+	  site_bits.resize(new_size);
+	event_count.resize(new_size);
+	if (!nativeModule() || nativeModule()->prng_state_size != 0)
+		prng_state.resize(paddedSize(new_size));
+	       vote.resize(paddedSize(new_size));
+	active.setgarbage(s64(new_size.x) * new_size.y);
+	row_live_events.setgarbage(s64(new_size.y) * 2);
+	size = new_size;
+
+	s64 bytes = this->bytes();
+	logInfo("NATIVE", "World resized to %dx%d, %.1f B per site, %d MiB (%lld B)", size.x, size.y, double(bytes) / (double(size.x) * size.y), int(bytes / (1024 * 1024)), bytes);
+	return true;
+}
+NativeWorldView NativeWorld::view() {
+	NativeWorldView v;
+	v.site_bits = site_bits.data.ptr;
+	v.prng_state = prng_state.data.ptr;
+	v.event_count = event_count.data.ptr;
+	v.size_x = size.x;
+	v.size_y = size.y;
+	v.prng_size_x = vote.size.x;
+	v.prng_size_y = vote.size.y;
+	v.dispatch_counter = dispatch_counter;
+	return v;
+}
+static NativeRect tileRect(const NativeWorld* w, ivec2 tile) {
+	NativeRect rect;
+	rect.x0 = tile.x * w->tile_size;
+	rect.y0 = tile.y * w->tile_size;
+	rect.x1 = min(rect.x0 + w->tile_size, w->size.x);
+	rect.y1 = min(rect.y0 + w->tile_size, w->size.y);
+	return rect;
+}
+// Void and Empty are always types 0 and 1, and never have a behavior, so events on them do nothing
+static bool rectIsInert(const NativeWorld* w, NativeRect rect) {
+	for (int y = rect.y0; y < rect.y1; ++y) {
+		const u32* site = w->site_bits.data.ptr + (size_t(y) * w->size.x + rect.x0) * 4;
+		for (int x = rect.x0; x < rect.x1; ++x, site += 4)
+			if (((site[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK) > 1)
+				return false;
+	}
+	return true;
+}
+static void tileOccupancyJob(void* data, ivec2 tile) {
+	NativeWorld* w = (NativeWorld*)data;
+	w->tile_occupied[tile.y * w->tile_count.x + tile.x] = rectIsInert(w, tileRect(w, tile)) ? 0 : 1;
+}
+static int countOccupiedTiles(const NativeWorld* w) {
+	int count = 0;
+	for (int i = 0; i < w->tile_occupied.count; ++i)
+		count += w->tile_occupied[i];
+	return count;
+}
+
+void NativeWorld::reset() {
+	const NativeModule* module = nativeModule();
+	if (!module || size == ivec2(0,0)) return;
+
+	// a module built with the counter prng keeps no per site prng state at all
+	if (module->prng_state_size == 0)
+		prng_state.destroy();
+	else
+		prng_state.resize(paddedSize(size));
+	memset(site_bits.data.ptr, 0, size_t(site_bits.data.bytes()));
+	NativeWorldView v = view();
+	module->reset(&v, 0, vote.size.y);
+
+	u32 state = seed;
+	for (int i = 0; i < 4; ++i)
+		sched_state[i] = splitMix32(state);
+	tile_size = max(tile_size, NATIVE_TILE_SIZE_MIN);
+	tile_count = (size + ivec2(tile_size - 1)) / tile_size;
+	tile_sched_state.setgarbage(s64(tile_count.x) * tile_count.y * 4);
+	tile_live_events.setgarbage(s64(tile_count.x) * tile_count.y);
+	tile_occupied.setgarbage(s64(tile_count.x) * tile_count.y);
+	tile_halo.setgarbage(s64(tile_count.x) * tile_count.y * 9);
+	memset(tile_halo.ptr, 0, size_t(tile_halo.bytes()));
+	for (int i = 0; i < tile_sched_state.count; ++i)
+		tile_sched_state[i] = splitMix32(state);
+	jobsParallelFor2D(tile_count, tileOccupancyJob, this);
+	occupied_tiles = countOccupiedTiles(this);
+	recountTypes(); // the one full scan, the steps keep the counts going from here
+	dispatch_counter = 0;
+	events_since_reset = 0;
+	live_events_since_reset = 0;
+	memset(stage_time, 0, sizeof(stage_time));
+	module_generation = nativeModuleGeneration();
+}
+void NativeWorld::rescanTiles() {
+	if (tile_count == ivec2(0,0)) return;
+	memset(tile_halo.ptr, 0, size_t(tile_halo.bytes())); // a fresh scan already sees everything the notes would have said
+	jobsParallelFor2D(tile_count, tileOccupancyJob, this);
+	occupied_tiles = countOccupiedTiles(this);
+	recountTypes();
+}
+namespace {
+
+struct TilePhase {
+	NativeWorld* world;
+	const NativeModule* module;
+	NativeWorldView view;
+	ivec2 color; // which of the 2x2 tile colors runs in this phase
+};
+
+struct VoteRound {
+	NativeWorld* world;
+	const NativeModule* module;
+	NativeWorldView view;
+	int band_height;
+};
+
+struct TileCensus {
+	const NativeWorld* world;
+	u32 type_count;
+	u32* tile_counts; // type_count per tile
+};
+
+};
+
+static void tilePhaseJob(void* data, ivec2 index) {
+	TilePhase* phase = (TilePhase*)data;
+	NativeWorld* w = phase->world;
+	ivec2 tile = index * 2 + phase->color;
+	int tile_idx = tile.y * w->tile_count.x + tile.x;
+	NativeRect rect = tileRect(w, tile);
+	if (w->skip_dormant_tiles) {
+		// wake up if a neighbor left something close enough for our events to reach, and take the note back.
+		// none of the 8 neighbors share our color, so nobody else touches them or their notes right now.
+		bool awake = w->tile_occupied[tile_idx] != 0;
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				ivec2 n = tile + ivec2(dx, dy);
+				if ((dx == 0 && dy == 0) || n.x < 0 || n.y < 0 || n.x >= w->tile_count.x || n.y >= w->tile_count.y) continue;
+				u8& note = w->tile_halo[(n.y * w->tile_count.x + n.x) * 9 + (1 - dx) + (1 - dy) * 3];
+				awake |= note != 0;
+				note = 0;
+			}
+		}
+		if (!awake) {
+			w->tile_live_events[tile_idx] = 0;
+			return;
+		}
+	}
+	// a full step worth of events for the tile, so every site still averages 1 event per step
+	u32 count = u32((rect.x1 - rect.x0) * (rect.y1 - rect.y0));
+	w->tile_live_events[tile_idx] = phase->module->events(&phase->view, rect, count, w->tile_sched_state.ptr + tile_idx * 4, w->type_deltas.ptr + size_t(tile_idx) * phase->module->type_count);
+	w->type_delta_dirty[tile_idx] = 1;
+	if (w->skip_dormant_tiles) {
+		w->tile_occupied[tile_idx] = rectIsInert(w, rect) ? 0 : 1;
+		// our events may have pushed atoms into the neighbors, note which ones have to wake up
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				ivec2 n = tile + ivec2(dx, dy);
+				if ((dx == 0 && dy == 0) || n.x < 0 || n.y < 0 || n.x >= w->tile_count.x || n.y >= w->tile_count.y) continue;
+				NativeRect halo = tileRect(w, n);
+				halo.x0 = max(halo.x0, rect.x0 - EVENT_WINDOW_RADIUS);
+				halo.y0 = max(halo.y0, rect.y0 - EVENT_WINDOW_RADIUS);
+				halo.x1 = min(halo.x1, rect.x1 + EVENT_WINDOW_RADIUS);
+				halo.y1 = min(halo.y1, rect.y1 + EVENT_WINDOW_RADIUS);
+				w->tile_halo[tile_idx * 9 + (1 + dx) + (1 + dy) * 3] = rectIsInert(w, halo) ? 0 : 1;
+			}
+		}
+	}
+}
+
+// The vote schedule works in bands of rows. The exclusion mask of a band needs the vote rows around it as well,
+// so bands are kept tall enough for that overlap to stay cheap.
+#define NATIVE_VOTE_BAND_HEIGHT 64
+
+static void voteBandJob(void* data, int band) {
+	VoteRound* round = (VoteRound*)data;
+	NativeWorld* w = round->world;
+	int y0 = band * round->band_height;
+	int y1 = min(y0 + round->band_height, w->vote.size.y);
+	round->module->vote(&round->view, w->vote.data.ptr, y0, y1);
+}
+static void exclusionBandJob(void* data, int band) {
+	VoteRound* round = (VoteRound*)data;
+	NativeWorld* w = round->world;
+	int y0 = band * round->band_height;
+	int y1 = min(y0 + round->band_height, w->size.y);
+	exclusionComputeMask(w->exclusion_kernel, w->vote.data.ptr, w->vote.size, round->module->exclusion_radius, y0, y1, w->active.ptr + size_t(y0) * w->size.x);
+}
+static void eventRowJob(void* data, int y) {
+	VoteRound* round = (VoteRound*)data;
+	NativeWorld* w = round->world;
+	// winners are more than the exclusion radius apart, so their windows never overlap and any row can run on any thread
+	const u8* row = w->active.ptr + size_t(y) * w->size.x;
+	u32 winners = 0;
+	for (int x = 0; x < w->size.x; ++x)
+		winners += row[x];
+	w->row_live_events[y * 2 + 0] = winners;
+	w->row_live_events[y * 2 + 1] = 0;
+	if (winners) {
+		w->row_live_events[y * 2 + 1] = round->module->eventsActive(&round->view, y, row, w->type_deltas.ptr + size_t(y) * round->module->type_count);
+		w->type_delta_dirty[y] = 1;
+	}
+}
+
+// Every job that runs events has a slot of its own to note type changes in, so no atomics are needed.
+// Slots start out zeroed and only those whose events ran are folded in and zeroed again afterwards.
+static void prepareTypeDeltas(NativeWorld* w, const NativeModule* module, s64 slot_count) {
+	if (w->type_delta_dirty.count != slot_count || w->type_deltas.count != slot_count * module->type_count) {
+		w->type_deltas.setgarbage(slot_count * module->type_count);
+		memset(w->type_deltas.ptr, 0, size_t(w->type_deltas.bytes()));
+		w->type_delta_dirty.setgarbage(slot_count);
+		memset(w->type_delta_dirty.ptr, 0, size_t(w->type_delta_dirty.bytes()));
+	}
+	if (w->type_counts.count != s64(module->type_count))
+		w->type_counts_valid = false; // the module changed under the world, the next countTypes rescans
+}
+static void foldTypeDeltas(NativeWorld* w, const NativeModule* module) {
+	u32 type_count = module->type_count;
+	bool valid = w->type_counts_valid;
+	for (s64 slot = 0; slot < w->type_delta_dirty.count; ++slot) {
+		if (!w->type_delta_dirty[slot]) continue;
+		s32* deltas = w->type_deltas.ptr + slot * type_count;
+		for (u32 t = 0; t < type_count; ++t) {
+			if (valid) w->type_counts[t] += u32(deltas[t]);
+			deltas[t] = 0;
+		}
+		w->type_delta_dirty[slot] = 0;
+	}
+}
+
+void NativeWorld::step() {
+	const NativeModule* module = nativeModule();
+	if (!module || size == ivec2(0,0)) return;
+
+	NativeWorldView v = view();
+	u32 count = u32(size.x * size.y);
+	s64 time_start = time_counter();
+	if (schedule == NativeSchedule_uniform) {
+		prepareTypeDeltas(this, module, 1);
+		NativeRect rect = { 0, 0, size.x, size.y };
+		live_events_since_reset += module->events(&v, rect, count, sched_state, type_deltas.ptr);
+		type_delta_dirty[0] = 1;
+		stage_time[NativeStage_event] += time_counter() - time_start;
+	} else if (schedule == NativeSchedule_vote) {
+		// vote -> exclusion mask -> events, like the gpu's STAGE_VOTE and STAGE_EVENT dispatches
+		VoteRound round;
+		round.world = this;
+		round.module = module;
+		round.view = v;
+		round.band_height = NATIVE_VOTE_BAND_HEIGHT;
+		prepareTypeDeltas(this, module, size.y);
+		Job* voted = jobsSubmit((vote.size.y + round.band_height - 1) / round.band_height, voteBandJob, &round);
+		Job* masked = jobsSubmit((size.y + round.band_height - 1) / round.band_height, exclusionBandJob, &round, &voted, 1);
+		Job* stepped = jobsSubmit(size.y, eventRowJob, &round, &masked, 1);
+		jobsWait(voted);
+		s64 time_voted = time_counter();
+		jobsWait(masked);
+		s64 time_masked = time_counter();
+		jobsWait(stepped);
+		s64 time_stepped = time_counter();
+		stage_time[NativeStage_vote] += time_voted - time_start;
+		stage_time[NativeStage_exclusion] += time_masked - time_voted;
+		stage_time[NativeStage_event] += time_stepped - time_masked;
+		count = 0;
+		for (int y = 0; y < size.y; ++y) {
+			count += row_live_events[y * 2 + 0];
+			live_events_since_reset += row_live_events[y * 2 + 1];
+		}
+	} else {
+		if (tile_count == ivec2(0,0)) return; // not reset since the last resize
+		prepareTypeDeltas(this, module, s64(tile_count.x) * tile_count.y);
+		// tiles of the same color are a whole tile apart, so their events can't see each other and need no voting.
+		// the order of the colors is shuffled every step, so no tile edge is systematically updated first.
+		static const ivec2 colors[4] = { ivec2(0,0), ivec2(1,0), ivec2(0,1), ivec2(1,1) };
+		int order[4] = { 0, 1, 2, 3 };
+		for (int i = 3; i > 0; --i) {
+			int j = int(splitMix32(sched_state[0]) % u32(i + 1));
+			int t = order[i]; order[i] = order[j]; order[j] = t;
+		}
+		memset(tile_live_events.ptr, 0, size_t(tile_live_events.bytes()));
+		// each phase depends on the previous one, so all four can be queued up front
+		TilePhase phases[4];
+		Job* jobs[4];
+		for (int p = 0; p < 4; ++p) {
+			TilePhase& phase = phases[p];
+			phase.world = this;
+			phase.module = module;
+			phase.view = v;
+			phase.color = colors[order[p]];
+			ivec2 phase_tile_count = (tile_count - phase.color + ivec2(1)) / 2;
+			jobs[p] = jobsSubmit2D(phase_tile_count, tilePhaseJob, &phase, p == 0 ? NULL : &jobs[p-1], p == 0 ? 0 : 1);
+		}
+		for (int p = 0; p < 4; ++p)
+			jobsWait(jobs[p]);
+		stage_time[NativeStage_event] += time_counter() - time_start;
+		for (int i = 0; i < tile_live_events.count; ++i)
+			live_events_since_reset += tile_live_events[i];
+		occupied_tiles = countOccupiedTiles(this);
+	}
+	events_since_reset += count;
+	dispatch_counter += 1;
+
+	s64 time_census = time_counter();
+	foldTypeDeltas(this, module);
+	stage_time[NativeStage_census] += time_counter() - time_census;
+}
+static void tileCensusJob(void* data, ivec2 tile) {
+	TileCensus* census = (TileCensus*)data;
+	const NativeWorld* w = census->world;
+	NativeRect rect = tileRect(w, tile);
+	u32* counts = census->tile_counts + size_t(tile.y * w->tile_count.x + tile.x) * census->type_count;
+	memset(counts, 0, census->type_count * sizeof(u32));
+	for (int y = rect.y0; y < rect.y1; ++y) {
+		const u32* site = w->site_bits.data.ptr + (size_t(y) * w->size.x + rect.x0) * 4;
+		for (int x = rect.x0; x < rect.x1; ++x, site += 4) {
+			u32 type = (site[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK;
+			counts[min(type, census->type_count - 1)] += 1; // anything out of range is corrupt, lump it in with the last type
+		}
+	}
+}
+void NativeWorld::countTypes(Bunch<u32>* counts) {
+	const NativeModule* module = nativeModule();
+	counts->clear();
+	if (!module || tile_count == ivec2(0,0)) return;
+	if (!type_counts_valid || type_counts.count != s64(module->type_count))
+		recountTypes();
+	counts->copy(type_counts);
+}
+void NativeWorld::recountTypes() {
+	const NativeModule* module = nativeModule();
+	type_counts_valid = false;
+	if (!module || tile_count == ivec2(0,0)) return;
+
+	// every tile histograms its own sites, then the tiles get summed up
+	s64 time_start = time_counter();
+	TileCensus census;
+	census.world = this;
+	census.type_count = module->type_count;
+	tile_type_counts.setgarbage(s64(tile_count.x) * tile_count.y * census.type_count);
+	census.tile_counts = tile_type_counts.ptr;
+	jobsParallelFor2D(tile_count, tileCensusJob, &census);
+
+	type_counts.setgarbage(census.type_count);
+	memset(type_counts.ptr, 0, size_t(type_counts.bytes()));
+	for (s64 t = 0; t < s64(tile_count.x) * tile_count.y; ++t)
+		for (u32 i = 0; i < census.type_count; ++i)
+			type_counts[i] += census.tile_counts[t * census.type_count + i];
+	type_counts_valid = true;
+	stage_time[NativeStage_census] += time_counter() - time_start;
+}
+bool NativeWorld::needsReset() const {
+	return module_generation != nativeModuleGeneration();
+}
+s64 NativeWorld::bytes() const {
+	return prng_state.data.bytes() + site_bits.data.bytes() + event_count.data.bytes() + vote.data.bytes() + active.bytes() + row_live_events.bytes() +
+		tile_sched_state.bytes() + tile_occupied.bytes() + tile_halo.bytes() + tile_live_events.bytes() + tile_type_counts.bytes() +
+		type_counts.bytes() + type_deltas.bytes() + type_delta_dirty.bytes();
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "core/vec2.h"
+#include "core/container.h"
+#include "core/string_range.h"
+#include "shaders/cpu_native_shared.inl"
+#include "shaders/defines.inl" // for EVENT_WINDOW_RADIUS
+#include "native_exclusion.h"
+
+// Native (CPU) backend: the SPLAT program emitted as C++, compiled into a shared object and stepped on the host.
+// Site and prng layouts are identical to the gpu images, so state can move between the two.
+
+template<int COMPONENTS>
+struct NativeStateMap {
+	ivec2 size = ivec2(0,0);
+	Bunch<u32> data; // COMPONENTS per site, row major
+
+	void destroy() {
+		free(data.ptr);
+		data.ptr = 0;
+		data.count = data.maxcount = 0;
+		size = ivec2(0,0);
+	}
+	bool resize(ivec2 new_size) {
+		if (new_size == size) return true;
+		destroy();
+		size = new_size;
+		data.setgarbage(s64(size.x) * size.y * COMPONENTS);
+		memset(data.ptr, 0, size_t(data.bytes()));
+		return true;
+	}
+};
+
+enum NativeSchedule {
+	NativeSchedule_uniform, // single thread, every event at a uniformly random site of the whole world
+	NativeSchedule_tiled,   // tiles stepped in 4 colored phases, tiles of one color run in parallel
+	NativeSchedule_vote,    // same vote + exclusion as the gpu: every site draws a vote, local maxima run their event
+};
+
+// Where NativeWorld::step and countTypes spend their time. Stages are separated by barriers, so these are wall clock times.
+// Uniform and tiled steps are all events. The census is folding the type changes of the step's events into the counts.
+enum NativeStage {
+	NativeStage_vote,
+	NativeStage_exclusion,
+	NativeStage_event,
+	NativeStage_census,
+	NativeStage_count
+};
+
+// Tiles are at least this wide, so that two same colored tiles (one tile apart) can never have overlapping event windows.
+// Twice the minimum needed (EVENT_WINDOW_RADIUS*2+1), so events near a tile edge are not too correlated with the neighbors.
+#define NATIVE_TILE_SIZE_MIN ((EVENT_WINDOW_RADIUS*2+1)*2)
+
+struct NativeWorld {
+	NativeStateMap<4> prng_state;
+	NativeStateMap<4> site_bits;
+	NativeStateMap<1> event_count;
+	NativeStateMap<1> vote;      // padded like prng_state, only used by NativeSchedule_vote
+	Bunch<u8> active;            // 1 byte per site, the winners of the last vote
+	Bunch<u32> row_live_events;  // scratch, 2 per row: winners and live events
+
+	ivec2 size = ivec2(0,0);
+	u32 seed = 0;
+	u32 sched_state[4]; // picks event sites, independent of the per site prng states
+	NativeSchedule schedule = NativeSchedule_tiled;
+	ExclusionKernel exclusion_kernel = exclusionBestKernel();
+	int tile_size = 32;
+	bool skip_dormant_tiles = true; // tiled only: tiles with nothing but Empty and Void are not stepped until something moves in
+	ivec2 tile_count = ivec2(0,0);
+	Bunch<u32> tile_sched_state; // 4 per tile, the per tile version of sched_state
+	Bunch<u8> tile_occupied;     // 1 per tile, has something other than Empty or Void in it
+	Bunch<u8> tile_halo;         // 9 per tile, something is within EVENT_WINDOW_RADIUS of the tile inside the neighbor at (dx+1) + (dy+1)*3
+	int occupied_tiles = 0;      // after the last step or reset
+	Bunch<u32> tile_live_events; // scratch, written by the tile jobs
+	Bunch<u32> tile_type_counts; // scratch for the full census
+	Bunch<u32> type_counts;      // population of every type, kept up to date by the events of every step
+	bool type_counts_valid = false;
+	Bunch<s32> type_deltas;      // type_count per slot (a tile, a row, or the whole world for uniform), the type changes of a step
+	Bunch<u8> type_delta_dirty;  // 1 per slot, its events ran this step
+	u32 dispatch_counter = 0;
+	s64 events_since_reset = 0;
+	s64 live_events_since_reset = 0;
+	u32 module_generation = 0; // module the world was last reset with
+	s64 stage_time[NativeStage_count] = {}; // time_counter ticks since the last reset
+
+	void destroy();
+	bool resize(ivec2 new_size);
+	NativeWorldView view();
+	void reset();   // STAGE_RESET, needs a loaded module
+	void step();    // one average event per site (1 AEPS) for uniform and tiled, one round of voting for vote
+	void rescanTiles(); // after site_bits were changed from the outside, eg. by loading a snapshot
+	void countTypes(Bunch<u32>* counts); // population of every type, no more than a copy unless the sites changed from the outside. needs a reset world
+	void recountTypes(); // counts every site again, per tile in parallel
+	bool needsReset() const; // the module was rebuilt since the last reset, so type ids may have moved
+	s64 bytes() const; // everything allocated for the world, scratch included
+};
+
+// Writes the C++ flavoured atom_decls.inl/atoms.inl into native_bin/, compiles them against
+// shaders/staged_update_native.cpp and swaps the result in. On failure the previous module stays loaded.
+bool nativeBuild(StringRange decl_code, StringRange elem_code);
+const NativeModule* nativeModule();
+u32 nativeModuleGeneration();
+StringRange nativeBuildLog();
+float nativeBuildTime();
+void nativeDestroy();
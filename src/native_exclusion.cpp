@@ -0,0 +1,307 @@
+#include "native_exclusion.h"
+#include "core/log.h"
+#include "shaders/cpu_gpu_shared.inl"
+#include "shaders/defines.inl" // for EVENT_WINDOW_RADIUS
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EXCLUSION_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2   // msvc hands out any intrinsic without extra flags
+#define TARGET_AVX512
+#else
+#include <immintrin.h>
+#include <cpuid.h>
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#else
+#define EXCLUSION_X86 0
+#endif
+
+#define R (EVENT_WINDOW_RADIUS*2)      // vote map padding and the biggest exclusion radius, 8
+#define ROWS (R*2+1)                   // most vote rows that touch one site row
+#define LEVELS 5                       // running max tables of width 1, 2, 4, 8, 16
+#define TABLE_PAD 16                   // zeros past the end of every table, so the tables never need bounds checks
+
+namespace {
+
+struct ExclusionOps {
+	void (*max2)(u32* dst, const u32* a, const u32* b, int n);   // dst = max(a, b)
+	void (*max3)(u32* acc, const u32* a, const u32* b, int n);   // acc = max(acc, a, b)
+	void (*greater)(u8* out, const u32* a, const u32* b, int n); // out = a > b
+};
+
+};
+
+// Reference
+
+static void computeMaskReference(const u32* vote, ivec2 vote_size, int radius, int y_begin, int y_end, u8* active) {
+	int world_width = vote_size.x - R*2;
+	for (int y = y_begin; y < y_end; ++y) {
+		for (int x = 0; x < world_width; ++x) {
+			ivec2 vote_idx = ivec2(x, y) + ivec2(R);
+			u32 center_v = vote[vote_idx.y * vote_size.x + vote_idx.x];
+			bool is_active = true;
+			for (int dy = -radius; dy <= radius && is_active; ++dy) {
+				for (int dx = -radius; dx <= radius; ++dx) {
+					int m = abs(dx) + abs(dy);
+					if (m <= radius && !(dx == 0 && dy == 0)) {
+						if (vote[(vote_idx.y + dy) * vote_size.x + vote_idx.x + dx] >= center_v) {
+							is_active = false;
+							break;
+						}
+					}
+				}
+			}
+			active[(y - y_begin) * world_width + x] = is_active ? 1 : 0;
+		}
+	}
+}
+
+// Scalar
+
+static void max2Scalar(u32* dst, const u32* a, const u32* b, int n) {
+	for (int i = 0; i < n; ++i)
+		dst[i] = a[i] > b[i] ? a[i] : b[i];
+}
+static void max3Scalar(u32* acc, const u32* a, const u32* b, int n) {
+	for (int i = 0; i < n; ++i) {
+		u32 m = a[i] > b[i] ? a[i] : b[i];
+		acc[i] = acc[i] > m ? acc[i] : m;
+	}
+}
+static void greaterScalar(u8* out, const u32* a, const u32* b, int n) {
+	for (int i = 0; i < n; ++i)
+		out[i] = a[i] > b[i] ? 1 : 0;
+}
+
+// SIMD
+
+#if EXCLUSION_X86
+// byte i is bit i of the index, turns compare bitmasks into bool bytes. a constant table, so no thread ever fills it
+#define BYTE_FROM_BIT(b) (u64((b) & 1) | u64(((b) >> 1) & 1) << 8 | u64(((b) >> 2) & 1) << 16 | u64(((b) >> 3) & 1) << 24 | \
+	u64(((b) >> 4) & 1) << 32 | u64(((b) >> 5) & 1) << 40 | u64(((b) >> 6) & 1) << 48 | u64(((b) >> 7) & 1) << 56)
+#define BYTE_FROM_BIT4(b)  BYTE_FROM_BIT(b), BYTE_FROM_BIT((b) + 1), BYTE_FROM_BIT((b) + 2), BYTE_FROM_BIT((b) + 3)
+#define BYTE_FROM_BIT16(b) BYTE_FROM_BIT4(b), BYTE_FROM_BIT4((b) + 4), BYTE_FROM_BIT4((b) + 8), BYTE_FROM_BIT4((b) + 12)
+#define BYTE_FROM_BIT64(b) BYTE_FROM_BIT16(b), BYTE_FROM_BIT16((b) + 16), BYTE_FROM_BIT16((b) + 32), BYTE_FROM_BIT16((b) + 48)
+static const u64 byte_from_bit[256] = { BYTE_FROM_BIT64(0), BYTE_FROM_BIT64(64), BYTE_FROM_BIT64(128), BYTE_FROM_BIT64(192) };
+#undef BYTE_FROM_BIT64
+#undef BYTE_FROM_BIT16
+#undef BYTE_FROM_BIT4
+#undef BYTE_FROM_BIT
+
+TARGET_AVX2 static void max2Avx2(u32* dst, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_max_epu32(va, vb));
+	}
+	max2Scalar(dst + i, a + i, b + i, n - i);
+}
+TARGET_AVX2 static void max3Avx2(u32* acc, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		__m256i vc = _mm256_loadu_si256((const __m256i*)(acc + i));
+		_mm256_storeu_si256((__m256i*)(acc + i), _mm256_max_epu32(vc, _mm256_max_epu32(va, vb)));
+	}
+	max3Scalar(acc + i, a + i, b + i, n - i);
+}
+TARGET_AVX2 static void greaterAvx2(u8* out, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		// no unsigned compare in avx2: a <= b exactly when max(a, b) == b
+		__m256i le = _mm256_cmpeq_epi32(_mm256_max_epu32(va, vb), vb);
+		int bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(le)) & 0xff;
+		memcpy(out + i, &byte_from_bit[bits], 8);
+	}
+	greaterScalar(out + i, a + i, b + i, n - i);
+}
+
+// gcc 12 warns '__Y' may be used uninitialized inside avx512fintrin.h's own helpers, a false positive
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+TARGET_AVX512 static void max2Avx512(u32* dst, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void*)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void*)(b + i));
+		_mm512_storeu_si512((void*)(dst + i), _mm512_max_epu32(va, vb));
+	}
+	max2Scalar(dst + i, a + i, b + i, n - i);
+}
+TARGET_AVX512 static void max3Avx512(u32* acc, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void*)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void*)(b + i));
+		__m512i vc = _mm512_loadu_si512((const void*)(acc + i));
+		_mm512_storeu_si512((void*)(acc + i), _mm512_max_epu32(vc, _mm512_max_epu32(va, vb)));
+	}
+	max3Scalar(acc + i, a + i, b + i, n - i);
+}
+TARGET_AVX512 static void greaterAvx512(u8* out, const u32* a, const u32* b, int n) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void*)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void*)(b + i));
+		unsigned bits = _mm512_cmpgt_epu32_mask(va, vb);
+		memcpy(out + i,     &byte_from_bit[bits & 0xff], 8);
+		memcpy(out + i + 8, &byte_from_bit[bits >> 8], 8);
+	}
+	greaterScalar(out + i, a + i, b + i, n - i);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static bool cpuHas(ExclusionKernel kernel) {
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 1);
+	bool os_saves_ymm = (regs[2] & (1 << 27)) && (_xgetbv(0) & 0x06) == 0x06; // osxsave, and the os saves xmm+ymm
+	if (!os_saves_ymm) return false;
+	__cpuidex(regs, 7, 0);
+	if (kernel == ExclusionKernel_avx2) return (regs[1] & (1 << 5)) != 0;
+	if (kernel == ExclusionKernel_avx512) return (regs[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xe6) == 0xe6; // and opmask+zmm state
+	return false;
+#else
+	__builtin_cpu_init();
+	if (kernel == ExclusionKernel_avx2) return __builtin_cpu_supports("avx2");
+	if (kernel == ExclusionKernel_avx512) return __builtin_cpu_supports("avx512f");
+	return false;
+#endif
+}
+#endif
+
+static ExclusionOps opsFor(ExclusionKernel kernel) {
+	ExclusionOps ops = { max2Scalar, max3Scalar, greaterScalar };
+#if EXCLUSION_X86
+	if (kernel == ExclusionKernel_avx2) {
+		ops.max2 = max2Avx2; ops.max3 = max3Avx2; ops.greater = greaterAvx2;
+	} else if (kernel == ExclusionKernel_avx512) {
+		ops.max2 = max2Avx512; ops.max3 = max3Avx512; ops.greater = greaterAvx512;
+	}
+#endif
+	return ops;
+}
+
+bool exclusionKernelSupported(ExclusionKernel kernel) {
+	if (kernel == ExclusionKernel_reference || kernel == ExclusionKernel_scalar) return true;
+#if EXCLUSION_X86
+	return cpuHas(kernel);
+#else
+	return false;
+#endif
+}
+static ExclusionKernel pickBestKernel() {
+	ExclusionKernel best = ExclusionKernel_scalar;
+	if (exclusionKernelSupported(ExclusionKernel_avx2))   best = ExclusionKernel_avx2;
+	if (exclusionKernelSupported(ExclusionKernel_avx512)) best = ExclusionKernel_avx512;
+	logInfo("EXCLUSION", "Using the %s kernel", exclusionKernelName(best));
+	return best;
+}
+ExclusionKernel exclusionBestKernel() {
+	static ExclusionKernel best = pickBestKernel(); // initialized once, even when the first calls come from several threads
+	return best;
+}
+const char* exclusionKernelName(ExclusionKernel kernel) {
+	switch (kernel) {
+		case ExclusionKernel_reference: return "reference";
+		case ExclusionKernel_scalar:    return "scalar";
+		case ExclusionKernel_avx2:      return "avx2";
+		case ExclusionKernel_avx512:    return "avx512";
+		default:                        return "unknown";
+	}
+}
+
+// Row algorithm
+
+// table[k][c] = max(vote[c .. c + 2^k - 1]) for one vote row
+static void buildTables(const ExclusionOps& ops, const u32* vote_row, int width, u32* tables) {
+	int stride = width + TABLE_PAD;
+	memcpy(tables, vote_row, width * sizeof(u32));
+	memset(tables + width, 0, TABLE_PAD * sizeof(u32));
+	for (int k = 1; k < LEVELS; ++k) {
+		u32* dst = tables + k * stride;
+		const u32* src = tables + (k - 1) * stride;
+		int half = 1 << (k - 1);
+		ops.max2(dst, src, src + half, width);
+		memset(dst + width, 0, TABLE_PAD * sizeof(u32));
+	}
+}
+
+// biggest k with 2^k <= width
+static int tableLevel(int width) {
+	int k = 0;
+	while ((2 << k) <= width) ++k;
+	return k;
+}
+
+void exclusionComputeMask(ExclusionKernel kernel, const u32* vote, ivec2 vote_size, int radius, int y_begin, int y_end, u8* active) {
+	radius = radius < 0 ? 0 : radius > R ? R : radius;
+	if (kernel == ExclusionKernel_reference || !exclusionKernelSupported(kernel)) {
+		computeMaskReference(vote, vote_size, radius, y_begin, y_end, active);
+		return;
+	}
+	if (y_end <= y_begin) return;
+	int world_width = vote_size.x - R*2;
+	if (radius == 0) { // no other vote to beat
+		memset(active, 1, size_t(y_end - y_begin) * world_width);
+		return;
+	}
+	ExclusionOps ops = opsFor(kernel);
+	int rows = radius*2 + 1;
+	int stride = vote_size.x + TABLE_PAD;
+	int slot_size = stride * LEVELS;
+
+	// a ring of tables for the vote rows around the current site row, plus the running neighborhood max
+	u32* ring = (u32*)malloc(sizeof(u32) * (size_t(slot_size) * rows + world_width));
+	u32* acc = ring + size_t(slot_size) * rows;
+	#define TABLE(vote_y, k) (ring + size_t((vote_y) % rows) * slot_size + (k) * stride)
+
+	for (int vy = y_begin + R - radius; vy < y_begin + R + radius; ++vy)
+		buildTables(ops, vote + size_t(vy) * vote_size.x, vote_size.x, TABLE(vy, 0));
+
+	int center_k = tableLevel(radius);
+	int center_w = 1 << center_k;
+	for (int y = y_begin; y < y_end; ++y) {
+		int cy = y + R; // center vote row
+		int vy = cy + radius; // only new row needed for this site row
+		buildTables(ops, vote + size_t(vy) * vote_size.x, vote_size.x, TABLE(vy, 0));
+
+		// the center row, without the center itself: [cx-radius, cx-1] and [cx+1, cx+radius], a piece from each end
+		// of both, which is one piece each when the radius is a power of two (like the full 8)
+		// site x has its center vote at column x + R, so table entries are addressed relative to x
+		const u32* center = TABLE(cy, center_k);
+		if (center_w == radius) {
+			ops.max2(acc, center + R - radius, center + R + 1, world_width);
+		} else {
+			ops.max2(acc, center + R - radius, center + R - center_w, world_width);
+			ops.max3(acc, center + R + 1, center + R + radius + 1 - center_w, world_width);
+		}
+		for (int dy = 1; dy <= radius; ++dy) {
+			int rad = radius - dy;          // horizontal reach of the diamond on this row
+			int w = rad * 2 + 1;            // span [cx-rad, cx+rad]
+			int k = tableLevel(w);          // biggest power of two that fits in the span
+			int a = R - rad;                // left aligned piece, relative to x
+			int b = R + rad + 1 - (1 << k); // right aligned piece
+			for (int side = -1; side <= 1; side += 2) {
+				const u32* t = TABLE(cy + side * dy, k);
+				ops.max3(acc, t + a, t + b, world_width);
+			}
+		}
+		ops.greater(active + size_t(y - y_begin) * world_width, TABLE(cy, 0) + R, acc, world_width);
+	}
+	#undef TABLE
+	free(ring);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "core/vec2.h"
+#include "core/basic_types.h"
+
+// CPU version of isActiveMem from staged_update_direct.comp: a site may run its event if its vote is strictly greater
+// than every other vote within the exclusion radius, twice the widest event window of the program (at most
+// EVENT_WINDOW_RADIUS*2). That guarantees that no two event windows overlap.
+// Instead of 144 compares per site, whole rows are done at once: every vote row gets a table of running maxes over
+// widths 1, 2, 4, 8 and 16, so any horizontal span of the diamond is the max of two table entries, and the neighborhood
+// max is a stack of per-row elementwise maxes. Those inner loops are SIMD, picked at runtime from the cpu's features.
+
+enum ExclusionKernel {
+	ExclusionKernel_reference, // per site loop, straight port of isActiveMem
+	ExclusionKernel_scalar,    // row algorithm, plain C
+	ExclusionKernel_avx2,
+	ExclusionKernel_avx512,
+	ExclusionKernel_count
+};
+
+ExclusionKernel exclusionBestKernel(); // fastest one this cpu supports
+bool exclusionKernelSupported(ExclusionKernel kernel);
+const char* exclusionKernelName(ExclusionKernel kernel);
+
+// vote is the padded vote map (world size + EVENT_WINDOW_RADIUS*2 on each side, like img_vote), vote_size is its size.
+// radius is the exclusion radius, from 0 to EVENT_WINDOW_RADIUS*2 (see NativeModule::exclusion_radius).
+// Writes active[(y - y_begin) * world_size.x + x] = 1 for winning sites, 0 otherwise, for site rows [y_begin, y_end).
+// Rows are independent, so bands of rows can be computed on different threads.
+void exclusionComputeMask(ExclusionKernel kernel, const u32* vote, ivec2 vote_size, int radius, int y_begin, int y_end, u8* active);
@@ -0,0 +1,591 @@
+#include "snapshot.h"
+#include "native.h"
+#include "splat_compiler.h"
+#include "core/log.h"
+#include "core/jobs.h"
+#include "core/cpu_timer.h"
+#include "core/file_stat.h"
+#include "shaders/cpu_gpu_shared.inl" // for the atom type layout
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+static u64 alignUp(u64 offset) {
+	return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+namespace {
+
+// a section to write: up to 4 pieces of memory back to back
+struct SectionSource {
+	const void* ptr[4];
+	u64 bytes[4];
+};
+
+// a data member that moved: where its bits were in the saved atom, and where they go now
+struct FieldMove {
+	u32 src_component, src_shift;
+	u32 dst_component, dst_shift;
+	u32 mask;
+};
+
+struct ElementRemap {
+	u32 new_type;
+	bool repack;    // its fields moved, so more than the type id changes
+	int move_first; // its FieldMoves. fields it has now that have none start at 0
+	int move_count;
+};
+
+struct TypeRemap {
+	NativeWorld* world;
+	const ElementRemap* elements; // indexed by the saved type id
+	u32 count;
+	const FieldMove* moves;
+	u32 keep[4]; // the hidden type and ECC bits, all that's kept of an atom that gets repacked
+};
+
+struct ParallelCopy {
+	u8* dst;
+	const u8* src;
+	u64 bytes;
+};
+
+};
+
+// everything that goes into a snapshot file, either pointing into the world or into copies of its maps
+struct SnapshotStage {
+	SnapshotHeader header;
+	SectionSource sources[SnapshotSection_count];
+	Bunch<SnapshotElement> elements;
+	Bunch<SnapshotField> fields;
+	SnapshotSchedule schedule;
+	Bunch<u32> site_bits, prng_state, event_count, tile_sched_state; // copies, only used by SnapshotWriter
+	Bunch<u8> tile_occupied, tile_halo;
+	char pathfile[256];
+	u64 seq;
+};
+
+#define SNAPSHOT_COPY_CHUNK (1 << 20)
+static void copyChunkJob(void* data, int i) {
+	ParallelCopy* c = (ParallelCopy*)data;
+	u64 begin = u64(i) * SNAPSHOT_COPY_CHUNK;
+	memcpy(c->dst + begin, c->src + begin, size_t(min(u64(SNAPSHOT_COPY_CHUNK), c->bytes - begin)));
+}
+template<typename T>
+static const void* copyMap(Bunch<T>* dst, const Bunch<T>& src) {
+	dst->setgarbage(src.count);
+	ParallelCopy c = { (u8*)dst->ptr, (const u8*)src.ptr, u64(src.bytes()) };
+	if (c.bytes)
+		jobsParallelFor(int((c.bytes + SNAPSHOT_COPY_CHUNK - 1) / SNAPSHOT_COPY_CHUNK), copyChunkJob, &c);
+	return dst->ptr;
+}
+
+void snapshotElementTable(const ProgramInfo* info, Bunch<SnapshotElement>* elements, Bunch<SnapshotField>* fields) {
+	elements->clear();
+	fields->clear();
+	for (int i = 0; i < info->elems.count; ++i) {
+		const ElementInfo& elem = info->elems[i];
+		SnapshotElement& e = elements->push();
+		memset(&e, 0, sizeof(e));
+		e.name_len = u32(min(elem.name.len, size_t(SNAPSHOT_NAME_MAX)));
+		memcpy(e.name, elem.name.str, e.name_len);
+		for (int d = 0; d < elem.data.count; ++d) {
+			const DataField& data = elem.data[d];
+			if (data.internal || data.global_offset == NO_OFFSET) continue;
+			SnapshotField& f = fields->push();
+			memset(&f, 0, sizeof(f));
+			f.name_len = u32(min(data.name.len, size_t(SNAPSHOT_NAME_MAX)));
+			memcpy(f.name, data.name.str, f.name_len);
+			f.global_offset = data.global_offset;
+			f.bitsize = data.bitsize;
+			e.field_count += 1;
+		}
+	}
+}
+
+// fills in the header and the sections of 'world', copying its maps into the stage if 'copy' is set
+static void stageWorld(SnapshotStage* stage, const NativeWorld* world, const ProgramInfo* info, bool copy) {
+	snapshotElementTable(info, &stage->elements, &stage->fields);
+	SnapshotSchedule& schedule = stage->schedule;
+	memset(&schedule, 0, sizeof(schedule));
+	memcpy(schedule.sched_state, world->sched_state, sizeof(schedule.sched_state));
+	schedule.tile_size = world->tile_size;
+	schedule.tile_count_x = world->tile_count.x;
+	schedule.tile_count_y = world->tile_count.y;
+
+	SectionSource* sources = stage->sources;
+	memset(sources, 0, sizeof(stage->sources));
+	sources[SnapshotSection_site_bits].ptr[0] = copy ? copyMap(&stage->site_bits, world->site_bits.data) : world->site_bits.data.ptr;
+	sources[SnapshotSection_site_bits].bytes[0] = world->site_bits.data.bytes();
+	sources[SnapshotSection_prng_state].ptr[0] = copy ? copyMap(&stage->prng_state, world->prng_state.data) : world->prng_state.data.ptr;
+	sources[SnapshotSection_prng_state].bytes[0] = world->prng_state.data.bytes();
+	sources[SnapshotSection_event_count].ptr[0] = copy ? copyMap(&stage->event_count, world->event_count.data) : world->event_count.data.ptr;
+	sources[SnapshotSection_event_count].bytes[0] = world->event_count.data.bytes();
+	sources[SnapshotSection_elements].ptr[0] = stage->elements.ptr;
+	sources[SnapshotSection_elements].bytes[0] = stage->elements.bytes();
+	sources[SnapshotSection_fields].ptr[0] = stage->fields.ptr;
+	sources[SnapshotSection_fields].bytes[0] = stage->fields.bytes();
+	SectionSource& sched = sources[SnapshotSection_schedule];
+	sched.ptr[0] = &schedule;
+	sched.ptr[1] = copy ? copyMap(&stage->tile_sched_state, world->tile_sched_state) : world->tile_sched_state.ptr;
+	sched.ptr[2] = copy ? copyMap(&stage->tile_occupied, world->tile_occupied) : world->tile_occupied.ptr;
+	sched.ptr[3] = copy ? copyMap(&stage->tile_halo, world->tile_halo) : world->tile_halo.ptr;
+	sched.bytes[0] = sizeof(schedule);
+	sched.bytes[1] = world->tile_sched_state.bytes();
+	sched.bytes[2] = world->tile_occupied.bytes();
+	sched.bytes[3] = world->tile_halo.bytes();
+
+	SnapshotHeader& header = stage->header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.header_bytes = sizeof(SnapshotHeader);
+	header.size_x = world->size.x;
+	header.size_y = world->size.y;
+	header.prng_size_x = world->prng_state.size.x;
+	header.prng_size_y = world->prng_state.size.y;
+	header.dispatch_counter = world->dispatch_counter;
+	header.seed = world->seed;
+	header.events_since_reset = world->events_since_reset;
+	header.live_events_since_reset = world->live_events_since_reset;
+	header.element_count = u32(stage->elements.count);
+	header.field_count = u32(stage->fields.count);
+	header.section_count = SnapshotSection_count;
+	u64 offset = sizeof(SnapshotHeader);
+	for (int s = 0; s < SnapshotSection_count; ++s) {
+		header.sections[s].kind = u32(s);
+		for (int p = 0; p < 4; ++p)
+			header.sections[s].bytes += sources[s].bytes[p];
+		if (header.sections[s].bytes == 0) continue;
+		offset = alignUp(offset);
+		header.sections[s].offset = offset;
+		offset += header.sections[s].bytes;
+	}
+}
+
+static bool writeStage(const SnapshotStage* stage, const char* pathfile, s64 time_start) {
+	const SnapshotHeader& header = stage->header;
+	FILE* f = fopen(pathfile, "wb");
+	if (!f) {
+		logError("SNAPSHOT", 0, "Couldn't open '%s' for writing", pathfile);
+		return false;
+	}
+	static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	u64 written = sizeof(header);
+	for (int s = 0; s < SnapshotSection_count && ok; ++s) {
+		if (header.sections[s].bytes == 0) continue;
+		ok &= fwrite(zeros, 1, size_t(header.sections[s].offset - written), f) == size_t(header.sections[s].offset - written);
+		for (int p = 0; p < 4 && ok; ++p)
+			if (stage->sources[s].bytes[p])
+				ok &= fwrite(stage->sources[s].ptr[p], size_t(stage->sources[s].bytes[p]), 1, f) == 1;
+		written = header.sections[s].offset + header.sections[s].bytes;
+	}
+	ok &= fclose(f) == 0;
+	if (!ok) {
+		logError("SNAPSHOT", 0, "Couldn't write all of '%s'", pathfile);
+		return false;
+	}
+	logInfo("SNAPSHOT", "Saved %dx%d world at step %u to '%s', %d MiB in %.2f sec", header.size_x, header.size_y, header.dispatch_counter,
+		pathfile, int(written / (1024 * 1024)), time_to_sec(time_counter() - time_start));
+	return true;
+}
+
+bool snapshotSave(const char* pathfile, const NativeWorld* world, const ProgramInfo* info) {
+	if (world->size == ivec2(0,0)) {
+		logError("SNAPSHOT", 0, "Nothing to save to '%s', the world is empty", pathfile);
+		return false;
+	}
+	s64 time_start = time_counter();
+	SnapshotStage stage;
+	stageWorld(&stage, world, info, false);
+	return writeStage(&stage, pathfile, time_start);
+}
+
+static bool readHeader(FILE* f, const char* pathfile, SnapshotHeader* header) {
+	u64 file_bytes = fileSize(f);
+	fileSeek(f, 0);
+	if (fread(header, sizeof(*header), 1, f) != 1 || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+		logError("SNAPSHOT", 0, "'%s' is not a snapshot", pathfile);
+		return false;
+	}
+	if (header->version != SNAPSHOT_VERSION || header->header_bytes != sizeof(SnapshotHeader) || header->section_count != SnapshotSection_count) {
+		logError("SNAPSHOT", 0, "'%s' is snapshot version %u, only version %u is supported", pathfile, header->version, SNAPSHOT_VERSION);
+		return false;
+	}
+	if (header->size_x <= 0 || header->size_y <= 0) {
+		logError("SNAPSHOT", 0, "'%s' has a bad world size %dx%d", pathfile, header->size_x, header->size_y);
+		return false;
+	}
+	for (int s = 0; s < SnapshotSection_count; ++s) {
+		const SnapshotSection& section = header->sections[s];
+		if (section.bytes && (section.offset < sizeof(SnapshotHeader) || section.offset + section.bytes > file_bytes)) {
+			logError("SNAPSHOT", 0, "'%s' is truncated", pathfile);
+			return false;
+		}
+	}
+	return true;
+}
+bool snapshotReadHeader(const char* pathfile, SnapshotHeader* header) {
+	FILE* f = fopen(pathfile, "rb");
+	if (!f) {
+		logError("SNAPSHOT", 0, "Couldn't open '%s'", pathfile);
+		return false;
+	}
+	bool ok = readHeader(f, pathfile, header);
+	fclose(f);
+	return ok;
+}
+
+static bool readSection(FILE* f, const SnapshotSection& section, void* dst, u64 bytes) {
+	return fileSeek(f, section.offset) && fread(dst, size_t(bytes), 1, f) == 1;
+}
+static void typeRemapJob(void* data, int y) {
+	TypeRemap* remap = (TypeRemap*)data;
+	NativeWorld* w = remap->world;
+	u32* site = w->site_bits.data.ptr + size_t(y) * w->size.x * 4;
+	for (int x = 0; x < w->size.x; ++x, site += 4) {
+		u32 type = (site[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK;
+		if (type >= remap->count) continue; // not one of ours, leave it alone
+		const ElementRemap& e = remap->elements[type];
+		if (e.new_type == type && !e.repack) continue;
+		if (e.new_type == 1) { // the element is gone, an Empty is all zeros apart from the type
+			memset(site, 0, 4 * sizeof(u32));
+		} else if (e.repack) {
+			u32 old[4];
+			memcpy(old, site, sizeof(old));
+			for (int c = 0; c < 4; ++c)
+				site[c] &= remap->keep[c];
+			for (int m = e.move_first; m < e.move_first + e.move_count; ++m) {
+				const FieldMove& move = remap->moves[m];
+				site[move.dst_component] |= ((old[move.src_component] >> move.src_shift) & move.mask) << move.dst_shift;
+			}
+		}
+		site[ATOM_TYPE_COMPONENT] &= ~(u32(ATOM_TYPE_BITMASK) << ATOM_TYPE_LOCAL_OFFSET);
+		site[ATOM_TYPE_COMPONENT] |= e.new_type << ATOM_TYPE_LOCAL_OFFSET;
+	}
+}
+
+static void keepBits(u32* keep, int global_offset, int bitsize) {
+	for (int b = global_offset; b < global_offset + bitsize; ++b)
+		keep[b / BITS_PER_COMPONENT] |= 1u << (b % BITS_PER_COMPONENT);
+}
+// a field of a saved table can be moved if it sits inside one component of the atom, like the accessors need it
+static bool fieldFits(const SnapshotField& f) {
+	return f.bitsize > 0 && f.bitsize <= BITS_PER_COMPONENT && f.global_offset >= 0 && f.global_offset + f.bitsize <= ATOM_BITS &&
+		f.global_offset / BITS_PER_COMPONENT == (f.global_offset + f.bitsize - 1) / BITS_PER_COMPONENT;
+}
+template<typename T>
+static StringRange tableName(const T& entry) {
+	return StringRange(entry.name, min(entry.name_len, u32(SNAPSHOT_NAME_MAX)));
+}
+static bool sameField(const SnapshotField& a, const SnapshotField& b) {
+	return a.global_offset == b.global_offset && a.bitsize == b.bitsize && tableName(a) == tableName(b);
+}
+
+bool snapshotLoad(const char* pathfile, NativeWorld* world, const ProgramInfo* info) {
+	const NativeModule* module = nativeModule();
+	if (!module) {
+		logError("SNAPSHOT", 0, "Can't load '%s' without a native module", pathfile);
+		return false;
+	}
+	s64 time_start = time_counter();
+	FILE* f = fopen(pathfile, "rb");
+	if (!f) {
+		logError("SNAPSHOT", 0, "Couldn't open '%s'", pathfile);
+		return false;
+	}
+	SnapshotHeader header;
+	if (!readHeader(f, pathfile, &header)) {
+		fclose(f);
+		return false;
+	}
+	ivec2 size = ivec2(header.size_x, header.size_y);
+	const SnapshotSection* sections = header.sections;
+	if (sections[SnapshotSection_site_bits].bytes != u64(size.x) * size.y * 4 * sizeof(u32) ||
+		(sections[SnapshotSection_event_count].bytes && sections[SnapshotSection_event_count].bytes != u64(size.x) * size.y * sizeof(u32))) {
+		logError("SNAPSHOT", 0, "'%s' has maps that don't match its %dx%d size", pathfile, size.x, size.y);
+		fclose(f);
+		return false;
+	}
+
+	// a regular reset first, so everything the snapshot doesn't have (prng state of a counter prng world, tile state of a
+	// different tile size) is set up like after any other reset
+	world->seed = header.seed;
+	world->resize(size);
+	world->reset();
+
+	bool ok = readSection(f, sections[SnapshotSection_site_bits], world->site_bits.data.ptr, sections[SnapshotSection_site_bits].bytes);
+	if (sections[SnapshotSection_event_count].bytes)
+		ok &= readSection(f, sections[SnapshotSection_event_count], world->event_count.data.ptr, sections[SnapshotSection_event_count].bytes);
+	const SnapshotSection& prng = sections[SnapshotSection_prng_state];
+	if (prng.bytes && prng.bytes == u64(world->prng_state.data.bytes()))
+		ok &= readSection(f, prng, world->prng_state.data.ptr, prng.bytes);
+	else if (prng.bytes || world->prng_state.data.bytes())
+		logInfo("SNAPSHOT", "'%s' was saved with a different prng mode, the prng state starts fresh", pathfile);
+
+	// move every atom to the current type id of its element, and its fields to where the element keeps them now
+	Bunch<SnapshotElement> elements;
+	Bunch<SnapshotField> fields;
+	elements.setgarbage(header.element_count);
+	fields.setgarbage(header.field_count);
+	u64 field_total = 0;
+	if (ok && sections[SnapshotSection_elements].bytes == u64(elements.bytes()) && sections[SnapshotSection_fields].bytes == u64(fields.bytes())) {
+		if (elements.count)
+			ok &= readSection(f, sections[SnapshotSection_elements], elements.ptr, elements.bytes());
+		if (fields.count)
+			ok &= readSection(f, sections[SnapshotSection_fields], fields.ptr, fields.bytes());
+		for (int i = 0; i < elements.count && ok; ++i)
+			field_total += elements[i].field_count;
+	}
+	if (ok && (sections[SnapshotSection_elements].bytes != u64(elements.bytes()) || field_total != u64(fields.count))) {
+		logError("SNAPSHOT", 0, "'%s' has an element table that doesn't add up", pathfile);
+		ok = false;
+	}
+	if (ok && elements.count) {
+		Bunch<SnapshotElement> cur_elements;
+		Bunch<SnapshotField> cur_fields;
+		snapshotElementTable(info, &cur_elements, &cur_fields);
+		Bunch<int> cur_first;
+		cur_first.setgarbage(cur_elements.count);
+		for (int j = 0, first = 0; j < cur_elements.count; first += int(cur_elements[j].field_count), ++j)
+			cur_first[j] = first;
+
+		Bunch<ElementRemap> remaps;
+		Bunch<FieldMove> moves;
+		bool ids_changed = false;
+		int lost = 0, repacked = 0, fields_new = 0, fields_gone = 0;
+		const SnapshotField* saved = fields.ptr;
+		for (int i = 0; i < elements.count; saved += elements[i].field_count, ++i) {
+			ElementRemap& r = remaps.push();
+			r.new_type = 1; // Empty
+			r.repack = false;
+			r.move_first = int(moves.count);
+			r.move_count = 0;
+			StringRange name = tableName(elements[i]);
+			for (int j = 0; j < info->elems.count; ++j)
+				if (name == info->elems[j].name)
+					r.new_type = u32(j);
+			ids_changed |= r.new_type != u32(i);
+			if (r.new_type == 1 && i != 1) {
+				lost += 1;
+				continue;
+			}
+			int saved_count = int(elements[i].field_count);
+			int cur_count = r.new_type < u32(cur_elements.count) ? int(cur_elements[r.new_type].field_count) : 0;
+			const SnapshotField* cur = cur_fields.ptr + (r.new_type < u32(cur_first.count) ? cur_first[r.new_type] : 0);
+			r.repack = saved_count != cur_count;
+			for (int k = 0; k < cur_count && !r.repack; ++k)
+				r.repack = !sameField(saved[k], cur[k]);
+			if (!r.repack) continue;
+
+			// same name and size moves over, anything else starts at 0
+			repacked += 1;
+			for (int k = 0; k < cur_count; ++k) {
+				StringRange field_name = tableName(cur[k]);
+				int from = -1;
+				for (int s = 0; s < saved_count; ++s)
+					if (field_name == tableName(saved[s]))
+						from = s;
+				if (from < 0 || saved[from].bitsize != cur[k].bitsize || !fieldFits(saved[from]) || !fieldFits(cur[k])) {
+					fields_new += 1;
+					continue;
+				}
+				FieldMove& move = moves.push();
+				move.src_component = u32(saved[from].global_offset / BITS_PER_COMPONENT);
+				move.src_shift = u32(saved[from].global_offset % BITS_PER_COMPONENT);
+				move.dst_component = u32(cur[k].global_offset / BITS_PER_COMPONENT);
+				move.dst_shift = u32(cur[k].global_offset % BITS_PER_COMPONENT);
+				move.mask = maskBits(cur[k].bitsize);
+			}
+			for (int s = 0; s < saved_count; ++s) {
+				bool kept = false;
+				for (int k = 0; k < cur_count; ++k)
+					kept |= tableName(saved[s]) == tableName(cur[k]);
+				fields_gone += kept ? 0 : 1;
+			}
+			r.move_count = int(moves.count) - r.move_first;
+		}
+		if (ids_changed || repacked) {
+			TypeRemap remap;
+			memset(&remap, 0, sizeof(remap));
+			remap.world = world;
+			remap.elements = remaps.ptr;
+			remap.count = u32(remaps.count);
+			remap.moves = moves.ptr;
+			keepBits(remap.keep, ATOM_TYPE_GLOBAL_OFFSET, ATOM_TYPE_BITSIZE);
+			keepBits(remap.keep, ATOM_ECC_GLOBAL_OFFSET, ATOM_ECC_BITSIZE);
+			jobsParallelFor(size.y, typeRemapJob, &remap);
+		}
+		if (ids_changed)
+			logInfo("SNAPSHOT", "Element type ids changed since '%s' was saved, moved the atoms over (%d elements no longer exist)", pathfile, lost);
+		if (repacked)
+			logInfo("SNAPSHOT", "%d elements keep their data members elsewhere since '%s' was saved, moved them over (%d members start at 0, %d no longer exist)",
+				repacked, pathfile, fields_new, fields_gone);
+	}
+
+	// the scheduler state only fits if the tiles are the same, otherwise the tiles are rescanned
+	const SnapshotSection& sched = sections[SnapshotSection_schedule];
+	SnapshotSchedule schedule;
+	bool sched_restored = false;
+	if (ok && sched.bytes >= sizeof(schedule) && readSection(f, sched, &schedule, sizeof(schedule))) {
+		memcpy(world->sched_state, schedule.sched_state, sizeof(world->sched_state));
+		if (schedule.tile_size == world->tile_size && ivec2(schedule.tile_count_x, schedule.tile_count_y) == world->tile_count &&
+			sched.bytes == sizeof(schedule) + world->tile_sched_state.bytes() + world->tile_occupied.bytes() + world->tile_halo.bytes()) {
+			sched_restored = fread(world->tile_sched_state.ptr, size_t(world->tile_sched_state.bytes()), 1, f) == 1 &&
+				fread(world->tile_occupied.ptr, size_t(world->tile_occupied.bytes()), 1, f) == 1 &&
+				fread(world->tile_halo.ptr, size_t(world->tile_halo.bytes()), 1, f) == 1;
+		}
+	}
+	fclose(f);
+	if (!ok) {
+		logError("SNAPSHOT", 0, "Couldn't read all of '%s'", pathfile);
+		world->reset();
+		return false;
+	}
+	if (sched_restored) {
+		world->occupied_tiles = 0;
+		for (int i = 0; i < world->tile_occupied.count; ++i)
+			world->occupied_tiles += world->tile_occupied[i];
+		world->recountTypes();
+	} else {
+		world->rescanTiles();
+	}
+
+	world->dispatch_counter = header.dispatch_counter;
+	world->events_since_reset = header.events_since_reset;
+	world->live_events_since_reset = header.live_events_since_reset;
+	logInfo("SNAPSHOT", "Loaded %dx%d world at step %u from '%s' in %.2f sec", size.x, size.y, header.dispatch_counter, pathfile, time_to_sec(time_counter() - time_start));
+	return true;
+}
+
+//-----------------------------------------//
+//          Background snapshots           //
+//-----------------------------------------//
+
+enum SlotState {
+	SlotState_free,
+	SlotState_filling, // take() is copying into it
+	SlotState_queued,
+	SlotState_writing,
+};
+
+struct SnapshotWriterState {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv; // signals queued slots to the thread, and free slots back to take()
+	SnapshotStage slots[2];
+	SlotState slot_state[2] = { SlotState_free, SlotState_free };
+	s64 slot_time[2] = {};
+	u64 seq_next = 0;
+	bool quit = false;
+	std::atomic<int> failed;
+	s64 waited = 0;
+};
+
+static void snapshotWriterThread(SnapshotWriterState* w) {
+	std::unique_lock<std::mutex> lock(w->mutex);
+	for (;;) {
+		// oldest queued slot first, so checkpoints land on disk in order
+		int next = -1;
+		for (int i = 0; i < 2; ++i)
+			if (w->slot_state[i] == SlotState_queued && (next < 0 || w->slots[i].seq < w->slots[next].seq))
+				next = i;
+		if (next < 0) {
+			if (w->quit) break;
+			w->cv.wait(lock);
+			continue;
+		}
+		w->slot_state[next] = SlotState_writing;
+		lock.unlock();
+		if (!writeStage(&w->slots[next], w->slots[next].pathfile, w->slot_time[next]))
+			w->failed += 1;
+		lock.lock();
+		w->slot_state[next] = SlotState_free;
+		w->cv.notify_all();
+	}
+}
+
+bool SnapshotWriter::take(const char* pathfile, const NativeWorld* world, const ProgramInfo* info) {
+	if (world->size == ivec2(0,0)) {
+		logError("SNAPSHOT", 0, "Nothing to save to '%s', the world is empty", pathfile);
+		return false;
+	}
+	if (!state) {
+		state = new SnapshotWriterState;
+		state->failed = 0;
+		state->thread = std::thread(snapshotWriterThread, state);
+	}
+	s64 time_start = time_counter();
+	int slot = -1;
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		for (;;) {
+			for (int i = 0; i < 2 && slot < 0; ++i)
+				if (state->slot_state[i] == SlotState_free)
+					slot = i;
+			if (slot >= 0) break;
+			state->cv.wait(lock);
+		}
+		state->slot_state[slot] = SlotState_filling;
+	}
+	s64 time_free = time_counter();
+	if (time_free - time_start > time_frequency() / 100)
+		logInfo("SNAPSHOT", "Waited %.2f sec for the last snapshots to be written", time_to_sec(time_free - time_start));
+
+	// the thread never touches a slot that's being filled, so the copy runs without the lock
+	SnapshotStage* stage = &state->slots[slot];
+	stageWorld(stage, world, info, true);
+	snprintf(stage->pathfile, sizeof(stage->pathfile), "%s", pathfile);
+
+	std::lock_guard<std::mutex> lock(state->mutex);
+	stage->seq = state->seq_next++;
+	state->slot_state[slot] = SlotState_queued;
+	state->slot_time[slot] = time_start;
+	state->waited += time_free - time_start;
+	state->cv.notify_all();
+	return true;
+}
+void SnapshotWriter::flush() {
+	if (!state) return;
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while (state->slot_state[0] != SlotState_free || state->slot_state[1] != SlotState_free)
+		state->cv.wait(lock);
+}
+void SnapshotWriter::destroy() {
+	if (!state) return;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->quit = true; // the thread still writes what's queued before it stops
+		state->cv.notify_all();
+	}
+	state->thread.join();
+	delete state;
+	state = NULL;
+}
+int SnapshotWriter::pending() const {
+	if (!state) return 0;
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return int(state->slot_state[0] != SlotState_free) + int(state->slot_state[1] != SlotState_free);
+}
+int SnapshotWriter::failed() const {
+	return state ? state->failed.load() : 0;
+}
+float SnapshotWriter::waitedSec() const {
+	return state ? float(time_to_sec(state->waited)) : 0.0f;
+}
+
+void CheckpointSchedule::restart() {
+	last_time = time_counter();
+}
+bool CheckpointSchedule::due(u32 step) {
+	s64 now = time_counter();
+	bool due_steps = every_steps > 0 && step % u32(every_steps) == 0;
+	bool due_minutes = every_minutes > 0.0f && time_to_sec(now - last_time) >= every_minutes * 60.0;
+	if (due_steps || due_minutes)
+		last_time = now;
+	return due_steps || due_minutes;
+}
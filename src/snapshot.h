@@ -0,0 +1,111 @@
+#pragma once
+#include "core/basic_types.h"
+#include "core/container.h"
+
+struct NativeWorld;
+struct ProgramInfo;
+
+// Versioned binary snapshot of a world: a fixed header, then one section per state map. Every section starts on a
+// SNAPSHOT_ALIGNMENT boundary and holds the map exactly as it sits in memory (and in the matching gpu image), so
+// loading is a straight read into place, and the file can just as well be mapped.
+// The element table keeps the name and the data fields of every type id, so a world saved before a code change still
+// loads after it: atoms get the new type id of their element, their fields are moved to where the element keeps them
+// now, and atoms of elements that no longer exist become Empty.
+
+#define SNAPSHOT_MAGIC "MFMSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ALIGNMENT 4096
+#define SNAPSHOT_NAME_MAX 60
+
+enum SnapshotSectionKind {
+	SnapshotSection_site_bits,   // 4 u32 per site, row major
+	SnapshotSection_prng_state,  // 4 u32 per padded site, left out for counter prng worlds
+	SnapshotSection_event_count, // 1 u32 per site
+	SnapshotSection_elements,    // one SnapshotElement per type id
+	SnapshotSection_schedule,    // SnapshotSchedule, then the per tile state, so a native world resumes bit exactly
+	SnapshotSection_fields,      // the SnapshotFields of every element, in type id order
+	SnapshotSection_count
+};
+
+struct SnapshotSection {
+	u32 kind;
+	u32 pad;
+	u64 offset; // from the start of the file
+	u64 bytes;  // 0 if the section is missing
+};
+
+struct SnapshotHeader {
+	char magic[8];
+	u32 version;
+	u32 header_bytes;
+	s32 size_x, size_y;
+	s32 prng_size_x, prng_size_y; // 0 without prng state
+	u32 dispatch_counter;
+	u32 seed;
+	s64 events_since_reset;
+	s64 live_events_since_reset;
+	u32 element_count;
+	u32 field_count;
+	u32 section_count;
+	u32 pad;
+	SnapshotSection sections[SnapshotSection_count];
+};
+
+struct SnapshotElement {
+	u32 name_len;
+	char name[SNAPSHOT_NAME_MAX];
+	u32 field_count; // its fields follow those of the elements before it in the field table
+};
+
+// a data member of an element, where it sat in the atom. The hidden type and ECC fields are left out, they never move
+struct SnapshotField {
+	u32 name_len;
+	char name[SNAPSHOT_NAME_MAX];
+	s32 global_offset;
+	s32 bitsize;
+};
+
+// the tables of 'info's elements, by type id, and of their fields, as snapshots and trajectories store them
+void snapshotElementTable(const ProgramInfo* info, Bunch<SnapshotElement>* elements, Bunch<SnapshotField>* fields);
+
+// followed by tile_sched_state (4 u32 per tile), tile_occupied (1 byte per tile) and tile_halo (9 bytes per tile)
+struct SnapshotSchedule {
+	u32 sched_state[4];
+	s32 tile_size;
+	s32 tile_count_x, tile_count_y;
+	u32 pad;
+};
+
+// 'info' is the program the world's native module was built from, for the element names
+bool snapshotSave(const char* pathfile, const NativeWorld* world, const ProgramInfo* info);
+// Resets 'world' at the snapshot's size with the loaded native module, then overwrites it with the snapshot.
+bool snapshotLoad(const char* pathfile, NativeWorld* world, const ProgramInfo* info);
+// just the header, eg. to get the size before loading
+bool snapshotReadHeader(const char* pathfile, SnapshotHeader* header);
+
+// Saves snapshots on a background thread, so stepping only pays for a copy of the world. take() copies the maps into one
+// of two staging slots at a step boundary and returns, the thread writes the slot out while stepping goes on. When both
+// slots are still waiting for the disk, take() waits for the older one (back-pressure), so a slow disk slows the stepping
+// down instead of piling up copies. The slots keep their memory between takes, twice the size of the world's state.
+struct SnapshotWriterState;
+struct SnapshotWriter {
+	SnapshotWriterState* state = 0;
+
+	bool take(const char* pathfile, const NativeWorld* world, const ProgramInfo* info);
+	void flush();   // waits until everything taken is written
+	void destroy(); // flushes, stops the thread and frees the slots
+	int pending() const; // taken but not written yet
+	int failed() const;  // writes that failed since the start
+	float waitedSec() const; // time take() spent waiting for a free slot
+};
+
+// When periodic checkpoints are due: on steps that are a multiple of every_steps, and every_minutes after the last one.
+// 0 turns either off.
+struct CheckpointSchedule {
+	int every_steps = 0;
+	float every_minutes = 0.0f;
+	s64 last_time = 0;
+
+	void restart(); // the minutes count from here
+	bool due(u32 step);
+};
@@ -1,14 +1,24 @@
 #include "splat_compiler.h"
 #include "splat_internal.h"
+#include "native.h"
 #include "core/file_stat.h"
 #include "core/log.h"
 #include "core/dir.h"
 #include "core/cpu_timer.h"
+#include "core/crc.h"
+#ifndef MFM_HEADLESS
 #include "imgui/imgui.h"
+#endif
 #include <stdlib.h> // for malloc/free
 #include <stdio.h> // for FILE
+#ifndef MFM_HEADLESS
+#include <thread>
+#include <atomic>
+#endif
 
+#ifndef MFM_HEADLESS
 #include "core/shader_loader.h" // maybe better to move this out..
+#endif
 
 namespace {
 
@@ -23,6 +33,14 @@ struct FileWatcher {
 	time_t last_modified = 0;
 	bool not_found = true;
 	String raw_text;
+
+	// parse cache, see parseFile()
+	String text;           // raw_text without '\r' plus a newline, tokens and the AST point into it
+	u32 text_crc = 0;
+	Node* ast = NULL;      // top level nodes after the section transform, NULL until the file parsed without errors
+	Node* ast_last = NULL; // linked to the next file's ast while 'root' is in use
+	NodeArena arena;       // holds the ast, released when the file parses again
+
 	void init(StringRange pathfile, StringRange project_name);
 	void checkForUpdates();
 };
@@ -38,10 +56,40 @@ static String splat_concat;
 static Bunch<StringRange> file_ranges;
 static Bunch<StringRange> file_names;
 static Errors err;
+#ifndef MFM_HEADLESS
 static bool show_errors = false;
+#endif
 static Emitter emi_decl;
 static Emitter emi_elem;
+static Bunch<EmittedElement> emit_cache[EmitTarget_count];
 static Node* root;
+static NodeArena root_arena; // just for root itself, the rest of the tree lives in the file arenas
+static bool native_enabled = false;
+static bool native_dirty = false;
+static bool counter_prng = false;
+static bool counter_prng_dirty = false;
+static bool shared_site_tests = false;
+static bool shared_site_tests_dirty = false;
+static bool emit_cache_shared_site_tests[EmitTarget_count]; // what the element code in emit_cache was emitted with
+static Bunch<char*> retired_texts; // file texts replaced by a compile, the last published ProgramInfo may still point into them
+#ifndef MFM_HEADLESS
+// Hot reloads compile on their own thread, with the last published results staying in use until the shaders built from
+// the new code are ready as well, see checkForSplatProgramChanges. While compiling, the thread owns everything the compile
+// writes (the file ASTs and texts, err, the emitters, root and the file lists), so the gui leaves those alone.
+enum CompileState {
+	CompileState_idle,
+	CompileState_compiling,
+	CompileState_waiting_for_shaders,
+};
+static CompileState compile_state = CompileState_idle;
+static std::thread compile_thread;
+static std::atomic<bool> compile_done(false);
+static ProgramInfo pending_info;
+static bool pending_file_change = false;
+static bool pending_project_change = false;
+static bool recompile_requested = false;
+static String selected_project; // applied once the compile in flight is done
+#endif
 
 void FileWatcher::init(StringRange pathfile_in, StringRange project_name_in) {
 	pathfile.set(pathfile_in);
@@ -122,38 +170,135 @@ static int getFileEntry(StringRange pathfile, StringRange project_name) {
 	return file_idx;
 }
 
-Node* compile(const char* code_start, const char* code_end, StringRange* file_ranges, int file_count, Emitter* emi_decl, Emitter* emi_elem, Errors* err, ProgramInfo* info) {
-	*info = ProgramInfo();
+static bool isProjectSource(FileWatcher& F) {
+	return !F.not_found && ((F.project_name.range() == current_project.range()) || (F.project_name.range() == StringRange("stdlib"))) && !(F.file_name == StringRange("init.gpulam"));
+}
+// Lexes, parses and section transforms one file, unless its text is the same as the last time it parsed fine.
+// Returns true if it came from the cache.
+static bool parseFile(FileWatcher* F, Errors* err, ProgramInfo* info) {
+	static String cleaned;
+	cleaned.clear();
+	cleaned.reservebytes(F->raw_text.len + 2);
+	for (const char* r = F->raw_text.str; r != (F->raw_text.str + F->raw_text.len); ++r) {
+		if (*r != '\r') {
+			cleaned.str[cleaned.len++] = *r;
+		}
+	}
+	cleaned.str[cleaned.len++] = '\n';
+	// although compiler takes start, end, the string MUST be null terminated!
+	// this is because strtol is used internally, and that uses null term to do it's thing
+	cleaned.str[cleaned.len] = 0;
+	u32 crc = crc32(0, cleaned.str, cleaned.len);
+	if (F->ast && F->text_crc == crc && F->text.len == cleaned.len)
+		return true;
 
-	info->time_to_lex = time_counter();
-	Lexer lex = Lexer(code_start, code_end, file_ranges, file_count);
+	if (F->ast) {
+		for (int i = 0; i < EmitTarget_count; ++i)
+			forgetEmittedElements(&emit_cache[i], F->ast);
+		F->ast = F->ast_last = NULL;
+	}
+	F->arena.release();
+	if (F->text.str)
+		retired_texts.push(F->text.str);
+	F->text = String();
+	F->text.set(cleaned.range());
+	F->text_crc = 0;
 
+	s64 time_start = time_counter();
+	Lexer lex = Lexer(F->text.str, F->text.str + F->text.len);
 	Token tok;
 	tok.str = "root";
 	tok.len = strlen(tok.str);
 	tok.type = Token_unknown;
-
 	Parser par;
-	Node* root = makeNode(Node_braces, tok);
+	par.arena = &F->arena;
+	Node* file_root = makeNode(&par, Node_braces, tok);
+	int64_t err_count = err->errors.count;
 	while (Node* block = parseGroups(&par, &lex, err))
-		addKid(root, block);
-	info->time_to_lex = time_counter() - info->time_to_lex;
-	
+		addKid(file_root, block);
+	info->time_to_lex += time_counter() - time_start;
+
+	// sections end at the end of their file
+	if (err->errors.count == err_count && file_root->kid) {
+		time_start = time_counter();
+		transformAST(file_root, file_root->kid, err);
+		info->time_to_parse += time_counter() - time_start;
+	}
+	if (err->errors.count == err_count && file_root->kid) {
+		F->ast = file_root->kid;
+		F->ast_last = F->ast;
+		while (F->ast_last->sib) F->ast_last = F->ast_last->sib;
+		F->text_crc = crc;
+	} else {
+		F->arena.release();
+	}
+	return false;
+}
+// Undoes the linking of the cached file ASTs under 'root', and frees it
+static void freeRoot() {
+	if (!root) return;
+	for (int i = 0; i < files.count; ++i)
+		if (files[i].ast_last)
+			files[i].ast_last->sib = NULL;
+	root_arena.release();
+	root = NULL;
+}
+// Parses the changed project and stdlib files, links their ASTs under one root and emits it, leaving the GLSL in emi_decl/emi_elem.
+static Node* compile(Emitter* emi_decl, Emitter* emi_elem, Errors* err, ProgramInfo* info) {
+	*info = ProgramInfo();
+
+	Token tok;
+	tok.str = "root";
+	tok.len = strlen(tok.str);
+	tok.type = Token_unknown;
+	Parser par;
+	par.arena = &root_arena;
+	Node* root = makeNode(&par, Node_braces, tok);
+
+	int parsed = 0;
+	int cached = 0;
+	Node* last = NULL;
+	for (int i = 0; i < files.count; ++i) {
+		FileWatcher& F = files[i];
+		if (!isProjectSource(F))
+			continue;
+		if (parseFile(&F, err, info))
+			cached += 1;
+		else
+			parsed += 1;
+		if (!F.ast)
+			continue;
+		if (last)
+			last->sib = F.ast;
+		else
+			root->kid = F.ast;
+		last = F.ast_last;
+	}
+
+	// the file texts only move when they're parsed, so the ranges are taken afterwards
+	splat_concat.clear();
+	file_ranges.clear();
+	file_names.clear();
+	for (int i = 0; i < files.count; ++i) {
+		if (isProjectSource(files[i])) {
+			file_names.push(files[i].file_name);
+			file_ranges.push(files[i].text.range());
+			splat_concat.append(files[i].text.range());
+		}
+	}
+	emi_elem->file_names = file_names.ptr;
+	emi_elem->file_ranges = file_ranges.ptr;
+	emi_elem->file_count = file_names.count;
+
 	if (err->errors.count == 0) {
-		info->time_to_parse = time_counter();
-		if (root->kid)
-			transformAST(root, root->kid, err);
-		info->time_to_parse = time_counter() - info->time_to_parse;
-
-		if (err->errors.count == 0) {
-			info->time_to_emit = time_counter();
-			if (root->kid) {
-				emitForwardDeclarationsAndTypes(emi_decl, root, err, info);
-				emitElements(emi_decl, emi_elem, root, err, info);
-			}
-			info->time_to_emit = time_counter() - info->time_to_emit;
+		info->time_to_emit = time_counter();
+		if (root->kid) {
+			emitForwardDeclarationsAndTypes(emi_decl, root, err, info);
+			emitElements(emi_decl, emi_elem, root, err, info);
 		}
+		info->time_to_emit = time_counter() - info->time_to_emit;
 	}
+	log("SPLAT: parsed %d files, %d unchanged; emitted %d elements, %d unchanged\n", parsed, cached, emi_elem->elements_emitted, emi_elem->elements_from_cache);
 	return root;
 }
 
@@ -171,18 +316,64 @@ static void setProject(StringRange name) {
 	current_project.set(name);
 	project_change = true;
 }
+#ifndef MFM_HEADLESS
 static void projectsSelectCallback(const char* pathfile, const char* name) {
 	StringRange n = StringRange(name);
 	if (gui::Selectable(name, current_project.range() == n))
-		setProject(n);
+		selected_project.set(n);
 }
-void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out, ProgramInfo* info) {
-	if (current_project.len == 0)
-		current_project.set("basic");
-	if (gui::Begin("Projects")) {
-		dirScan(PROJECTS_DIRECTORY, projectsSelectCallback);
-	} gui::End();
-
+#endif
+static void appendInitCode(String* code) {
+	code->append("\n");
+	for (int i = 0; i < files.count; ++i) {
+		if ((files[i].project_name.range() == current_project.range()) && files[i].file_name == StringRange("init.gpulam")) {
+			if (!files[i].not_found) {
+				code->append(files[i].raw_text.range());
+				return;
+			}
+		}
+	}
+	code->append("void Init(C2D c, S2D s) { return; }\n");
+}
+// The cached element code depends on the shared site tests switch, so it goes if that changed since
+static void matchEmitCache(EmitTarget target, bool use_shared_site_tests) {
+	if (emit_cache_shared_site_tests[target] == use_shared_site_tests)
+		return;
+	for (int i = 0; i < emit_cache[target].count; ++i) {
+		emit_cache[target][i].decl_code.free();
+		emit_cache[target][i].elem_code.free();
+	}
+	emit_cache[target].clear();
+	emit_cache_shared_site_tests[target] = use_shared_site_tests;
+}
+// Re-emits the current AST as C++ and hands it to the native backend.
+static bool buildNative() {
+	if (!root || err.errors.count != 0) return false;
+	Emitter native_decl;
+	Emitter native_elem;
+	native_decl.target = EmitTarget_cpp;
+	native_elem.target = EmitTarget_cpp;
+	native_decl.counter_prng = counter_prng;
+	native_decl.shared_site_tests = shared_site_tests;
+	native_elem.file_names = file_names.ptr;
+	native_elem.file_ranges = file_ranges.ptr;
+	native_elem.file_count = file_names.count;
+	native_elem.shared_site_tests = shared_site_tests;
+	native_elem.element_cache = &emit_cache[EmitTarget_cpp];
+	matchEmitCache(EmitTarget_cpp, shared_site_tests);
+	Errors native_err;
+	ProgramInfo native_info; // the glsl emit already filled in the real one
+	if (root->kid) {
+		emitForwardDeclarationsAndTypes(&native_decl, root, &native_err, &native_info);
+		emitElements(&native_decl, &native_elem, root, &native_err, &native_info);
+	}
+	appendInitCode(&native_elem.code);
+	bool ok = native_err.errors.count == 0 && nativeBuild(native_decl.code.range(), native_elem.code.range());
+	native_decl.code.free();
+	native_elem.code.free();
+	return ok;
+}
+static void scanForChanges() {
 	// watch for changes in STDLIB and in PROJECTS
 	hack_project_name = StringRange("stdlib");
 	dirScan(STDLIB_DIRECTORY, ".splat", splatCallback);
@@ -194,12 +385,60 @@ void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out
 			files[i].checkForUpdates();
 		}
 	}
-			
+}
+// Compiles the project and stdlib files, leaving the GLSL in emi_decl/emi_elem. Runs on the compile thread for hot reloads.
+static void recompile(ProgramInfo* info, bool use_counter_prng, bool use_shared_site_tests) {
+	freeRoot();
+	err = Errors();
+	emi_decl.code.free(); // Gross.
+	emi_elem.code.free();
+	emi_decl = Emitter();
+	emi_elem = Emitter();
+	emi_decl.counter_prng = use_counter_prng;
+	emi_decl.shared_site_tests = use_shared_site_tests;
+	emi_elem.shared_site_tests = use_shared_site_tests;
+	emi_elem.element_cache = &emit_cache[EmitTarget_glsl];
+	matchEmitCache(EmitTarget_glsl, use_shared_site_tests);
 
-	*file_change_out = file_change;
-	*project_change_out = project_change;
+	root = compile(&emi_decl, &emi_elem, &err, info);
+
+	appendInitCode(&emi_elem.code);
+}
+static void freeRetiredTexts() {
+	for (int i = 0; i < retired_texts.count; ++i)
+		free(retired_texts[i]);
+	retired_texts.clear();
+}
+#ifndef MFM_HEADLESS
+static void compileThread(bool use_counter_prng, bool use_shared_site_tests) {
+	recompile(&pending_info, use_counter_prng, use_shared_site_tests);
+	compile_done = true;
+}
+// Hands the results to the caller, in the frame the shaders built from them start running
+static void publishCompile(bool* file_change_out, bool* project_change_out, ProgramInfo* info) {
+	*info = ProgramInfo();
+	for (int i = 0; i < pending_info.elems.count; ++i) {
+		ElementInfo& einfo = info->elems.push();
+		einfo = pending_info.elems[i];
+	}
+	info->time_to_lex = pending_info.time_to_lex;
+	info->time_to_parse = pending_info.time_to_parse;
+	info->time_to_emit = pending_info.time_to_emit;
+	*file_change_out = pending_file_change;
+	*project_change_out = pending_project_change;
+	freeRetiredTexts();
+	compile_state = CompileState_idle;
+}
+void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out, ProgramInfo* info) {
+	if (current_project.len == 0)
+		current_project.set("basic");
+	if (gui::Begin("Projects")) {
+		dirScan(PROJECTS_DIRECTORY, projectsSelectCallback);
+	} gui::End();
 
-	bool force_recompile = false;
+	*file_change_out = false;
+	*project_change_out = false;
+	bool compiling = compile_state == CompileState_compiling;
 
 	gui::PushStyleColor(ImGuiCol_WindowBg, vec4(vec3(0.0f), 1.0f));
 	if (gui::Begin("Compiler Debug")) {
@@ -208,8 +447,16 @@ void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out
 		gui::RadioButton("output", &which, 1); gui::SameLine();
 		gui::RadioButton("ast", &which, 2);
 		gui::SameLine();
-		force_recompile = gui::Button("recompile"); gui::SameLine();
-		if (gui::Button("dump compiled code")) {
+		recompile_requested |= gui::Button("recompile"); gui::SameLine();
+		bool use_counter_prng = counter_prng;
+		if (gui::Checkbox("counter prng", &use_counter_prng))
+			setCounterPrngEnabled(use_counter_prng);
+		gui::SameLine();
+		bool use_shared_site_tests = shared_site_tests;
+		if (gui::Checkbox("shared site tests", &use_shared_site_tests))
+			setSharedSiteTestsEnabled(use_shared_site_tests);
+		gui::SameLine();
+		if (gui::Button("dump compiled code") && !compiling) {
 			FILE* f = fopen("debug_shaders/code.txt", "wb");
 			if (f) {
 				fwrite(emi_decl.code.str, emi_decl.code.len, 1, f);
@@ -219,7 +466,9 @@ void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out
 		}
 		gui::Separator();
 		gui::BeginChild("code");
-		if (which == 0) {
+		if (compiling) {
+			gui::Text("Compiling...");
+		} else if (which == 0) {
 			if (splat_concat.len)
 				gui::TextUnformatted(splat_concat.str, splat_concat.str + splat_concat.len);
 		} else if (which == 1) {
@@ -234,73 +483,106 @@ void checkForSplatProgramChanges(bool* file_change_out, bool* project_change_out
 		gui::EndChild();
 	} gui::End();
 	gui::PopStyleColor();
-	
-	if (file_change || project_change || force_recompile) {
-		splat_concat.clear();
-		file_ranges.clear();
-		file_names.clear();
-		for (int i = 0; i < files.count; ++i) {
-			if (!files[i].not_found && ((files[i].project_name.range() == current_project.range()) || (files[i].project_name.range() == StringRange("stdlib"))) && !(files[i].file_name == StringRange("init.gpulam"))) {
-				char* cleaned = (char*)malloc(files[i].raw_text.len + 1);
-				char* w = cleaned;
-				for (const char* r = files[i].raw_text.str; r != (files[i].raw_text.str + files[i].raw_text.len); ++r) {
-					if (*r != '\r') {
-						*w++ = *r;
-					}
-				}
-				// although compiler takes start, end, the string MUST be null terminated!
-				// this is because strtol is used internally, and that uses null term to do it's thing
-				*w = 0;
-				file_names.push(files[i].file_name);
-				splat_concat.append(StringRange(cleaned, w-cleaned));
-				splat_concat.append("\n");
-				// add just the length for now, and compute the pointers later after splat_concat is fully complete and no longer reallocs
-				StringRange& file_range = file_ranges.push();
-				file_range.len = w-cleaned + 1; // string + newline (can't compare pointers, since String potentially reallocs inside during append)
-			}
-		}
-		if (file_ranges.count > 0) {
-			file_ranges[0].str = splat_concat.str;
-			for (int i = 1; i < file_ranges.count; ++i) {
-				file_ranges[i].str = file_ranges[i-1].str + file_ranges[i-1].len;
-			}
+
+	bool startup = !root;
+	if (compile_state == CompileState_idle) {
+		if (selected_project.len) {
+			setProject(selected_project.range());
+			selected_project.clear();
 		}
-		err = Errors();
-		emi_decl.code.free(); // Gross.
-		emi_elem.code.free();
-		emi_decl = Emitter();
-		emi_elem = Emitter();
-		emi_elem.file_names = file_names.ptr;
-		emi_elem.file_ranges = file_ranges.ptr;
-		emi_elem.file_count = file_names.count;
-
-		if (root) freeNode(root);
-		root = compile(splat_concat.str, splat_concat.str + splat_concat.len, file_ranges.ptr, file_ranges.count, &emi_decl, &emi_elem, &err, info);
-
-		emi_elem.code.append("\n");
-		bool init_exists = false;
-		for (int i = 0; i < files.count; ++i) {
-			if ((files[i].project_name.range() == current_project.range()) && files[i].file_name == StringRange("init.gpulam")) {
-				if (!files[i].not_found) {
-					emi_elem.code.append(files[i].raw_text.range());
-					init_exists = true;
-					break;
-				}
-			}
+		scanForChanges();
+		if (file_change || project_change || recompile_requested || counter_prng_dirty || shared_site_tests_dirty) {
+			pending_file_change = file_change;
+			pending_project_change = project_change;
+			file_change = project_change = recompile_requested = counter_prng_dirty = shared_site_tests_dirty = false;
+			compile_done = false;
+			compile_state = CompileState_compiling;
+			if (startup)
+				compileThread(counter_prng, shared_site_tests); // nothing is running yet, so there's nothing to keep going in the meantime
+			else
+				compile_thread = std::thread(compileThread, counter_prng, shared_site_tests);
 		}
-		if (!init_exists)
-			emi_elem.code.append("void Init(C2D c, S2D s) { return; }\n");
-
+	}
+	if (compile_state == CompileState_compiling && compile_done) {
+		if (compile_thread.joinable())
+			compile_thread.join();
 		if (err.errors.count == 0) {
 			injectProceduralFile("shaders/atom_decls.inl", emi_decl.code.str, emi_decl.code.len);
 			injectProceduralFile("shaders/atoms.inl", emi_elem.code.str, emi_elem.code.len);
+			native_dirty = true;
+			compile_state = CompileState_waiting_for_shaders;
+			if (startup)
+				publishCompile(file_change_out, project_change_out, info); // the shaders compile later this frame, since they have no modules yet
+		} else {
+			publishCompile(file_change_out, project_change_out, info); // the old shaders keep running
 		}
-		file_change = false;
-		project_change = false;
 	}
+	if (compile_state == CompileState_waiting_for_shaders && !shadersCompiling())
+		publishCompile(file_change_out, project_change_out, info);
+
+	if (native_enabled && native_dirty && compile_state == CompileState_idle) {
+		buildNative();
+		native_dirty = false;
+	}
+}
+void splatCompilerDestroy() {
+	if (compile_thread.joinable())
+		compile_thread.join();
+}
+#endif
+bool compileSplatProject(StringRange project_name, ProgramInfo* info) {
+	setProject(project_name);
+	scanForChanges();
+	bool found = false;
+	for (int i = 0; i < files.count; ++i)
+		found |= files[i].project_name.range() == current_project.range() && !files[i].not_found;
+	if (!found) {
+		logError("SPLAT", 0, "No project '%.*s' in " PROJECTS_DIRECTORY, project_name.len, project_name.str);
+		return false;
+	}
+
+	counter_prng_dirty = shared_site_tests_dirty = false;
+	recompile(info, counter_prng, shared_site_tests);
+	freeRetiredTexts();
+	file_change = false;
+	project_change = false;
+	if (err.errors.count != 0) {
+		logErrors(&err, file_names.ptr, file_ranges.ptr, file_ranges.count);
+		return false;
+	}
+	logInfo("SPLAT", "Compiled '%.*s': %d elements, lex %.3f sec, parse %.3f sec, emit %.3f sec", project_name.len, project_name.str, info->elems.count,
+		time_to_sec(info->time_to_lex), time_to_sec(info->time_to_parse), time_to_sec(info->time_to_emit));
+
+	native_dirty = false;
+	return !native_enabled || buildNative();
+}
+
+void setNativeBackendEnabled(bool enabled) {
+	native_dirty |= enabled && !native_enabled;
+	native_enabled = enabled;
+}
+bool getNativeBackendEnabled() {
+	return native_enabled;
+}
+void setCounterPrngEnabled(bool enabled) {
+	counter_prng_dirty |= enabled != counter_prng;
+	counter_prng = enabled;
+}
+bool getCounterPrngEnabled() {
+	return counter_prng;
+}
+void setSharedSiteTestsEnabled(bool enabled) {
+	shared_site_tests_dirty |= enabled != shared_site_tests;
+	shared_site_tests = enabled;
+}
+bool getSharedSiteTestsEnabled() {
+	return shared_site_tests;
 }
 
+#ifndef MFM_HEADLESS
 void showSplatCompilerErrors(ProgramInfo* info, StringRange glsl_err, float glsl_time_to_compile) {
+	if (compile_state == CompileState_compiling)
+		return; // err belongs to the compile thread, the window comes back when it's done
 	bool any_errors = err.errors.count != 0 || glsl_err.len != 0;
 	show_errors |= any_errors;
 	if (show_errors) {
@@ -331,3 +613,4 @@ void showSplatCompilerErrors(ProgramInfo* info, StringRange glsl_err, float glsl
 		}
 	}
 }
+#endif
@@ -10,6 +10,7 @@ struct ElementInfo {
 	StringRange name = "";
 	StringRange symbol = "";
 	u32 color = 0; // in ABGR format. (not ARGB, like MFM)
+	int radius = EVENT_WINDOW_RADIUS; // furthest site its events reach, see elementRadius()
 	Bunch<DataField> data;
 };
 
@@ -20,5 +21,22 @@ struct ProgramInfo {
 	s64 time_to_emit;
 };
 
+// Compiles changed code on a thread of its own. The changes, and the new info, only come out in the frame the shaders
+// built from the new code are ready to run (see shadersPoll), so the world keeps running the old code until then.
 void checkForSplatProgramChanges(bool* file_change, bool* project_change, ProgramInfo* info);
+void splatCompilerDestroy(); // waits for a compile in flight
+// Headless version of the above (no gui, no shader injection): loads the project from projects/ plus stdlib/, compiles it once
+// and logs any errors. With the native backend enabled it also builds the native module. Returns false if any of that failed.
+bool compileSplatProject(StringRange project_name, ProgramInfo* info);
+// also emit the program as C++ and build it for the native backend (see native.h) whenever it changes
+void setNativeBackendEnabled(bool enabled);
+bool getNativeBackendEnabled();
+// random numbers from a stateless counter based generator keyed on (site, step), instead of a xoroshiro state per site.
+// changes the emitted code, so the program is recompiled, and the worlds drop their prng state
+void setCounterPrngEnabled(bool enabled);
+bool getCounterPrngEnabled();
+// the given tests of the rules (and isa votes) go through a per event cache of the site types, so each site is loaded
+// for them at most once per event however many rules test it, and the given loops are unrolled. same results as without.
+void setSharedSiteTestsEnabled(bool enabled);
+bool getSharedSiteTestsEnabled();
 void showSplatCompilerErrors(ProgramInfo* info, StringRange glsl_err, float glsl_time_to_compile);
\ No newline at end of file
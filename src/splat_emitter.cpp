@@ -154,18 +154,22 @@ void emitBlock(Emitter* emi, Node* who) {
 #define VOTE_KEYCODE_FORMAT "_vote_keycode%d"
 #define CHECK_KEYCODE_FORMAT "_check_keycode%d"
 #define CHANGE_KEYCODE_FORMAT "_change_keycode%d"
+// 'isa T' on the site _cursn, through the site type cache with shared site tests
+#define ISA_TEST_FORMAT "%s(%s(_cursn), %.*s)"
+#define ISA_TEST_ARGS(isa) (emi->shared_site_tests ? "isType" : "is"), (emi->shared_site_tests ? "ew_type" : "ew"), (isa).len, (isa).str
+#define PARAM_IN (emi->target == EmitTarget_glsl ? "in " : "") // C++ has no parameter qualifiers
 
 void emitGivenKeycodeDecl(Emitter* emi, int keycode) {
-	emitLine(emi, "bool " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "(in SiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, keycode);
+	emitLine(emi, "bool " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "(%sSiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, PARAM_IN, keycode);
 }
 void emitVoteKeycodeDecl(Emitter* emi, int keycode) {
-	emitLine(emi, "void " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "(in SiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, keycode);
+	emitLine(emi, "void " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "(%sSiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, PARAM_IN, keycode);
 }
 void emitCheckKeycodeDecl(Emitter* emi, int keycode) {
 	emitLine(emi, "bool " RULENAME_FORMAT CHECK_KEYCODE_FORMAT "() { /* %c */", RULENAME_FORMAT_ARGS, keycode, keycode);
 }
 void emitChangeKeycodeDecl(Emitter* emi, int keycode) {
-	emitLine(emi, "void " RULENAME_FORMAT CHANGE_KEYCODE_FORMAT "(in SiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, keycode);
+	emitLine(emi, "void " RULENAME_FORMAT CHANGE_KEYCODE_FORMAT "(%sSiteNum _cursn) { /* %c */", RULENAME_FORMAT_ARGS, keycode, PARAM_IN, keycode);
 }
 static void clearBinds(Emitter* emi) {
 	memset(emi->given,  0, sizeof(Emitter::given));
@@ -181,13 +185,13 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 	int lhs_active_sites = 0;
 	int rhs_active_sites = 0;
 	for (int i = 0; i < 41; ++i) {
-		if (who->diag.lhs[i] != ' ')  {
-			emi->lhs_used[who->diag.lhs[i]] = true;
-			emi->nsites[who->diag.lhs[i]] += 1;
+		if (who->diag->lhs[i] != ' ')  {
+			emi->lhs_used[who->diag->lhs[i]] = true;
+			emi->nsites[who->diag->lhs[i]] += 1;
 			lhs_active_sites += 1;
 		}
-		if (who->diag.rhs[i] != ' ') {
-			emi->rhs_used[who->diag.rhs[i]] = true;
+		if (who->diag->rhs[i] != ' ') {
+			emi->rhs_used[who->diag->rhs[i]] = true;
 			rhs_active_sites += 1;
 		}
 	}
@@ -216,11 +220,17 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 		}
 	}
 
+	/* Pure rules, with no code in their given, match on the site types alone, see the type planes in emitElementTypeChecks */
+	bool pure_given = true;
+	for (int i = 0; i < int(ARRSIZE(Emitter::given)); ++i)
+		if (emi->lhs_used[i] && (emi->given[i].block || emi->given[i].expression))
+			pure_given = false;
+
 	/* Given keycode binds */
-	for (int i = 0; i < ARRSIZE(Emitter::given); ++i) {
+	for (int i = 0; i < int(ARRSIZE(Emitter::given)) && !pure_given; ++i) {
 		if (emi->lhs_used[i]) {
 			if (emi->given[i].block || emi->given[i].expression) {
-				emitLine(emi, "bool " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "_inject(in SiteNum _cursn) {", RULENAME_FORMAT_ARGS, i);
+				emitLine(emi, "bool " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "_inject(%sSiteNum _cursn) {", RULENAME_FORMAT_ARGS, i, PARAM_IN);
 				if (emi->given[i].block)
 					emitBlock(emi, emi->given[i].block);
 				else
@@ -231,13 +241,20 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 			emitIndent(emi);
 			if (emi->given[i].block || emi->given[i].expression) {
 				if (emi->given[i].isa.len)
-					emitLine(emi, "return is(ew(_cursn), %.*s) && " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "_inject(_cursn);", emi->given[i].isa.len, emi->given[i].isa.str, RULENAME_FORMAT_ARGS, i);
+					emitLine(emi, "return " ISA_TEST_FORMAT " && " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "_inject(_cursn);", ISA_TEST_ARGS(emi->given[i].isa), RULENAME_FORMAT_ARGS, i);
 				else
 					emitLine(emi, "return " RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "_inject(_cursn);", RULENAME_FORMAT_ARGS, i);
 			} else if (emi->given[i].isa.len) {
-				emitLine(emi, "return is(ew(_cursn), %.*s);", emi->given[i].isa.len, emi->given[i].isa.str);
+				emitLine(emi, "return " ISA_TEST_FORMAT ";", ISA_TEST_ARGS(emi->given[i].isa));
 			} else if (i == '@') {
 				emitLine(emi, "return true;");
+			} else if (emi->shared_site_tests) {
+				if (i == '_')
+					emitLine(emi, "return ew_type(_cursn) == Empty;");
+				else if (i == '?')
+					emitLine(emi, "AtomType t = ew_type(_cursn); return t != Void && t != Empty;");
+				else
+					emitLine(emi, "return ew_type(_cursn) != Void;");
 			} else if (i == '_') {
 				emitLine(emi, "return ew_isEmpty(_cursn);");
 			} else if (i == '?') {
@@ -258,7 +275,7 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 	for (int s = 0; s < slot_count; ++s) {
 		int k = keycode_from_slot[s];
 		if (emi->vote[k].block || emi->vote[k].expression) {
-			emitLine(emi, "int " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "_inject(in SiteNum _cursn) {", RULENAME_FORMAT_ARGS, k);
+			emitLine(emi, "int " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "_inject(%sSiteNum _cursn) {", RULENAME_FORMAT_ARGS, k, PARAM_IN);
 			if (emi->vote[k].block)
 				emitBlock(emi, emi->vote[k].block);
 			else
@@ -271,11 +288,11 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 		emitIndent(emi);
 		if (emi->vote[k].block) {
 			if (emi->vote[k].isa.len)
-				emitLine(emi, "int myvotes = is(ew(_cursn), %.*s) ? " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "_inject(_cursn) : 0;", emi->vote[k].isa.len, emi->vote[k].isa.str, RULENAME_FORMAT_ARGS, k);
+				emitLine(emi, "int myvotes = " ISA_TEST_FORMAT " ? " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "_inject(_cursn) : 0;", ISA_TEST_ARGS(emi->vote[k].isa), RULENAME_FORMAT_ARGS, k);
 			else
 				emitLine(emi, "int myvotes = " RULENAME_FORMAT VOTE_KEYCODE_FORMAT "_inject(_cursn);", RULENAME_FORMAT_ARGS, k);
 		} else if (emi->vote[k].isa.len) {
-			emitLine(emi, "int myvotes = is(ew(_cursn), %.*s) ? 1 : 0;", emi->vote[k].isa.len, emi->vote[k].isa.str);
+			emitLine(emi, "int myvotes = " ISA_TEST_FORMAT " ? 1 : 0;", ISA_TEST_ARGS(emi->vote[k].isa));
 		} else {
 			emitLine(emi, "int myvotes = 1;");
 		}
@@ -338,25 +355,59 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 	/* Given */
 	emitLine(emi, "bool " RULENAME_FORMAT "_given() {", RULENAME_FORMAT_ARGS);
 	emitIndent(emi);
-	emitIndentedText(emi, "const int sitenum_table[%d] = {", lhs_active_sites);
-	for (int i = 0; i < 41; ++i)
-		if (who->diag.lhs[i] != ' ')
-			emitText(emi, " %d,", i);
-	emitLine(emi, "};");
-	emitIndentedText(emi, "const int dispatch_table[%d] = {", lhs_active_sites);
-	for (int i = 0; i < 41; ++i)
-		if (who->diag.lhs[i] != ' ')
-			emitText(emi, " %d,", slot_from_keycode[who->diag.lhs[i]]);
-	emitLine(emi, "};");
-	emitLine(emi, "for (int i = 0; i < %d; ++i) {", lhs_active_sites);
-	emitIndent(emi);
-	emitLine(emi, "switch (dispatch_table[i]) {");
-	for (int i = 0; i < slot_count; ++i)
-		emitLine(emi, "case %d: if (!" RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "(sitenum_table[i])) return false; break;", i, RULENAME_FORMAT_ARGS, keycode_from_slot[i]);
-	emitLine(emi, "default: break;");
-	emitLine(emi, "}");
-	emitUnindent(emi);
-	emitLine(emi, "}");
+	if (pure_given) {
+		// one (site, type set) constraint per site, in site order
+		const char* site_type = emi->shared_site_tests ? "ew_type(%d)" : "_UNPACK_TYPE(ew(%d))";
+		for (int i = 0; i < 41; ++i) {
+			int k = who->diag->lhs[i];
+			if (k == ' ' || (k == '@' && !emi->given[k].isa.len))
+				continue;
+			emitIndentedText(emi, "if (");
+			if (emi->given[k].isa.len) {
+				emitText(emi, "!isType(");
+				emitText(emi, site_type, i);
+				emitText(emi, ", %.*s)", emi->given[k].isa.len, emi->given[k].isa.str);
+			} else {
+				emitText(emi, site_type, i);
+				if (k == '_')
+					emitText(emi, " != Empty");
+				else if (k == '?')
+					emitText(emi, " <= Empty"); // Void or Empty
+				else
+					emitText(emi, " == Void");
+			}
+			emitText(emi, ") return false; /* %c */\n", k);
+		}
+	} else if (emi->shared_site_tests) {
+		// unrolled, in the same site order, so the blocks run exactly when they do without; the built in tests are
+		// type compares against ew_type, which the other rules of the event share
+		for (int i = 0; i < 41; ++i) {
+			int k = who->diag->lhs[i];
+			if (k == ' ' || (k == '@' && !emi->given[k].block && !emi->given[k].expression && !emi->given[k].isa.len))
+				continue;
+			emitLine(emi, "if (!" RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "(%d)) return false; /* %c */", RULENAME_FORMAT_ARGS, k, i, k);
+		}
+	} else {
+		emitIndentedText(emi, "const int sitenum_table[%d] = {", lhs_active_sites);
+		for (int i = 0; i < 41; ++i)
+			if (who->diag->lhs[i] != ' ')
+				emitText(emi, " %d,", i);
+		emitLine(emi, "};");
+		emitIndentedText(emi, "const int dispatch_table[%d] = {", lhs_active_sites);
+		for (int i = 0; i < 41; ++i)
+			if (who->diag->lhs[i] != ' ')
+				emitText(emi, " %d,", slot_from_keycode[who->diag->lhs[i]]);
+		emitLine(emi, "};");
+		emitLine(emi, "for (int i = 0; i < %d; ++i) {", lhs_active_sites);
+		emitIndent(emi);
+		emitLine(emi, "switch (dispatch_table[i]) {");
+		for (int i = 0; i < slot_count; ++i)
+			emitLine(emi, "case %d: if (!" RULENAME_FORMAT GIVEN_KEYCODE_FORMAT "(sitenum_table[i])) return false; break;", i, RULENAME_FORMAT_ARGS, keycode_from_slot[i]);
+		emitLine(emi, "default: break;");
+		emitLine(emi, "}");
+		emitUnindent(emi);
+		emitLine(emi, "}");
+	}
 	emitLine(emi, "return true;");
 	emitUnindent(emi);
 	emitLine(emi, "}");
@@ -370,13 +421,13 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 	}
 	emitIndentedText(emi, "const int sitenum_table[%d] = {", lhs_active_sites);
 	for (int i = 0; i < 41; ++i)
-		if (who->diag.lhs[i] != ' ')
+		if (who->diag->lhs[i] != ' ')
 			emitText(emi, " %d,", i);
 	emitLine(emi, "};");
 	emitIndentedText(emi, "const int dispatch_table[%d] = {", lhs_active_sites);
 	for (int i = 0; i < 41; ++i)
-		if (who->diag.lhs[i] != ' ')
-			emitText(emi, " %d,", slot_from_keycode[who->diag.lhs[i]]);
+		if (who->diag->lhs[i] != ' ')
+			emitText(emi, " %d,", slot_from_keycode[who->diag->lhs[i]]);
 	emitLine(emi, "};");
 	emitLine(emi, "for (int i = 0; i < %d; ++i) {", lhs_active_sites);
 	emitIndent(emi);
@@ -408,13 +459,13 @@ static void emitRule(Emitter* emi, Node* who, Errors* err) {
 	emitIndent(emi);
 	emitIndentedText(emi, "const int sitenum_table[%d] = {", rhs_active_sites);
 	for (int i = 0; i < 41; ++i)
-		if (who->diag.rhs[i] != ' ')
+		if (who->diag->rhs[i] != ' ')
 			emitText(emi, " %d,", i);
 	emitLine(emi, "};");
 	emitIndentedText(emi, "const int dispatch_table[%d] = {", rhs_active_sites);
 	for (int i = 0; i < 41; ++i)
-		if (who->diag.rhs[i] != ' ')
-			emitText(emi, " %d,", rhs_slot_from_keycode[who->diag.rhs[i]]);
+		if (who->diag->rhs[i] != ' ')
+			emitText(emi, " %d,", rhs_slot_from_keycode[who->diag->rhs[i]]);
 	emitLine(emi, "};");
 	emitLine(emi, "for (int i = 0; i < %d; ++i) {", rhs_active_sites);
 	emitIndent(emi);
@@ -579,6 +630,8 @@ void emitElement(Emitter* emi, Node* who) {
 	}
 	emitLine(emi, "void %.*s_EVENT_START() {", emi->element_name.len, emi->element_name.str);
 	emitIndent(emi);
+	if (emi->shared_site_tests)
+		emitLine(emi, "ew_forgetTypes();");
 	if (symmetries == 0) {
 		emitLine(emi, "_SYMMETRY = 0;");
 	} else if (symmetries == 0xff) {
@@ -649,7 +702,8 @@ static Node* collectDataMember(Emitter* emi, Node* who, Errors* err, ProgramInfo
 	mem.internal = false;
 	return who->sib;
 }
-static void elementStart(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err, ProgramInfo* info)  {
+// The part of starting an element that doesn't emit code, also needed for elements coming from the cache
+static void collectElement(Emitter* emi, Node* who, Errors* err, ProgramInfo* info) {
 	emi->element_name = who->str_val;
 	emi->super_name = { };
 	emi->ruleset_idx = 1;
@@ -672,7 +726,26 @@ static void elementStart(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err
 	emi->element_stubs.push({emi->element_name, emi->super_name, NULL, NULL});
 
 	/* Pick offsets, avoiding straddling component boundaries */
-	dataAddInternalAndPickOffsets(emi->data);
+	DataLayout layout = dataAddInternalAndPickOffsets(emi->data);
+	if (layout.unplaced) {
+		for (int i = 0; i < emi->data.count; ++i)
+			if (emi->data[i].global_offset == NO_OFFSET)
+				err->add(who->tok, TempStr("Data member '%.*s' (%d bits) of '%.*s' doesn't fit in the atom, %d bits are left.",
+					emi->data[i].name.len, emi->data[i].name.str, emi->data[i].bitsize, emi->element_name.len, emi->element_name.str, layout.free_bits));
+	} else if (layout.used_bits && emi->target == EmitTarget_glsl) { // once, not again for the native emit
+		log("%.*s data: %d bits, %d left, the largest gap is %d\n", emi->element_name.len, emi->element_name.str, layout.used_bits, layout.free_bits, layout.largest_gap);
+	}
+
+	/* Copy data layout for external use */
+	for (int i = 0; i < info->elems.count; ++i) {
+		if (info->elems[i].name == emi->element_name) {
+			info->elems[i].data = emi->data;
+			break;
+		}
+	}
+}
+static void elementStart(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err, ProgramInfo* info)  {
+	collectElement(emi, who, err, info);
 
 	/* Write header */
 	emitHeader(emi, 2, '=', '|', StringRange(who->tok.str, who->tok.len)); 
@@ -690,21 +763,13 @@ static void elementStart(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err
 		dat.appendDataFunctions(emi_decl->code, emi->element_name);
 		dat.appendLocalDataFunctionDefines(emi->code, emi->element_name, true);
 	}
-
-	/* Copy data layout for external use */
-	for (int i = 0; i < info->elems.count; ++i) {
-		if (info->elems[i].name == emi->element_name) {
-			info->elems[i].data = emi->data;
-			break;
-		}
-	}
 }
 static void rulesetStart(Emitter* emi, Node* who) {
 	emi->rule_idx = 1;
 	clearBinds(emi);
 	emitHeader(emi, 1, '-', '|', StringRange(who->tok.str, who->tok.len)); 
 }
-static void emitNode(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err, ProgramInfo* info) {
+static void emitNode(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err, ProgramInfo* info, bool siblings = true) {
 	Node* next = who->sib;
 
 	// Re-think this logic. Seems like going forward we will need to know what section we're in to deliver good errors.
@@ -733,16 +798,159 @@ static void emitNode(Emitter* emi_decl, Emitter* emi, Node* who, Errors* err, Pr
 		if (who->kid) emitNode(emi_decl, emi, who->kid, err, info);
 		if (who->type == Node_rules) emitRuleset(emi);
 		if (who->type == Node_element) emitElement(emi, who);
-		if (next) emitNode(emi_decl, emi, next, err, info);
+		if (next && siblings) emitNode(emi_decl, emi, next, err, info);
+	}
+}
+static EmittedElement* findEmittedElement(Bunch<EmittedElement>* cache, Node* who) {
+	for (int i = 0; i < cache->count; ++i)
+		if ((*cache)[i].element == who)
+			return &(*cache)[i];
+	return NULL;
+}
+// Emits the top level nodes one by one, taking unchanged elements from emi->element_cache
+static void emitTopLevelNodes(Emitter* emi_decl, Emitter* emi, Node* first, Errors* err, ProgramInfo* info) {
+	for (Node* who = first; who; who = who->sib) {
+		if (who->type != Node_element || !emi->element_cache) {
+			emitNode(emi_decl, emi, who, err, info, false);
+			continue;
+		}
+		int file_idx = findFileIdx(emi->file_ranges, emi->file_count, who->tok.str);
+		EmittedElement* cached = findEmittedElement(emi->element_cache, who);
+		if (cached && cached->file_idx == file_idx) {
+			collectElement(emi, who, err, info);
+			emi_decl->code.append(cached->decl_code.range());
+			emi->code.append(cached->elem_code.range());
+			emi->elements_from_cache += 1;
+			continue;
+		}
+
+		size_t decl_start = emi_decl->code.len;
+		size_t elem_start = emi->code.len;
+		int64_t err_count = err->errors.count;
+		emitNode(emi_decl, emi, who, err, info, false);
+		emi->elements_emitted += 1;
+		if (err->errors.count != err_count)
+			continue; // don't keep code that has errors in it
+
+		if (!cached) {
+			cached = &emi->element_cache->push();
+			cached->element = who;
+		}
+		cached->file_idx = file_idx;
+		cached->decl_code.set(emi_decl->code.str + decl_start, emi_decl->code.len - decl_start);
+		cached->elem_code.set(emi->code.str + elem_start, emi->code.len - elem_start);
+	}
+}
+void forgetEmittedElements(Bunch<EmittedElement>* cache, Node* first) {
+	for (Node* who = first; who; who = who->sib) {
+		for (int i = 0; i < cache->count; ++i) {
+			if ((*cache)[i].element == who) {
+				(*cache)[i].decl_code.free();
+				(*cache)[i].elem_code.free();
+				cache->remove(i);
+				break;
+			}
+		}
+	}
+}
+/* Event window radius analysis */
+// Radius reached through one argument that names a site: a site number or C2D() of literals, or _cursn, which only ever
+// takes the sites of the rule's diagram. Anything else could be any site of the window.
+static int siteArgRadius(Node* arg, Node* arg_end) {
+	if (arg == arg_end) return EVENT_WINDOW_RADIUS;
+	if (arg->sib == arg_end) {
+		if (arg->type == Node_integer_literal && arg->tok.int_lit >= 0 && arg->tok.int_lit < 41)
+			return taxilen(getSiteCoord(arg->tok.int_lit));
+		if (arg->type == Node_identifier && StringRange(arg->tok.str, arg->tok.len) == StringRange("_cursn"))
+			return 0;
+	} else if (arg->type == Node_identifier && StringRange(arg->tok.str, arg->tok.len) == StringRange("C2D") &&
+			arg->sib->type == Node_parens && arg->sib->sib == arg_end) {
+		// the lexer skips '-', so these are the absolute values, which is all the radius needs
+		Node* x = arg->sib->kid;
+		Node* comma = x ? x->sib : NULL;
+		Node* y = comma ? comma->sib : NULL;
+		if (x && x->type == Node_integer_literal && comma && comma->tok.type == Token_comma &&
+				y && y->type == Node_integer_literal && y->sib && y->sib->type == Node_parens_end)
+			return min(abs(x->tok.int_lit) + abs(y->tok.int_lit), EVENT_WINDOW_RADIUS);
+	}
+	return EVENT_WINDOW_RADIUS;
+}
+static bool endsWith(StringRange s, const char* end) {
+	size_t len = strlen(end);
+	return s.len >= len && StringRange(s.str + s.len - len, len) == StringRange(end, len);
+}
+// How many of the leading arguments of a call name sites: the ew functions of sites.inl, and the data member accessors
+// that take a site. -1 for the raw site functions, which could reach anything.
+static int siteArgCount(StringRange name, int arg_count) {
+	if (name.len >= 2 && name.str[0] == 'e' && name.str[1] == 'w') {
+		if (name == StringRange("ew")) return 1; // ew(site) and ew(site, atom)
+		if (name == StringRange("ew_swap")) return 2;
+		if (name == StringRange("ew_changeSymmetry") || name == StringRange("ew_getSymmetry")) return 0;
+		return arg_count;
+	}
+	if (name.len >= 5 && StringRange(name.str, 5) == StringRange("_SITE"))
+		return -1;
+	if (endsWith(name, "_get"))
+		return arg_count == 1 ? 1 : 0;
+	if (endsWith(name, "_set") || endsWith(name, "_add") || endsWith(name, "_sub") || endsWith(name, "_mul") || endsWith(name, "_div"))
+		return arg_count == 2 ? 1 : 0;
+	return 0;
+}
+static int callRadius(Node* name, Node* parens) {
+	Node* args[2] = { };
+	Node* ends[2] = { };
+	int arg_count = 0;
+	Node* arg = parens->kid;
+	for (Node* n = parens->kid; n; n = n->sib) {
+		bool arg_end = n->type == Node_parens_end || n->tok.type == Token_comma;
+		if (arg_end && (n != parens->kid || n->type != Node_parens_end)) {
+			if (arg_count < 2) {
+				args[arg_count] = arg;
+				ends[arg_count] = n;
+			}
+			arg_count += 1;
+			arg = n->sib;
+		}
+	}
+	int sites = siteArgCount(StringRange(name->tok.str, name->tok.len), arg_count);
+	if (sites < 0 || sites > 2) return EVENT_WINDOW_RADIUS;
+	int radius = 0;
+	for (int i = 0; i < sites && i < arg_count; ++i)
+		radius = max(radius, siteArgRadius(args[i], ends[i]));
+	return radius;
+}
+static void findRadius(Node* who, int* radius) {
+	for (; who && *radius < EVENT_WINDOW_RADIUS; who = who->sib) {
+		if (who->type == Node_diagram) {
+			for (int i = 0; i < 41; ++i)
+				if (who->diag->lhs[i] != ' ' || who->diag->rhs[i] != ' ')
+					*radius = max(*radius, taxilen(getSiteCoord(i)));
+		} else if (who->type == Node_identifier && who->sib && who->sib->type == Node_parens) {
+			*radius = max(*radius, callRadius(who, who->sib));
+		}
+		if (who->kid) findRadius(who->kid, radius);
 	}
 }
+// The furthest site the rules and code of an element can reach, not counting the super element. Where the code picks sites
+// at run time, it's the whole window. A \radius declaration isn't taken on trust, the code has to show it.
+static int elementRadius(Node* element) {
+	int radius = 0;
+	findRadius(element->kid, &radius);
+	return radius;
+}
+
 static void emitElementTypeDecls(Emitter* emi, Node* who, Errors* err, ProgramInfo* info) {
+	if (emi->counter_prng)
+		emitLine(emi, "#define PRNG_COUNTER");
+	if (emi->shared_site_tests)
+		emitLine(emi, "#define SHARED_SITE_TESTS");
 	{
 		emitLine(emi, "#define Void 0");
 		ElementInfo& einfo = info->elems.push();
 		einfo.name = "Void";
 		einfo.symbol = "  ";
 		einfo.color = 0xffff00ff;
+		einfo.radius = 0;
 	}
 	{
 		emitLine(emi, "#define Empty 1");
@@ -750,8 +958,13 @@ static void emitElementTypeDecls(Emitter* emi, Node* who, Errors* err, ProgramIn
 		einfo.name = "Empty";
 		einfo.symbol = "Em";
 		einfo.color = 0xff000000;
+		einfo.radius = 0;
 	}
 	int t = 2;
+	static Bunch<StringRange> super_names; // per type id
+	super_names.clear();
+	super_names.push(StringRange());
+	super_names.push(StringRange());
 	while (who) {
 		if (who->type == Node_element) {
 			emitLine(emi, "#define %.*s %d", who->str_val.len, who->str_val.str, t++);
@@ -759,6 +972,8 @@ static void emitElementTypeDecls(Emitter* emi, Node* who, Errors* err, ProgramIn
 			einfo.name = who->str_val;
 			einfo.color = 0xffffff00;
 			einfo.symbol = "??";
+			einfo.radius = elementRadius(who);
+			super_names.push(StringRange());
 			Node* kid = who->kid;
 			while (kid) {
 				if (kid->type == Node_metadata_color) {
@@ -769,6 +984,8 @@ static void emitElementTypeDecls(Emitter* emi, Node* who, Errors* err, ProgramIn
 					einfo.color |= ((kid->unsigned_val >> 24) & 0xff) << 24; // A
 				} else if (kid->type == Node_metadata_symbol) {
 					einfo.symbol = kid->str_val;
+				} else if (kid->type == Node_super) {
+					super_names[super_names.count - 1] = kid->str_val;
 				}
 				kid = kid->sib;
 			}
@@ -776,6 +993,31 @@ static void emitElementTypeDecls(Emitter* emi, Node* who, Errors* err, ProgramIn
 		who = who->sib;
 	}
 	emitLine(emi, "#define TYPE_COUNT %d", t);
+
+	// elements run the rules of their super element too, so they reach at least as far
+	static Bunch<int> super_idx;
+	super_idx.clear();
+	for (int i = 0; i < info->elems.count; ++i) {
+		int s = -1;
+		for (int j = 0; super_names[i].len && j < info->elems.count; ++j)
+			if (j != i && info->elems[j].name == super_names[i])
+				s = j;
+		super_idx.push(s);
+	}
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (int i = 0; i < info->elems.count; ++i) {
+			if (super_idx[i] >= 0 && info->elems[super_idx[i]].radius > info->elems[i].radius) {
+				info->elems[i].radius = info->elems[super_idx[i]].radius;
+				changed = true;
+			}
+		}
+	}
+	int radius = 0;
+	for (int i = 0; i < info->elems.count; ++i)
+		radius = max(radius, info->elems[i].radius);
+	// two events can run at the same time if their windows can't overlap, see isActiveMem
+	emitLine(emi, "#define EXCLUSION_RADIUS %d", radius * 2);
 }
 static void emitInheritanceDecls(Emitter* emi, Node* who, Errors* err, ProgramInfo* info) {
 	while (who) {
@@ -831,14 +1073,16 @@ static void printHeirarchy(ElementStub* who, int depth = 0) {
 	if (who->kid) printHeirarchy(who->kid, depth + 1);
 	if (who->sib) printHeirarchy(who->sib, depth);
 }
-static void emitTypeCompare(Emitter* emi, ElementStub* who, bool* first) {
-	if (who->kid) emitTypeCompare(emi, who, first);
+// Sets the plane bit of every element under 'who' (and its sibs) that has no kids of its own, which is what 'is' accepts
+// for an element with kids.
+static void markTypePlaneLeaves(ElementStub* who, Bunch<StringRange>* type_names, Bunch<u32>* planes, int words, int plane) {
+	if (who->kid) markTypePlaneLeaves(who->kid, type_names, planes, words, plane);
 	else {
-		if (!*first) emitText(emi, " || ");
-		*first = false;
-		emitText(emi, "A_t == %.*s", who->element_name.len, who->element_name.str, first);
+		for (int t = 0; t < type_names->count; ++t)
+			if ((*type_names)[t] == who->element_name)
+				(*planes)[t * words + plane / 32] |= 1u << (plane % 32);
 	}
-	if (who->sib) emitTypeCompare(emi, who->sib, first);
+	if (who->sib) markTypePlaneLeaves(who->sib, type_names, planes, words, plane);
 }
 static void emitElementTypeChecks(Emitter* emi, Node* who_first, Errors* err) {
 	for (int i = 0; i < emi->element_stubs.count; ++i) {
@@ -861,20 +1105,65 @@ static void emitElementTypeChecks(Emitter* emi, Node* who_first, Errors* err) {
 	}
 #endif
 	
+	// Type planes: a row of TYPE_COUNT bits per type, bit t set if the type 'is' t. Empty also takes Void, elements with
+	// kids take the kids (but not themselves), everything else just itself.
+	static Bunch<StringRange> type_names; // per type id, same order as emitElementTypeDecls
+	type_names.clear();
+	type_names.push(StringRange("Void"));
+	type_names.push(StringRange("Empty"));
+	for (Node* who = who_first; who; who = who->sib)
+		if (who->type == Node_element)
+			type_names.push(who->str_val);
+	int words = (type_names.count + 31) / 32;
+	static Bunch<u32> planes;
+	planes.clear();
+	for (int i = 0; i < type_names.count * words; ++i)
+		planes.push(0);
+	for (int t = 0; t < type_names.count; ++t) {
+		ElementStub* stub = NULL;
+		for (int i = 0; i < emi->element_stubs.count && !stub; ++i)
+			if (emi->element_stubs[i].element_name == type_names[t])
+				stub = &emi->element_stubs[i];
+		if (t == 1) {
+			planes[0 * words] |= 1u << 1; // Void is Empty
+			planes[1 * words] |= 1u << 1;
+		} else if (stub && stub->kid) {
+			markTypePlaneLeaves(stub->kid, &type_names, &planes, words, t);
+		} else {
+			planes[t * words + t / 32] |= 1u << (t % 32);
+		}
+	}
+	emitLine(emi, "#define TYPE_PLANE_WORDS %d", words);
+	if (emi->target == EmitTarget_glsl)
+		emitIndentedText(emi, "const uint _TYPE_PLANES[%d] = uint[](", planes.count);
+	else
+		emitIndentedText(emi, "static const uint _TYPE_PLANES[%d] = {", planes.count);
+	for (int i = 0; i < planes.count; ++i)
+		emitText(emi, "%s0x%xu", i ? ", " : "", planes[i]);
+	emitText(emi, emi->target == EmitTarget_glsl ? ");\n" : "};\n");
+
 	emitLine(emi, "bool is(Atom A, AtomType t) {");
 	emitIndent(emi);
-	emitLine(emi, "AtomType A_t = _UNPACK_TYPE(A);");
+	emitLine(emi, "return isType(_UNPACK_TYPE(A), t);");
+	emitUnindent(emi);
+	emitLine(emi, "}");
+	// t is mostly a constant, which leaves a single compare, or one plane lookup for the elements with kids
+	emitLine(emi, "bool isType(AtomType A_t, AtomType t) {");
+	emitIndent(emi);
 	emitLine(emi, "if (t == Empty) { return A_t == Empty || A_t == Void; }");
+	bool first = true;
 	for (int i = 0; i < emi->element_stubs.count; ++i) {
 		ElementStub* who = &emi->element_stubs[i];
 		if (who->kid) {
-			emitIndentedText(emi, "else if (t == %.*s) {", who->element_name.len, who->element_name.str);
-			emitText(emi, "return ");
-			bool first = true;
-			emitTypeCompare(emi, who->kid, &first);
-			emitText(emi, "; }\n");
+			if (first)
+				emitIndentedText(emi, "else if (t == %.*s", who->element_name.len, who->element_name.str);
+			else
+				emitText(emi, " || t == %.*s", who->element_name.len, who->element_name.str);
+			first = false;
 		}
 	}
+	if (!first)
+		emitText(emi, ") { return A_t < TYPE_COUNT && (_TYPE_PLANES[A_t * TYPE_PLANE_WORDS + (t >> 5)] & (1u << (t & 31u))) != 0u; }\n");
 	emitLine(emi, "else { return A_t == t; }");
 	emitUnindent(emi);
 	emitLine(emi, "}");
@@ -903,12 +1192,13 @@ void emitForwardDeclarationsAndTypes(Emitter* emi, Node* who, Errors* err, Progr
 	emitHeader(emi, 1, '+', '+', StringRange("Forward Declarations for Core Functions")); 
 	emitLine(emi, "");
 	emitLine(emi, "bool is(Atom A, AtomType t);");
+	emitLine(emi, "bool isType(AtomType A_t, AtomType t);");
 }
 void emitElements(Emitter* emi_decl, Emitter* emi_elem, Node* who, Errors* err, ProgramInfo* info) {
 	emi_elem->code.clear();
 
 	/* Core code */
-	emitNode(emi_decl, emi_elem, who->kid, err, info);
+	emitTopLevelNodes(emi_decl, emi_elem, who->kid, err, info);
 
 	/* Dispatch methods */
 	emitHeader(emi_elem, 1, '+', '+', StringRange("Dispatches"));  
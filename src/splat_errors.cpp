@@ -1,6 +1,8 @@
 #include "splat_internal.h"
 #include "mfm_utils.h"
+#ifndef MFM_HEADLESS
 #include "imgui/imgui.h"
+#endif
 
 void Errors::add(Token tok, const char* msg) {
 	ParserError& e = errors.push();
@@ -8,15 +10,16 @@ void Errors::add(Token tok, const char* msg) {
 	e.msg.set(msg);
 }
 
+#ifndef MFM_HEADLESS
 static void printDiagramImg(Node* who) {
 	ImDrawList* dl = ImGui::GetWindowDrawList();
 	float char_size = 16.0f;
 	vec2 orig = gui::GetCursorScreenPos();
-	gui::InvisibleButton("drawing area", vec2(who->full_img.dims) * char_size);
-	for (int y = 0; y < who->full_img.dims.y; ++y) {
-		for (int x = 0; x < who->full_img.dims.x; ++x) {
-			char key = who->full_img(x, y);
-			char comp = who->comp_img(x, y);
+	gui::InvisibleButton("drawing area", vec2(who->diag->full_img.dims) * char_size);
+	for (int y = 0; y < who->diag->full_img.dims.y; ++y) {
+		for (int x = 0; x < who->diag->full_img.dims.x; ++x) {
+			char key = who->diag->full_img(x, y);
+			char comp = who->diag->comp_img(x, y);
 
 			vec2 p = vec2(x + 0.5f, y + 0.5f) * char_size;
 			vec2 r = vec2(char_size) * 0.45f;
@@ -62,7 +65,7 @@ void printNode(Node* who, int depth) {
 		gui::PushStyleColor(ImGuiCol_PopupBg, vec4(vec3(0.0f), 1.0f));
 		gui::BeginTooltip();
 		printDiagramImg(who);
-		printDiagramPair(&who->diag);
+		printDiagramPair(who->diag);
 		gui::EndTooltip();
 		gui::PopStyleColor(1);
 	}
@@ -70,18 +73,34 @@ void printNode(Node* who, int depth) {
 	if (who->sib) printNode(who->sib, depth);
 }
 
+#endif
+
 int findFileIdx(StringRange* file_ranges, int file_count, const char* str) {
-	int file_idx = 0;
-	while (file_idx < file_count) {
+	// every file has its own text buffer, see parseFile() in splat_compiler.cpp
+	for (int file_idx = 0; file_idx < file_count; ++file_idx) {
 		StringRange r = file_ranges[file_idx];
-		if ((str - r.str) >= (int)r.len) {
-			file_idx += 1;
-		} else {
-			break;
+		if (str >= r.str && str < r.str + r.len)
+			return file_idx;
+	}
+	return file_count;
+}
+// Same as printErrors, but into the log, for when there's no gui to show them in.
+void logErrors(Errors* err, StringRange* file_names, StringRange* file_ranges, int file_count) {
+	for (ParserError* e = err->errors.ptr; e != err->errors.end(); ++e) {
+		StringRange file_name = file_names[findFileIdx(file_ranges, file_count, e->tok.str)];
+		logError("SPLAT", 0, "in '%.*s' %s line %d: %.*s", file_name.len, file_name.str, e->show_diagram ? "diagram after" : "on", e->tok.line_num, e->msg.len, e->msg.str);
+		if (e->show_diagram) {
+			for (int y = 0; y < e->img.dims.y; ++y) {
+				char row[DIAGRAM_IMG_W + 1];
+				for (int x = 0; x < e->img.dims.x; ++x)
+					row[x] = e->img(x, y);
+				row[e->img.dims.x] = 0;
+				log("    %s\n", row);
+			}
 		}
 	}
-	return file_idx;
 }
+#ifndef MFM_HEADLESS
 void printErrors(Errors* err, StringRange glsl_err, StringRange* file_names, StringRange* file_ranges, int file_count) {
 	for (ParserError* e = err->errors.ptr; e != err->errors.end(); ++e) {
 		StringRange file_name = file_names[findFileIdx(file_ranges, file_count, e->tok.str)];
@@ -125,4 +144,5 @@ void printErrors(Errors* err, StringRange glsl_err, StringRange* file_names, Str
 
 void printCode(StringRange code) {
 	gui::TextUnformatted(code.str, code.str + code.len);
-}
\ No newline at end of file
+}
+#endif
@@ -228,6 +228,7 @@ int  findFileIdx(StringRange* file_ranges, int file_count, const char* str);
 void printNode(Node* who, int depth = 0);
 void printErrors(Errors* err, StringRange glsl_err, StringRange* file_names, StringRange* file_ranges, int file_count);
 void printCode(StringRange code);
+void logErrors(Errors* err, StringRange* file_names, StringRange* file_ranges, int file_count);
 
 
 ////////////////////////////////////////////////
@@ -294,6 +295,10 @@ struct DiagramPiece {
 struct Diagram {
 	char lhs[41];
 	char rhs[41];
+
+	// debug data, for the ast view
+	DiagramImg full_img;
+	DiagramImg comp_img;
 };
 
 struct Node {
@@ -303,28 +308,34 @@ struct Node {
 	Token tok;
 
 	// various possible non-literal data that were parsed from one or more tokens
-	Diagram diag; // #OPT maybe change this to a pointer and store separately
+	Diagram* diag; // only for Node_diagram, the rest are better off small
 	int int_val;
 	StringRange str_val;
 	unsigned int unsigned_val;
+};
 
-	// debug data, for now
-	DiagramImg full_img;
-	DiagramImg lhs_img;
-	DiagramImg rhs_img;
-	DiagramImg comp_img;
+// Bump allocator for the nodes of one AST. There's no freeing single nodes, the whole tree goes at once with release().
+#define NODE_ARENA_BLOCK_BYTES (64 * 1024)
+struct NodeArenaBlock {
+	NodeArenaBlock* next;
+	size_t used;
+	size_t bytes;
+};
+struct NodeArena {
+	NodeArenaBlock* head = NULL;
+	void* alloc(size_t bytes);
+	void release();
 };
 
 struct Parser {
-
+	NodeArena* arena;
 };
 
 inline bool isSectionHeaderNode(Node* who) {
 	return who->type == Node_element || who->type == Node_rules || who->type == Node_methods || who->type == Node_data;
 }
 
-Node* makeNode(NodeType, Token);
-void freeNode(Node* who);
+Node* makeNode(Parser* par, NodeType, Token);
 void transformAST(Node* par, Node* who, Errors* err);
 
 template<typename T>
@@ -358,7 +369,28 @@ struct ElementStub {
 	ElementStub* sib;
 };
 
+enum EmitTarget {
+	EmitTarget_glsl,
+	EmitTarget_cpp, // native backend, see shaders/native_prelude.inl
+	EmitTarget_count
+};
+
+// Code emitted for one element, kept across compiles so elements whose AST didn't change aren't emitted again.
+// The code only refers to other elements by name, so it doesn't depend on them changing.
+// 'element' is owned by the parse cache in splat_compiler.cpp, which forgets the entry before freeing it.
+struct EmittedElement {
+	Node* element;
+	int file_idx; // the #line directives name the file by index
+	String decl_code;
+	String elem_code;
+};
+
 struct Emitter {
+	// settings
+	EmitTarget target = EmitTarget_glsl;
+	bool counter_prng = false; // random numbers from the stateless counter_prng.inl instead of the per site xoroshiro state
+	bool shared_site_tests = false; // given and isa tests read the per event site type cache (ew_type) instead of loading the site every time
+
 	// error state
 	StringRange* file_names = NULL;
 	StringRange* file_ranges = NULL;
@@ -381,10 +413,15 @@ struct Emitter {
 
 	// cumulative state
 	Bunch<ElementStub> element_stubs;
+	Bunch<EmittedElement>* element_cache = NULL; // optional, for one target
+	int elements_emitted = 0;
+	int elements_from_cache = 0;
 
 	int element_uid = 0;
 	String code;
 };
 
 void emitForwardDeclarationsAndTypes(Emitter* emi, Node* who, Errors* err, ProgramInfo* info);
-void emitElements(Emitter* emi_decl, Emitter* emi_elem, Node* who, Errors* err, ProgramInfo* info);
\ No newline at end of file
+void emitElements(Emitter* emi_decl, Emitter* emi_elem, Node* who, Errors* err, ProgramInfo* info);
+// drops the cached code of the elements in a list of top level nodes, before they are freed
+void forgetEmittedElements(Bunch<EmittedElement>* cache, Node* first);
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "mfm_utils.h"
 #include "splat_internal.h"
 #include <stdio.h>
+#include <new> // for placement new
 
 /* DODGY
  - String leaks memory!
@@ -53,41 +54,52 @@ static unsigned int symmetry_bitmasks[] = {
 	0x55, // 01010101
 };
 
-Node* makeNode(NodeType type, Token tok) {
-	Node* n = (Node*)malloc(sizeof(Node));
+void* NodeArena::alloc(size_t bytes) {
+	bytes = (bytes + 15) & ~size_t(15);
+	if (!head || head->used + bytes > head->bytes) {
+		size_t block_bytes = max(size_t(NODE_ARENA_BLOCK_BYTES), sizeof(NodeArenaBlock) + 16 + bytes);
+		NodeArenaBlock* block = (NodeArenaBlock*)malloc(block_bytes);
+		block->next = head;
+		block->used = (sizeof(NodeArenaBlock) + 15) & ~size_t(15);
+		block->bytes = block_bytes;
+		head = block;
+	}
+	void* mem = (char*)head + head->used;
+	head->used += bytes;
+	return mem;
+}
+void NodeArena::release() {
+	while (head) {
+		NodeArenaBlock* next = head->next;
+		free(head);
+		head = next;
+	}
+}
+
+Node* makeNode(Parser* par, NodeType type, Token tok) {
+	Node* n = (Node*)par->arena->alloc(sizeof(Node));
 	memset(n, 0, sizeof(Node));
 	n->type = type;
 	n->tok = tok;
 	return n;
 }
-Node* makeNode(NodeType type, Token tok, int int_val) {
-	Node* n = makeNode(type, tok);
+Node* makeNode(Parser* par, NodeType type, Token tok, int int_val) {
+	Node* n = makeNode(par, type, tok);
 	n->int_val = int_val;
 	return n;
 }
-Node* makeNode(NodeType type, Token tok, unsigned int unsigned_val) {
-	Node* n = makeNode(type, tok);
+Node* makeNode(Parser* par, NodeType type, Token tok, unsigned int unsigned_val) {
+	Node* n = makeNode(par, type, tok);
 	n->unsigned_val = unsigned_val;
 	return n;
 }
-Node* makeNode(NodeType type, Token tok, StringRange str_val) {
-	Node* n = makeNode(type, tok);
+Node* makeNode(Parser* par, NodeType type, Token tok, StringRange str_val) {
+	Node* n = makeNode(par, type, tok);
 	n->str_val = str_val;
 	return n;
 }
-Node* makeNodeError(Token tok) {
-	return makeNode(Node_error, tok);
-}
-void freeNode(Node* who) {
-	if (who->kid) {
-		freeNode(who->kid);
-		who->kid = NULL;
-	}
-	if (who->sib) {
-		freeNode(who->sib);
-		who->sib = NULL;
-	}
-	free(who);
+Node* makeNodeError(Parser* par, Token tok) {
+	return makeNode(par, Node_error, tok);
 }
 DiagramPiece parseDiagramPieceAndClearComponent(Parser* p, DiagramImg* comp_img) {
 	DiagramPiece piece;
@@ -122,7 +134,8 @@ Node* parseSpatialForm(Parser* p, Errors* err, Token t) {
 
 	memset(comp_img.mem, 0, sizeof(DiagramImg)); // replace with clear(0)
 
-	Node* n = makeNode(Node_diagram, t);
+	Node* n = makeNode(p, Node_diagram, t);
+	n->diag = new (p->arena->alloc(sizeof(Diagram))) Diagram();
 	const char* c = t.str;
 	ivec2 idx = ivec2(0,0);
 	ivec2 dims = t.maxc - t.minc + ivec2(1);
@@ -180,254 +193,256 @@ Node* parseSpatialForm(Parser* p, Errors* err, Token t) {
 		}
 		c += 1;
 	}
-	// collapse mappings
-	// #OPT I feel like this only requires 1 iteration really, but I can't prove it so in case there is a pedantic case I'm missing...
-	int loops = 0;
-	while (true) {
-		bool did_a_collapse = false;
-		for (char i = 0; i < comp_count; ++i) {
-			if (comp_map[i] != i) {
-				char eq = comp_map[comp_map[i]];
-				if (comp_map[i] != eq) {
-					comp_map[i] = comp_map[eq];
-					did_a_collapse = true;
+	{ // scoped so that the early-outs to END below never jump over an initialization
+		// collapse mappings
+		// #OPT I feel like this only requires 1 iteration really, but I can't prove it so in case there is a pedantic case I'm missing...
+		int loops = 0;
+		while (true) {
+			bool did_a_collapse = false;
+			for (char i = 0; i < comp_count; ++i) {
+				if (comp_map[i] != i) {
+					char eq = comp_map[comp_map[i]];
+					if (comp_map[i] != eq) {
+						comp_map[i] = comp_map[eq];
+						did_a_collapse = true;
+					}
 				}
 			}
+			loops += 1;
+			if (!did_a_collapse) break; // stop when no remappings occurred
+		}
+		if (loops > 2) {
+			assert(false); // i'm curious what this can be...
 		}
-		loops += 1;
-		if (!did_a_collapse) break; // stop when no remappings occurred
-	}
-	if (loops > 2) {
-		assert(false); // i'm curious what this can be...
-	}
-
-	// renumber mappings to numeric order
-	char renumber_map[COMP_COUNT_MAX];
-	char unique_count = 0;
-	memset(renumber_map, COMP_COUNT_MAX, sizeof(renumber_map));
-	for (int i = 0; i < comp_count; ++i) {
-		if (renumber_map[comp_map[i]] == COMP_COUNT_MAX)
-			renumber_map[comp_map[i]] = unique_count++;
-	}
-	for (int i = 0; i < comp_count; ++i) {
-		comp_map[i] = renumber_map[comp_map[i]];
-	}
 
-	
-	// remap
-	for (int y = 0; y < dims.y; ++y) {
-		for (int x = 0; x < dims.x; ++x) {
-			comp_img(x,y) = comp_map[comp_img(x,y)];
+		// renumber mappings to numeric order
+		char renumber_map[COMP_COUNT_MAX];
+		char unique_count = 0;
+		memset(renumber_map, COMP_COUNT_MAX, sizeof(renumber_map));
+		for (int i = 0; i < comp_count; ++i) {
+			if (renumber_map[comp_map[i]] == COMP_COUNT_MAX)
+				renumber_map[comp_map[i]] = unique_count++;
+		}
+		for (int i = 0; i < comp_count; ++i) {
+			comp_map[i] = renumber_map[comp_map[i]];
 		}
-	}
 
-	if (unique_count != 4) { // includes the implicit '0' component for background
-		ParserError& e = err->errors.push();
-		e.tok = t;
-		e.msg.set(TempStr("Too %s parts in diagram - expected Left, Arrow, Right.", unique_count < 4 ? "few" : "many"));
-		e.img = full_img;
-		e.show_diagram = true;
+	
+		// remap
 		for (int y = 0; y < dims.y; ++y) {
 			for (int x = 0; x < dims.x; ++x) {
-				e.img_color[y][x] = COLOR_COMPONENT(comp_img(x,y));
+				comp_img(x,y) = comp_map[comp_img(x,y)];
 			}
 		}
-		goto END;
-	}
 
-	// isolate lhs
-	DiagramImg comp_working_img = comp_img;
-	DiagramPiece lhs = parseDiagramPieceAndClearComponent(p, &comp_working_img);
-	DiagramPiece arr = parseDiagramPieceAndClearComponent(p, &comp_working_img);
-	DiagramPiece rhs = parseDiagramPieceAndClearComponent(p, &comp_working_img);
-
-	// check that arrow is actually an arrow
-	{	
-		ParserError e;
-		e.tok = t;
-		e.img = full_img;
-		e.show_diagram = true;
-		ivec2 arrow_pos = ivec2(-1);
-		bool non_arrow_characters = false;
-		bool malformed_arrow = false;
-		int char_count = 0;
-		for (int y = arr.start.y; y <= arr.end.y; ++y) {
-			for (int x = arr.start.x; x <= arr.end.x; ++x) {
-				if (comp_img(x,y) == arr.comp_id) {
-					char key = full_img(x,y);
-					if (key != ' ') {
-						e.img_color[y][x] = COLOR_ERROR; // by default, say this is an error
-						if (key == '-' || key == '>') {
-							if (key == '-') {
-								if (arrow_pos == ivec2(-1)) { // check we haven't found something already
-									if (x < (dims.x-1) && full_img(x+1,y) == '>') { // if '>' is next to it, we found the arrow
-										arrow_pos = ivec2(x,y);
+		if (unique_count != 4) { // includes the implicit '0' component for background
+			ParserError& e = err->errors.push();
+			e.tok = t;
+			e.msg.set(TempStr("Too %s parts in diagram - expected Left, Arrow, Right.", unique_count < 4 ? "few" : "many"));
+			e.img = full_img;
+			e.show_diagram = true;
+			for (int y = 0; y < dims.y; ++y) {
+				for (int x = 0; x < dims.x; ++x) {
+					e.img_color[y][x] = COLOR_COMPONENT(comp_img(x,y));
+				}
+			}
+			goto END;
+		}
+
+		// isolate lhs
+		DiagramImg comp_working_img = comp_img;
+		DiagramPiece lhs = parseDiagramPieceAndClearComponent(p, &comp_working_img);
+		DiagramPiece arr = parseDiagramPieceAndClearComponent(p, &comp_working_img);
+		DiagramPiece rhs = parseDiagramPieceAndClearComponent(p, &comp_working_img);
+
+		// check that arrow is actually an arrow
+		{	
+			ParserError e;
+			e.tok = t;
+			e.img = full_img;
+			e.show_diagram = true;
+			ivec2 arrow_pos = ivec2(-1);
+			bool non_arrow_characters = false;
+			bool malformed_arrow = false;
+			int char_count = 0;
+			for (int y = arr.start.y; y <= arr.end.y; ++y) {
+				for (int x = arr.start.x; x <= arr.end.x; ++x) {
+					if (comp_img(x,y) == arr.comp_id) {
+						char key = full_img(x,y);
+						if (key != ' ') {
+							e.img_color[y][x] = COLOR_ERROR; // by default, say this is an error
+							if (key == '-' || key == '>') {
+								if (key == '-') {
+									if (arrow_pos == ivec2(-1)) { // check we haven't found something already
+										if (x < (dims.x-1) && full_img(x+1,y) == '>') { // if '>' is next to it, we found the arrow
+											arrow_pos = ivec2(x,y);
+											e.img_color[y][x] = COLOR_TEXT;
+										} else {
+											malformed_arrow = true;
+										}
+									} else {
+										malformed_arrow = true;
+									}
+								} else if (key == '>') {
+									if ((arrow_pos != ivec2(-1)) && (x == (arrow_pos.x+1))) { // if '-' is not behind it, this is a stray
 										e.img_color[y][x] = COLOR_TEXT;
 									} else {
 										malformed_arrow = true;
 									}
-								} else {
-									malformed_arrow = true;
-								}
-							} else if (key == '>') {
-								if ((arrow_pos != ivec2(-1)) && (x == (arrow_pos.x+1))) { // if '-' is not behind it, this is a stray
-									e.img_color[y][x] = COLOR_TEXT;
-								} else {
-									malformed_arrow = true;
 								}
+							} else {
+								non_arrow_characters = true;
 							}
-						} else {
-							non_arrow_characters = true;
 						}
 					}
 				}
 			}
+			if (arrow_pos == ivec2(-1)) {
+				e.msg.set("Arrow '->' not found.");
+				err->errors.push(e);
+				goto END;
+			} else if (non_arrow_characters) {
+				e.msg.set("Arrow part contains invalid characters.");
+				err->errors.push(e);
+				goto END;
+			} else if (malformed_arrow) {
+				e.msg.set("Arrow is malformed.");
+				err->errors.push(e);
+				goto END;
+			}
 		}
-		if (arrow_pos == ivec2(-1)) {
-			e.msg.set("Arrow '->' not found.");
-			err->errors.push(e);
-			goto END;
-		} else if (non_arrow_characters) {
-			e.msg.set("Arrow part contains invalid characters.");
-			err->errors.push(e);
-			goto END;
-		} else if (malformed_arrow) {
-			e.msg.set("Arrow is malformed.");
-			err->errors.push(e);
-			goto END;
-		}
-	}
 
-	// check that shapes match
-	{
-		ParserError e;
-		e.tok = t;
-		e.img = full_img;
-		e.show_diagram = true;
-		ivec2 pos = ivec2(0, 0);
-		ivec2 pos_end = maxvec(lhs.end-lhs.start, rhs.end-rhs.start);
-		bool shapes_dont_match = false;
-		while (true) {
-			ivec2 lhs_pos = lhs.start + pos;
-			ivec2 rhs_pos = rhs.start + pos;
-			bool lhs_empty = full_img.inImage(lhs_pos) ? full_img(lhs_pos) == ' ' : true;
-			bool rhs_empty = full_img.inImage(rhs_pos) ? full_img(rhs_pos) == ' ' : true;
-			if (lhs_empty ^ rhs_empty) { // different!
-				e.img_color[lhs_pos.y][lhs_pos.x] = COLOR_ERROR;
-				e.img_color[rhs_pos.y][rhs_pos.x] = COLOR_ERROR;
-				shapes_dont_match = true;
-			}
+		// check that shapes match
+		{
+			ParserError e;
+			e.tok = t;
+			e.img = full_img;
+			e.show_diagram = true;
+			ivec2 pos = ivec2(0, 0);
+			ivec2 pos_end = maxvec(lhs.end-lhs.start, rhs.end-rhs.start);
+			bool shapes_dont_match = false;
+			while (true) {
+				ivec2 lhs_pos = lhs.start + pos;
+				ivec2 rhs_pos = rhs.start + pos;
+				bool lhs_empty = full_img.inImage(lhs_pos) ? full_img(lhs_pos) == ' ' : true;
+				bool rhs_empty = full_img.inImage(rhs_pos) ? full_img(rhs_pos) == ' ' : true;
+				if (lhs_empty ^ rhs_empty) { // different!
+					e.img_color[lhs_pos.y][lhs_pos.x] = COLOR_ERROR;
+					e.img_color[rhs_pos.y][rhs_pos.x] = COLOR_ERROR;
+					shapes_dont_match = true;
+				}
 
-			if (pos.x == pos_end.x) {
-				if (pos.y == pos_end.y) {
-					break;
+				if (pos.x == pos_end.x) {
+					if (pos.y == pos_end.y) {
+						break;
+					} else {
+						pos.x = 0;
+						pos.y += 1;
+					}
 				} else {
-					pos.x = 0;
-					pos.y += 1;
+					pos.x += 1;
 				}
-			} else {
-				pos.x += 1;
+			}
+			if (shapes_dont_match) {
+				e.msg.set("Shape of left and right parts is not the same.");
+				err->errors.push(e);
+				goto END;
 			}
 		}
-		if (shapes_dont_match) {
-			e.msg.set("Shape of left and right parts is not the same.");
-			err->errors.push(e);
-			goto END;
-		}
-	}
 
-	ivec2 lhs_center_pos = ivec2(-1);
-	// parse LHS
-	{
-		ParserError e;
-		e.tok = t;
-		e.img = full_img;
-		e.show_diagram = true;
-		bool center_non_unique = false;
-		for (int y = lhs.start.y; y <= lhs.end.y; ++y) {
-			for (int x = lhs.start.x; x <= lhs.end.x; ++x) {
-				if (comp_img(x,y) == lhs.comp_id) {
-					char key = full_img(x,y);
-					if (key != ' ') {
-						e.img_color[y][x] = COLOR_ERROR; // by default, say this is an error
-						if (key == '@') {
-							if (lhs_center_pos == ivec2(-1)) {
-								lhs_center_pos = ivec2(x,y);
-								e.img_color[y][x] = COLOR_TEXT;
-							} else {
-								center_non_unique = true;
+		ivec2 lhs_center_pos = ivec2(-1);
+		// parse LHS
+		{
+			ParserError e;
+			e.tok = t;
+			e.img = full_img;
+			e.show_diagram = true;
+			bool center_non_unique = false;
+			for (int y = lhs.start.y; y <= lhs.end.y; ++y) {
+				for (int x = lhs.start.x; x <= lhs.end.x; ++x) {
+					if (comp_img(x,y) == lhs.comp_id) {
+						char key = full_img(x,y);
+						if (key != ' ') {
+							e.img_color[y][x] = COLOR_ERROR; // by default, say this is an error
+							if (key == '@') {
+								if (lhs_center_pos == ivec2(-1)) {
+									lhs_center_pos = ivec2(x,y);
+									e.img_color[y][x] = COLOR_TEXT;
+								} else {
+									center_non_unique = true;
+								}
 							}
 						}
 					}
 				}
 			}
-		}
-		if (lhs_center_pos == ivec2(-1)) {
-			e.msg.set("Site marker '@' not found on left part.");
-			err->errors.push(e);
-			goto END;
-		} else if (center_non_unique) {
-			e.msg.set("Multiple site markers '@' found on left part.");
-			err->errors.push(e);
-			goto END;
-		}
-	}
-	ivec2 rhs_center_pos = rhs.start + (lhs_center_pos - lhs.start);
-
-	// check that diagrams don't extend outside the event window
-	{
-		ParserError e;
-		e.tok = t;
-		e.img = full_img;
-		e.show_diagram = true;
-		ivec2 pos = ivec2(0, 0);
-		ivec2 pos_end = maxvec(lhs.end-lhs.start, rhs.end-rhs.start);
-		bool out_of_bounds = false;
-		while (true) {
-			ivec2 lhs_pos = lhs.start + pos;
-			ivec2 rhs_pos = rhs.start + pos;
-			bool lhs_empty = full_img.inImage(lhs_pos) ? full_img(lhs_pos) == ' ' : true;
-			bool rhs_empty = full_img.inImage(rhs_pos) ? full_img(rhs_pos) == ' ' : true;
-			if (!lhs_empty && taxilen(lhs_pos - lhs_center_pos) > 4) {
-				e.img_color[lhs_pos.y][lhs_pos.x] = COLOR_ERROR;
-				out_of_bounds = true;
-			}
-			if (!rhs_empty && taxilen(rhs_pos - rhs_center_pos) > EVENT_WINDOW_RADIUS) {
-				e.img_color[rhs_pos.y][rhs_pos.x] = COLOR_ERROR;
-				out_of_bounds = true;
+			if (lhs_center_pos == ivec2(-1)) {
+				e.msg.set("Site marker '@' not found on left part.");
+				err->errors.push(e);
+				goto END;
+			} else if (center_non_unique) {
+				e.msg.set("Multiple site markers '@' found on left part.");
+				err->errors.push(e);
+				goto END;
 			}
-			if (pos.x == pos_end.x) {
-				if (pos.y == pos_end.y) {
-					break;
+		}
+		ivec2 rhs_center_pos = rhs.start + (lhs_center_pos - lhs.start);
+
+		// check that diagrams don't extend outside the event window
+		{
+			ParserError e;
+			e.tok = t;
+			e.img = full_img;
+			e.show_diagram = true;
+			ivec2 pos = ivec2(0, 0);
+			ivec2 pos_end = maxvec(lhs.end-lhs.start, rhs.end-rhs.start);
+			bool out_of_bounds = false;
+			while (true) {
+				ivec2 lhs_pos = lhs.start + pos;
+				ivec2 rhs_pos = rhs.start + pos;
+				bool lhs_empty = full_img.inImage(lhs_pos) ? full_img(lhs_pos) == ' ' : true;
+				bool rhs_empty = full_img.inImage(rhs_pos) ? full_img(rhs_pos) == ' ' : true;
+				if (!lhs_empty && taxilen(lhs_pos - lhs_center_pos) > 4) {
+					e.img_color[lhs_pos.y][lhs_pos.x] = COLOR_ERROR;
+					out_of_bounds = true;
+				}
+				if (!rhs_empty && taxilen(rhs_pos - rhs_center_pos) > EVENT_WINDOW_RADIUS) {
+					e.img_color[rhs_pos.y][rhs_pos.x] = COLOR_ERROR;
+					out_of_bounds = true;
+				}
+				if (pos.x == pos_end.x) {
+					if (pos.y == pos_end.y) {
+						break;
+					} else {
+						pos.x = 0;
+						pos.y += 1;
+					}
 				} else {
-					pos.x = 0;
-					pos.y += 1;
+					pos.x += 1;
 				}
-			} else {
-				pos.x += 1;
+			}
+			if (out_of_bounds) {
+				e.msg.set(TempStr("Keycodes outside event window (manhattan distance %d).", EVENT_WINDOW_RADIUS));
+				err->errors.push(e);
+				goto END;
 			}
 		}
-		if (out_of_bounds) {
-			e.msg.set(TempStr("Keycodes outside event window (manhattan distance %d).", EVENT_WINDOW_RADIUS));
-			err->errors.push(e);
-			goto END;
-		}
-	}
 
-	// Begin semantic parsing
-	// At this stage, the spatial syntax should all be valid
-	// - center pos != -1 (@ was found)
-	// - lhs and rhs shapes exist, and match in shape
-	for (int i = 0; i < 41; ++i) {
-		ivec2 lhs_pos = lhs_center_pos + getSiteCoord(i);
-		n->diag.lhs[i] = full_img.inImage(lhs_pos) && comp_img(lhs_pos) == lhs.comp_id ? full_img(lhs_pos) : ' ';
-		ivec2 rhs_pos = rhs_center_pos + getSiteCoord(i);
-		n->diag.rhs[i] = full_img.inImage(rhs_pos) && comp_img(rhs_pos) == rhs.comp_id ? full_img(rhs_pos) : ' ';		
+		// Begin semantic parsing
+		// At this stage, the spatial syntax should all be valid
+		// - center pos != -1 (@ was found)
+		// - lhs and rhs shapes exist, and match in shape
+		for (int i = 0; i < 41; ++i) {
+			ivec2 lhs_pos = lhs_center_pos + getSiteCoord(i);
+			n->diag->lhs[i] = full_img.inImage(lhs_pos) && comp_img(lhs_pos) == lhs.comp_id ? full_img(lhs_pos) : ' ';
+			ivec2 rhs_pos = rhs_center_pos + getSiteCoord(i);
+			n->diag->rhs[i] = full_img.inImage(rhs_pos) && comp_img(rhs_pos) == rhs.comp_id ? full_img(rhs_pos) : ' ';		
+		}
 	}
 
 END:
-	n->full_img = full_img;
-	n->comp_img = comp_img;
+	n->diag->full_img = full_img;
+	n->diag->comp_img = comp_img;
 	return n;
 }
 
@@ -499,17 +514,17 @@ Node* parseSectionHeader(Parser* par, Errors* err, Token tok)  {
 				err->add(tok, TempStr("Super of '%.*s' is missing.", element_name.len, element_name.str)); 
 				return NULL;
 			} else {
-				Node* nod = makeNode(node_type, tok);
+				Node* nod = makeNode(par, node_type, tok);
 				nod->int_val = header_depth;
 				nod->str_val = element_name;
 				if (isa_found) {
-					Node* super = makeNode(Node_super, super_tok, StringRange(super_tok.str, super_tok.len));
+					Node* super = makeNode(par, Node_super, super_tok, StringRange(super_tok.str, super_tok.len));
 					addKid(nod, super);
 				}
 				return nod;
 			}
 		} else {
-			Node* nod = makeNode(node_type, tok);
+			Node* nod = makeNode(par, node_type, tok);
 			nod->int_val = header_depth;
 			return nod;
 		}
@@ -532,7 +547,7 @@ Node* parseSymmetriesMetadata(Parser* par, Errors* err, Token meta_tok) {
 				symmetries |= (1 << n);
 			} else {
 				err->add(meta_tok, TempStr("Symmetry '%.*s' not recognized.", tok.len, tok.str));
-				return makeNodeError(tok);
+				return makeNodeError(par, tok);
 			}
 		} break;
 		case Token_identifier: {
@@ -545,16 +560,16 @@ Node* parseSymmetriesMetadata(Parser* par, Errors* err, Token meta_tok) {
 			}
 			if (!known) {
 				err->add(meta_tok, TempStr("Symmetry set '%.*s' not recognized.", tok.len, tok.str));
-				return makeNodeError(tok);
+				return makeNodeError(par, tok);
 			}
 		} break;
 
 		default:
 			err->add(meta_tok, TempStr("Symmetry metadata '%.*s' not recognized.", tok.len, tok.str));
-			return makeNodeError(tok);
+			return makeNodeError(par, tok);
 		}
 	}
-	return makeNode(Node_metadata_symmetries, meta_tok, symmetries);
+	return makeNode(par, Node_metadata_symmetries, meta_tok, symmetries);
 }
 Node* parseRadiusMetadata(Parser* par, Errors* err, Token meta_tok) {
 	Lexer lex = Lexer(meta_tok.str, meta_tok.str + meta_tok.len);
@@ -562,14 +577,14 @@ Node* parseRadiusMetadata(Parser* par, Errors* err, Token meta_tok) {
 	Token tok = lexToken(&lex, err);
 	if (tok.type == Token_number) {
 		if (tok.int_lit >= 0 && tok.int_lit <= 4) {
-			return makeNode(Node_metadata_radius, tok, tok.int_lit);
+			return makeNode(par, Node_metadata_radius, tok, tok.int_lit);
 		} else {
 			err->add(meta_tok, TempStr("Radius metadata '%.*s' must be between 0 and 4.", tok.len, tok.str));
-			return makeNodeError(tok);
+			return makeNodeError(par, tok);
 		}
 	} else {
 		err->add(meta_tok, TempStr("Radius metadata '%.*s' must be a number.", tok.len, tok.str));
-		return makeNodeError(tok);
+		return makeNodeError(par, tok);
 	}
 }
 Node* parseSymbolMetadata(Parser* par, Errors* err, Token meta_tok) {
@@ -578,12 +593,12 @@ Node* parseSymbolMetadata(Parser* par, Errors* err, Token meta_tok) {
 	Token tok = lexToken(&lex, err);
 	if (tok.len > 2) { 
 		err->add(meta_tok, TempStr("Symbol metadata '%.*s' is longer than 2 characters.", tok.len, tok.str));
-		return makeNodeError(tok);
+		return makeNodeError(par, tok);
 	} else if (isLowercaseAlpha(tok.str[0])) {
 		err->add(meta_tok, TempStr("Symbol metadata '%.*s' must start with a capital letter.", tok.len, tok.str));
-		return makeNodeError(tok);
+		return makeNodeError(par, tok);
 	} else {
-		return makeNode(Node_metadata_symbol, tok, StringRange(tok.str, tok.len));
+		return makeNode(par, Node_metadata_symbol, tok, StringRange(tok.str, tok.len));
 	}
 }
 Node* parseColorMetadata(Parser* par, Errors* err, Token meta_tok) {
@@ -601,7 +616,7 @@ Node* parseColorMetadata(Parser* par, Errors* err, Token meta_tok) {
 			dig += 1;
 		} else {
 			err->add(tok, TempStr("Color metadata '%.*s' contains non-hex digit '%c'.", tok.len, tok.str, dig[0]));
-			return makeNodeError(tok);
+			return makeNodeError(par, tok);
 		}
 	}
 	int dig_count = dig - tok.str;
@@ -618,10 +633,10 @@ Node* parseColorMetadata(Parser* par, Errors* err, Token meta_tok) {
 		for (int i = 0; i < 6; ++i)
 			argb |= digs[6 - 1 - i] << (i * 4);
 
-		return makeNode(Node_metadata_color, tok, argb);
+		return makeNode(par, Node_metadata_color, tok, argb);
 	} else {
 		err->add(tok, TempStr("Color metadata '%.*s' should be 3 or 6 digits long.", tok.len, tok.str));
-		return makeNodeError(tok);
+		return makeNodeError(par, tok);
 	}
 }
 StringRange parseLineString(Parser* par, Errors* err, Token tok) {
@@ -643,10 +658,10 @@ StringRange parseLineString(Parser* par, Errors* err, Token tok) {
 	return StringRange(tok.str, tok.len);
 }
 Node* parseAuthorMetadata(Parser* par, Errors* err, Token tok) {
-	return makeNode(Node_metadata_author, tok, parseLineString(par, err, tok));
+	return makeNode(par, Node_metadata_author, tok, parseLineString(par, err, tok));
 }
 Node* parseLicenceMetadata(Parser* par, Errors* err, Token tok) {
-	return makeNode(Node_metadata_licence, tok, parseLineString(par, err, tok));
+	return makeNode(par, Node_metadata_licence, tok, parseLineString(par, err, tok));
 }
 typedef Node* (*MetadataParser)(Parser*, Errors*, Token);
 static MetadataParser metadata_parsers[ARRSIZE(metadata_types)] = {
@@ -682,7 +697,7 @@ Node* parseGroups(Parser* par, Lexer* lex, Errors* err) {
 	} else if (tok.type == Token_newline || tok.type == Token_splat_comment || tok.type == Token_skip) {
 		return parseGroups(par, lex, err);
 	} else if (tok.type == Token_semicolon) {
-		return makeNode(Node_end_statement, tok);
+		return makeNode(par, Node_end_statement, tok);
 	} else if (tok.type == Token_open_brace || tok.type == Token_open_paren) {
 		NodeType type;
 		switch (tok.type) {
@@ -690,7 +705,7 @@ Node* parseGroups(Parser* par, Lexer* lex, Errors* err) {
 		case Token_open_paren: type = Node_parens; break;
 		default: assert(false); break;
 		}
-		Node* n = makeNode(type, tok);
+		Node* n = makeNode(par, type, tok);
 		while (true) {
 			Node* k = parseGroups(par, lex, err);
 			addKid(n, k);
@@ -703,9 +718,9 @@ Node* parseGroups(Parser* par, Lexer* lex, Errors* err) {
 		}
 		return n;
 	} else if (tok.type == Token_close_brace) {
-		return makeNode(Node_braces_end, tok);
+		return makeNode(par, Node_braces_end, tok);
 	} else if (tok.type == Token_close_paren) {
-		return makeNode(Node_parens_end, tok);
+		return makeNode(par, Node_parens_end, tok);
 	} else if (tok.type == Token_spatial_form) {
 		return parseSpatialForm(par, err, tok);
 	} else if (tok.type == Token_section_header) {
@@ -713,13 +728,13 @@ Node* parseGroups(Parser* par, Lexer* lex, Errors* err) {
 	} else if (tok.type == Token_metadata) {
 		return parseMetadata(par, err, tok);
 	} else if (tok.type == Token_identifier) {
-		return makeNode(Node_identifier, tok);
+		return makeNode(par, Node_identifier, tok);
 	} else if (tok.type == Token_keyword) {
-		return makeNode(Node_keyword, tok);
+		return makeNode(par, Node_keyword, tok);
 	} else if (tok.type == Token_number) {
-		return makeNode(Node_integer_literal, tok);
+		return makeNode(par, Node_integer_literal, tok);
 	} else {
-		return makeNode(Node_unknown, tok);
+		return makeNode(par, Node_unknown, tok);
 	}
 }
 
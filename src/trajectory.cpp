@@ -0,0 +1,382 @@
+#include "trajectory.h"
+#include "snapshot.h" // for the element table
+#include "native.h"
+#include "core/log.h"
+#include "core/jobs.h"
+#include "core/cpu_timer.h"
+#include "core/file_stat.h"
+#include "shaders/cpu_gpu_shared.inl" // for the atom type layout
+#include <string.h>
+
+#define TRAJECTORY_BAND_SITES 16384 // sites per band, rounded to whole rows
+
+static u8* putVarint(u8* out, u32 v) {
+	while (v >= 0x80) {
+		*out++ = u8(v | 0x80);
+		v >>= 7;
+	}
+	*out++ = u8(v);
+	return out;
+}
+static const u8* getVarint(const u8* in, const u8* in_end, u32* v) {
+	u32 r = 0;
+	for (int shift = 0; shift < 35 && in < in_end; shift += 7) {
+		u8 b = *in++;
+		r |= u32(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = r;
+			return in;
+		}
+	}
+	return NULL;
+}
+
+namespace {
+
+struct BandCoding {
+	const TrajectoryHeader* header;
+	s64 band_words;
+	s64 total_words;
+	bool keyframe;
+	// encoding
+	const u32* cur;
+	u32* prev;
+	u8* out;
+	s64 capacity;
+	u32* sizes;
+	// decoding
+	u32* site_bits;
+	const u8* const* band_in;
+	const u32* band_in_bytes;
+	int failed;
+};
+
+};
+
+static void fillEmpty(u32* words, s64 count, const u32* empty_atom) {
+	for (s64 i = 0; i < count; i += 4)
+		memcpy(words + i, empty_atom, 4 * sizeof(u32));
+}
+
+static void encodeBandJob(void* data, int band) {
+	BandCoding* c = (BandCoding*)data;
+	s64 begin = band * c->band_words;
+	s64 n = min(c->band_words, c->total_words - begin);
+	const u32* cur = c->cur + begin;
+	u32* prev = c->prev + begin;
+	if (c->keyframe)
+		fillEmpty(prev, n, c->header->empty_atom);
+	u8* out = c->out + band * c->capacity;
+	u8* o = out;
+	s64 i = 0;
+	while (i < n) {
+		// unchanged sites are skipped a whole site at a time, most of the world is unchanged
+		s64 z = i;
+		while (z + 4 <= n && !memcmp(cur + z, prev + z, 4 * sizeof(u32)))
+			z += 4;
+		while (z < n && cur[z] == prev[z])
+			++z;
+		s64 l = z;
+		while (l < n && cur[l] != prev[l])
+			++l;
+		o = putVarint(o, u32(z - i));
+		o = putVarint(o, u32(l - z));
+		for (s64 k = z; k < l; ++k) {
+			u32 x = cur[k] ^ prev[k];
+			memcpy(o, &x, sizeof(u32));
+			o += sizeof(u32);
+			prev[k] = cur[k];
+		}
+		i = l;
+	}
+	c->sizes[band] = u32(o - out);
+}
+
+static void decodeBandJob(void* data, int band) {
+	BandCoding* c = (BandCoding*)data;
+	s64 begin = band * c->band_words;
+	s64 n = min(c->band_words, c->total_words - begin);
+	u32* sites = c->site_bits + begin;
+	if (c->keyframe)
+		fillEmpty(sites, n, c->header->empty_atom);
+	const u8* in = c->band_in[band];
+	const u8* in_end = in + c->band_in_bytes[band];
+	s64 i = 0;
+	while (i < n) {
+		u32 zeros, changed;
+		if (!(in = getVarint(in, in_end, &zeros)) || !(in = getVarint(in, in_end, &changed)) ||
+			i + s64(zeros) + s64(changed) > n || in + s64(changed) * sizeof(u32) > in_end) {
+			c->failed = 1;
+			return;
+		}
+		i += zeros;
+		for (u32 k = 0; k < changed; ++k, ++i, in += sizeof(u32)) {
+			u32 x;
+			memcpy(&x, in, sizeof(u32));
+			sites[i] ^= x;
+		}
+	}
+}
+
+//-----------------------------------------//
+//                 Writer                  //
+//-----------------------------------------//
+
+bool TrajectoryWriter::open(const char* new_pathfile, const NativeWorld* world, const ProgramInfo* info, int keyframe_every) {
+	close();
+	if (world->size == ivec2(0,0) || keyframe_every <= 0) {
+		logError("TRAJECTORY", 0, "Can't record '%s', the world is empty or keyframe_every isn't positive", new_pathfile);
+		return false;
+	}
+	f = fopen(new_pathfile, "wb");
+	if (!f) {
+		logError("TRAJECTORY", 0, "Couldn't open '%s' for writing", new_pathfile);
+		return false;
+	}
+	snprintf(pathfile, sizeof(pathfile), "%s", new_pathfile);
+
+	Bunch<SnapshotElement> elements;
+	Bunch<SnapshotField> fields;
+	snapshotElementTable(info, &elements, &fields);
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	header.version = TRAJECTORY_VERSION;
+	header.header_bytes = sizeof(TrajectoryHeader);
+	header.size_x = world->size.x;
+	header.size_y = world->size.y;
+	header.keyframe_every = u32(keyframe_every);
+	header.band_rows = u32(max(1, TRAJECTORY_BAND_SITES / world->size.x));
+	header.empty_atom[ATOM_TYPE_COMPONENT] = 1u << ATOM_TYPE_LOCAL_OFFSET; // Empty is type 1 and nothing else
+	header.element_count = u32(elements.count);
+	header.field_count = u32(fields.count);
+
+	s64 total_words = s64(world->size.x) * world->size.y * 4;
+	s64 band_words = s64(header.band_rows) * world->size.x * 4;
+	int band_count = int((world->size.y + header.band_rows - 1) / header.band_rows);
+	// a run costs 2 varints, and every run but the first covers at least an unchanged and a changed word, so a band never
+	// takes more than 4 bytes per changed word plus 1 per word and a bit for the runs
+	band_capacity = band_words * 5 + band_words / 64 + 64;
+	prev.setgarbage(total_words);
+	band_bytes.setgarbage(band_capacity * band_count);
+	band_sizes.setgarbage(band_count);
+	index.clear();
+	bytes_raw = 0;
+
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (elements.count)
+		ok &= fwrite(elements.ptr, size_t(elements.bytes()), 1, f) == 1;
+	if (fields.count)
+		ok &= fwrite(fields.ptr, size_t(fields.bytes()), 1, f) == 1;
+	offset = sizeof(header) + u64(elements.bytes()) + u64(fields.bytes());
+	if (!ok) {
+		logError("TRAJECTORY", 0, "Couldn't write to '%s'", pathfile);
+		fclose(f);
+		f = NULL;
+		return false;
+	}
+	logInfo("TRAJECTORY", "Recording %dx%d world to '%s', a keyframe every %d frames", world->size.x, world->size.y, pathfile, keyframe_every);
+	return true;
+}
+
+bool TrajectoryWriter::record(const NativeWorld* world) {
+	if (!f) return false;
+	if (world->size != ivec2(header.size_x, header.size_y)) {
+		logError("TRAJECTORY", 0, "The world was resized, stopped recording '%s'", pathfile);
+		close();
+		return false;
+	}
+	if (index.count && world->dispatch_counter <= index.top().step) {
+		logError("TRAJECTORY", 0, "The world went back to step %u, stopped recording '%s'", world->dispatch_counter, pathfile);
+		close();
+		return false;
+	}
+
+	BandCoding coding;
+	memset(&coding, 0, sizeof(coding));
+	coding.header = &header;
+	coding.band_words = s64(header.band_rows) * header.size_x * 4;
+	coding.total_words = prev.count;
+	coding.keyframe = index.count % header.keyframe_every == 0;
+	coding.cur = world->site_bits.data.ptr;
+	coding.prev = prev.ptr;
+	coding.out = band_bytes.ptr;
+	coding.capacity = band_capacity;
+	coding.sizes = band_sizes.ptr;
+	jobsParallelFor(int(band_sizes.count), encodeBandJob, &coding);
+
+	TrajectoryFrame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.step = world->dispatch_counter;
+	frame.keyframe = coding.keyframe ? 1 : 0;
+	frame.bytes = u64(band_sizes.bytes());
+	for (int b = 0; b < band_sizes.count; ++b)
+		frame.bytes += band_sizes[b];
+	frame.events_since_reset = world->events_since_reset;
+
+	bool ok = fwrite(&frame, sizeof(frame), 1, f) == 1;
+	ok &= fwrite(band_sizes.ptr, size_t(band_sizes.bytes()), 1, f) == 1;
+	for (int b = 0; b < band_sizes.count && ok; ++b)
+		if (band_sizes[b])
+			ok &= fwrite(band_bytes.ptr + b * band_capacity, band_sizes[b], 1, f) == 1;
+	if (!ok) {
+		logError("TRAJECTORY", 0, "Couldn't write to '%s', stopped recording", pathfile);
+		close();
+		return false;
+	}
+	TrajectoryIndexEntry& e = index.push();
+	e.step = frame.step;
+	e.keyframe = frame.keyframe;
+	e.offset = offset;
+	offset += sizeof(frame) + frame.bytes;
+	bytes_raw += u64(prev.bytes());
+	return true;
+}
+
+bool TrajectoryWriter::close() {
+	if (!f) return true;
+	header.frame_count = u32(index.count);
+	header.index_offset = offset;
+	bool ok = !index.count || fwrite(index.ptr, size_t(index.bytes()), 1, f) == 1;
+	ok &= fileSeek(f, 0) && fwrite(&header, sizeof(header), 1, f) == 1;
+	ok &= fclose(f) == 0;
+	f = NULL;
+	if (!ok) {
+		logError("TRAJECTORY", 0, "Couldn't write the index of '%s'", pathfile);
+		return false;
+	}
+	logInfo("TRAJECTORY", "Recorded %d frames to '%s', %d MiB, %.2f%% of the raw site bits", int(index.count), pathfile,
+		int(offset / (1024 * 1024)), bytes_raw ? double(offset) / double(bytes_raw) * 100.0 : 0.0);
+	return true;
+}
+
+//-----------------------------------------//
+//                 Reader                  //
+//-----------------------------------------//
+
+bool TrajectoryReader::open(const char* pathfile) {
+	close();
+	f = fopen(pathfile, "rb");
+	if (!f) {
+		logError("TRAJECTORY", 0, "Couldn't open '%s'", pathfile);
+		return false;
+	}
+	u64 file_bytes = fileSize(f);
+	fileSeek(f, 0);
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0) {
+		logError("TRAJECTORY", 0, "'%s' is not a trajectory", pathfile);
+		close();
+		return false;
+	}
+	if (header.version != TRAJECTORY_VERSION || header.header_bytes != sizeof(TrajectoryHeader)) {
+		logError("TRAJECTORY", 0, "'%s' is trajectory version %u, only version %u is supported", pathfile, header.version, TRAJECTORY_VERSION);
+		close();
+		return false;
+	}
+	if (header.size_x <= 0 || header.size_y <= 0 || header.band_rows == 0 || header.keyframe_every == 0) {
+		logError("TRAJECTORY", 0, "'%s' has a bad header", pathfile);
+		close();
+		return false;
+	}
+
+	index.clear();
+	u64 frames_offset = sizeof(header) + u64(header.element_count) * sizeof(SnapshotElement) + u64(header.field_count) * sizeof(SnapshotField);
+	if (header.index_offset && header.index_offset + u64(header.frame_count) * sizeof(TrajectoryIndexEntry) <= file_bytes) {
+		index.setgarbage(header.frame_count);
+		if (index.count && (!fileSeek(f, header.index_offset) || fread(index.ptr, size_t(index.bytes()), 1, f) != 1)) {
+			logError("TRAJECTORY", 0, "Couldn't read the index of '%s'", pathfile);
+			close();
+			return false;
+		}
+	} else {
+		// never closed, so walk the frames. a frame that was cut off is left out
+		u64 offset = frames_offset;
+		TrajectoryFrame frame;
+		while (fileSeek(f, offset) && fread(&frame, sizeof(frame), 1, f) == 1 && offset + sizeof(frame) + frame.bytes <= file_bytes) {
+			TrajectoryIndexEntry& e = index.push();
+			e.step = frame.step;
+			e.keyframe = frame.keyframe;
+			e.offset = offset;
+			offset += sizeof(frame) + frame.bytes;
+		}
+		logInfo("TRAJECTORY", "'%s' wasn't closed, found %d frames", pathfile, int(index.count));
+	}
+	if (index.count && !index[0].keyframe) {
+		logError("TRAJECTORY", 0, "'%s' doesn't start with a keyframe", pathfile);
+		close();
+		return false;
+	}
+	site_bits.setgarbage(s64(header.size_x) * header.size_y * 4);
+	current = -1;
+	return true;
+}
+
+static bool decodeFrame(TrajectoryReader* r, int i) {
+	TrajectoryFrame frame;
+	if (!fileSeek(r->f, r->index[i].offset) || fread(&frame, sizeof(frame), 1, r->f) != 1)
+		return false;
+	int band_count = int((r->header.size_y + r->header.band_rows - 1) / r->header.band_rows);
+	if (frame.step != r->index[i].step || frame.bytes < u64(band_count) * sizeof(u32))
+		return false;
+	r->frame_bytes.setgarbage(s64(frame.bytes));
+	if (fread(r->frame_bytes.ptr, size_t(frame.bytes), 1, r->f) != 1)
+		return false;
+
+	Bunch<const u8*> band_in;
+	band_in.setgarbage(band_count);
+	const u32* band_in_bytes = (const u32*)r->frame_bytes.ptr;
+	u64 at = u64(band_count) * sizeof(u32);
+	for (int b = 0; b < band_count; ++b) {
+		band_in[b] = r->frame_bytes.ptr + at;
+		at += band_in_bytes[b];
+	}
+	if (at != frame.bytes)
+		return false;
+
+	BandCoding coding;
+	memset(&coding, 0, sizeof(coding));
+	coding.header = &r->header;
+	coding.band_words = s64(r->header.band_rows) * r->header.size_x * 4;
+	coding.total_words = r->site_bits.count;
+	coding.keyframe = frame.keyframe != 0;
+	coding.site_bits = r->site_bits.ptr;
+	coding.band_in = band_in.ptr;
+	coding.band_in_bytes = band_in_bytes;
+	jobsParallelFor(band_count, decodeBandJob, &coding);
+	return !coding.failed;
+}
+
+bool TrajectoryReader::seek(u32 step) {
+	if (!f) return false;
+	// binary search for the frame of the step
+	s64 lo = 0, hi = index.count;
+	while (lo < hi) {
+		s64 mid = (lo + hi) / 2;
+		if (index[mid].step < step) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo == index.count || index[lo].step != step) {
+		logError("TRAJECTORY", 0, "No frame for step %u", step);
+		return false;
+	}
+	int target = int(lo);
+	if (target == current) return true;
+	int key = target;
+	while (!index[key].keyframe)
+		--key;
+	int first = (current >= key && current < target) ? current + 1 : key;
+	for (int i = first; i <= target; ++i) {
+		if (!decodeFrame(this, i)) {
+			logError("TRAJECTORY", 0, "Frame %d (step %u) is corrupt", i, index[i].step);
+			current = -1;
+			return false;
+		}
+		current = i;
+	}
+	return true;
+}
+
+void TrajectoryReader::close() {
+	if (f) fclose(f);
+	f = NULL;
+	current = -1;
+}
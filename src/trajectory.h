@@ -0,0 +1,81 @@
+#pragma once
+#include "core/basic_types.h"
+#include "core/container.h"
+#include <stdio.h>
+
+struct NativeWorld;
+struct ProgramInfo;
+
+// Trajectory file: the site bits of a world at every recorded step. Every keyframe_every frames a keyframe holds the
+// whole world, the frames in between only what changed since the frame before. Both are coded the same way, as the
+// XOR against a reference (an all Empty world for keyframes, the previous frame otherwise), run length coded in words:
+// a varint count of unchanged words, a varint count of changed words, then the changed words' XOR, and so on.
+// The world is split into bands of band_rows rows that are coded independently, so recording and replay run in parallel.
+// An index of every frame goes at the end when the file is closed, so any step is one keyframe plus at most
+// keyframe_every - 1 deltas away. Files that were never closed are indexed by walking the frames instead.
+// Only the site bits are stored: enough to look at and analyze a run, not to resume it (that's what snapshots are for).
+
+#define TRAJECTORY_MAGIC "MFMTRAJ"
+#define TRAJECTORY_VERSION 2
+
+struct TrajectoryHeader {
+	char magic[8];
+	u32 version;
+	u32 header_bytes;
+	s32 size_x, size_y;
+	u32 keyframe_every;
+	u32 band_rows;
+	u32 empty_atom[4];  // the reference atom of keyframes
+	u32 element_count;  // SnapshotElement table right after the header
+	u32 field_count;    // then the SnapshotField table
+	u32 frame_count;    // 0 until the file is closed
+	u32 pad;
+	u64 index_offset;   // frame_count TrajectoryIndexEntry, 0 until the file is closed
+};
+
+// followed by one u32 byte count per band, then the bands
+struct TrajectoryFrame {
+	u32 step;
+	u32 keyframe;
+	u64 bytes; // everything after this struct
+	s64 events_since_reset;
+};
+
+struct TrajectoryIndexEntry {
+	u32 step;
+	u32 keyframe;
+	u64 offset; // of the TrajectoryFrame
+};
+
+struct TrajectoryWriter {
+	FILE* f = NULL;
+	TrajectoryHeader header;
+	Bunch<TrajectoryIndexEntry> index;
+	Bunch<u32> prev;              // site bits of the last recorded frame
+	Bunch<u8> band_bytes;         // coded bands of the frame being written, band_capacity bytes per band
+	Bunch<u32> band_sizes;
+	s64 band_capacity = 0;
+	u64 offset = 0;
+	u64 bytes_raw = 0;            // site bits of every recorded frame, for the compression ratio
+	char pathfile[256];
+
+	// steps of 'world' can be recorded until close, as long as its size stays the same and the steps keep going up
+	bool open(const char* pathfile, const NativeWorld* world, const ProgramInfo* info, int keyframe_every);
+	bool record(const NativeWorld* world);
+	bool close();
+	bool isOpen() const { return f != NULL; }
+};
+
+struct TrajectoryReader {
+	FILE* f = NULL;
+	TrajectoryHeader header;
+	Bunch<TrajectoryIndexEntry> index;
+	Bunch<u32> site_bits;         // 4 u32 per site, row major, the frame at 'current'
+	int current = -1;             // index entry in site_bits, -1 for none
+	Bunch<u8> frame_bytes;
+
+	bool open(const char* pathfile);
+	// decodes the frame of 'step' into site_bits, continuing from the current frame when that's on the way
+	bool seek(u32 step);
+	void close();
+};
@@ -21,11 +21,13 @@ void World::destroy() {
 	      color.destroy();
 	event_count.destroy();
 	        dev.destroy();
+	event_count_compact.destroy();
+	        dev_compact.destroy();
 
 	size = ivec2(0,0);
 }
-bool World::resize(ivec2 new_size) {
-	if (size == new_size) return false;
+bool World::resize(ivec2 new_size, u32 new_layout) {
+	if (size == new_size && layout == new_layout) return false;
 
 	VkResult err;
 
@@ -43,22 +45,40 @@ bool World::resize(ivec2 new_size) {
 
 	if (  !site_bits.resize(new_size, command_buffer)) { destroy(); return true; }
 	if (      !color.resize(new_size, command_buffer)) { destroy(); return true; }
-	if (!event_count.resize(new_size, command_buffer)) { destroy(); return true; }
-	if (        !dev.resize(new_size, command_buffer)) { destroy(); return true; }
+	if (new_layout & WorldLayout_compact) {
+		if (!event_count_compact.resize(new_size, command_buffer)) { destroy(); return true; }
+		if (        !dev_compact.resize(new_size, command_buffer)) { destroy(); return true; }
+	} else {
+		if (!event_count.resize(new_size, command_buffer)) { destroy(); return true; }
+		if (        !dev.resize(new_size, command_buffer)) { destroy(); return true; }
+	}
 
-	if ( !prng_state.resize(paddedSize(new_size), command_buffer)) { destroy(); return true; }
+	// the image is still bound in counter prng mode, but never touched
+	if ( !prng_state.resize((new_layout & WorldLayout_counter_prng) ? ivec2(1,1) : paddedSize(new_size), command_buffer)) { destroy(); return true; }
 	if (       !vote.resize(paddedSize(new_size), command_buffer)) { destroy(); return true; }
 
 	evkEndCommandBufferAndSubmit(command_buffer);
 
 	size = new_size;
+	layout = new_layout;
+
+	// the padded maps (prng, vote) are charged to the sites of the world proper
+	double sites = double(size.x) * size.y;
+	double prng_b = double(prng_state.bytes) / sites;
+	double event_count_b = double(event_count.bytes + event_count_compact.bytes) / sites;
+	double dev_b = double(dev.bytes + dev_compact.bytes) / sites;
+	double total_b = prng_b + double(site_bits.bytes + vote.bytes + color.bytes) / sites + event_count_b + dev_b;
+	logInfo("WORLD", "%dx%d (%s layout), %.1f B per site, %d MiB total: prng %.1f, site bits %.1f, vote %.1f, color %.1f, event count %.1f, dev %.1f",
+		size.x, size.y, (layout & WorldLayout_compact) ? "compact" : "full", total_b, int(total_b * sites / (1024.0 * 1024.0)),
+		prng_b, double(site_bits.bytes) / sites, double(vote.bytes) / sites, double(color.bytes) / sites, event_count_b, dev_b);
 
 	//#TODO this is copied in update descriptor sets below, centralize.
 	VkImageView* draw_views[] = { &color_draw_view, &dev_draw_view };
 	// Create render view:
 	{
-		VkImage images[] = { color.image, dev.image };
-		VkFormat formats[] = { VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R32G32B32A32_UINT };
+		bool compact = (layout & WorldLayout_compact) != 0;
+		VkImage images[] = { color.image, compact ? dev_compact.image : dev.image };
+		VkFormat formats[] = { VK_FORMAT_R8G8B8A8_UNORM, compact ? VK_FORMAT_R8_UINT : VK_FORMAT_R32G32B32A32_UINT };
 		for (int i = 0; i < ARRSIZE(draw_views); ++i) {
 			VkImageViewCreateInfo info = {};
 			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -84,7 +104,9 @@ void World::updateDescriptorSets(VkDescriptorSet update_descriptor_set, VkDescri
 
 	// Update compute descriptor set:
 	{
-		VkImageView views[] = { prng_state.view, site_bits.view, vote.view, color.view, event_count.view, dev.view };
+		bool compact = (layout & WorldLayout_compact) != 0;
+		VkImageView views[] = { prng_state.view, site_bits.view, vote.view, color.view,
+			compact ? event_count_compact.view : event_count.view, compact ? dev_compact.view : dev.view };
 		VkWriteDescriptorSet write_desc[ARRSIZE(views)] = { };
 		VkDescriptorImageInfo desc_image[ARRSIZE(views)][1] = { };
 		for (int i = 0; i < ARRSIZE(views); ++i) {
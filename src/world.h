@@ -1,11 +1,14 @@
 #pragma once
 #include "core/vec2.h"
+#include "core/basic_types.h"
 #include "wrap/evk.h"
 
 template<VkFormat FORMAT>
 struct StateMap {
 	ivec2    size   = ivec2(3,8);
 
+	VkDeviceSize   bytes  = 0; // actual allocation
+
 	// handles
 	VkImage        image  = VK_NULL_HANDLE;
 	VkDeviceMemory memory = VK_NULL_HANDLE;
@@ -16,6 +19,7 @@ struct StateMap {
 		if (image)  { vkDestroyImage(evk.dev, image, evk.alloc);    image  = VK_NULL_HANDLE; }
 		if (memory) { vkFreeMemory(evk.dev, memory, evk.alloc);     memory = VK_NULL_HANDLE; }
 		size = ivec2(0,0);
+		bytes = 0;
 	}
 	bool resize(ivec2 new_size, VkCommandBuffer command_buffer) {
 		if (new_size == size) return true; 
@@ -39,7 +43,7 @@ struct StateMap {
 			info.arrayLayers = 1;
 			info.samples = VK_SAMPLE_COUNT_1_BIT;
 			info.tiling = VK_IMAGE_TILING_OPTIMAL;
-			info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+			info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // transfer for the recorder
 			info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			err = vkCreateImage(evk.dev, &info, evk.alloc, &image);
@@ -57,6 +61,7 @@ struct StateMap {
 			err = vkBindImageMemory(evk.dev, image, memory, 0);
 			evkCheckError(err);
 			if (err) { destroy(); return false; }
+			bytes = alloc_info.allocationSize;
 			logInfo("IMAGE", "Resized to %dx%d, %d MiB (%d B)", size.x, size.y, alloc_info.allocationSize / (1024 * 1024), alloc_info.allocationSize);
 		}
 
@@ -94,6 +99,13 @@ struct StateMap {
 	}
 };
 
+// Has to match the shaders: WorldLayout_counter_prng comes from the SPLAT compiler's counter prng switch,
+// WorldLayout_compact from the WORLD_COMPACT_LAYOUT define in the procedural shaders/world_layout.inl.
+enum WorldLayoutFlags {
+	WorldLayout_counter_prng = 1 << 0, // no per site prng state, prng_state is a 1x1 placeholder
+	WorldLayout_compact      = 1 << 1, // 16 bit saturating event counts, and an 8 bit 'site updated' flag instead of dev
+};
+
 struct World {
 	StateMap<VK_FORMAT_R32G32B32A32_UINT> prng_state;
 	StateMap<VK_FORMAT_R32G32B32A32_UINT> site_bits;
@@ -101,14 +113,17 @@ struct World {
 	StateMap<VK_FORMAT_R8G8B8A8_UINT> color;
 	StateMap<VK_FORMAT_R32_UINT> event_count;
 	StateMap<VK_FORMAT_R32G32B32A32_UINT> dev;
+	StateMap<VK_FORMAT_R16_UINT> event_count_compact; // these two replace event_count and dev in the compact layout
+	StateMap<VK_FORMAT_R8_UINT> dev_compact;
 
 	ivec2 size = ivec2(0,0);
+	u32 layout = 0; // WorldLayoutFlags
 
 	VkImageView color_draw_view = VK_NULL_HANDLE;
 	VkImageView dev_draw_view = VK_NULL_HANDLE;
 
 	void destroy();
-	bool resize(ivec2 new_size);
+	bool resize(ivec2 new_size, u32 new_layout = 0);
 	void updateDescriptorSets(VkDescriptorSet update_descriptor_set, VkDescriptorSet draw_descriptor_set, VkSampler draw_sampler);
 	ivec2 voteMapSize() const;
 };
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "world_image.h"
+#include "native.h"
+#include "splat_compiler.h"
+#include "core/log.h"
+#include "core/jobs.h"
+#include "shaders/cpu_gpu_shared.inl" // for the atom type layout
+#include "stb/stb_image_write.h"
+
+#define WORLD_IMAGE_UNKNOWN_TYPE 0xffff00ff // ABGR, the magenta the render stage gives types it doesn't know
+
+void WorldImagePalette::build(const ProgramInfo* info, const NativeModule* native_module) {
+	colors.clear();
+	for (int i = 0; i < info->elems.count; ++i)
+		colors.push(info->elems[i].color);
+	module = native_module;
+}
+
+struct WorldImageJob {
+	const u32* site_bits;
+	ivec2 size;
+	const WorldImagePalette* palette;
+	NativeWorldView view; // for the module's getColor
+	int downsample;
+	ivec2 image_size;
+	u8* rgb;
+};
+
+static inline u32 siteColor(const WorldImageJob* job, int x, int y) {
+	const WorldImagePalette* palette = job->palette;
+	if (palette->module) {
+		u32 argb = palette->module->color(&job->view, x, y);
+		return 0xff000000 | ((argb & 0xff) << 16) | (argb & 0xff00) | ((argb >> 16) & 0xff);
+	}
+	const u32* A = job->site_bits + (size_t(y) * job->size.x + x) * 4;
+	u32 type = (A[ATOM_TYPE_COMPONENT] >> ATOM_TYPE_LOCAL_OFFSET) & ATOM_TYPE_BITMASK;
+	return type < u32(palette->colors.count) ? palette->colors[type] : WORLD_IMAGE_UNKNOWN_TYPE;
+}
+
+static void renderRow(void* data, int image_y) {
+	const WorldImageJob* job = (const WorldImageJob*)data;
+	int d = job->downsample;
+	u8* out = job->rgb + size_t(image_y) * job->image_size.x * 3;
+	if (d == 1) {
+		for (int x = 0; x < job->size.x; ++x) {
+			u32 c = siteColor(job, x, image_y);
+			out[x * 3 + 0] = u8(c);
+			out[x * 3 + 1] = u8(c >> 8);
+			out[x * 3 + 2] = u8(c >> 16);
+		}
+		return;
+	}
+	int y0 = image_y * d;
+	int y1 = min(y0 + d, job->size.y);
+	for (int image_x = 0; image_x < job->image_size.x; ++image_x) {
+		int x0 = image_x * d;
+		int x1 = min(x0 + d, job->size.x);
+		u64 r = 0, g = 0, b = 0; // a 16k world down to one pixel would overflow 32 bits
+		for (int y = y0; y < y1; ++y) {
+			for (int x = x0; x < x1; ++x) {
+				u32 c = siteColor(job, x, y);
+				r += c & 0xff;
+				g += (c >> 8) & 0xff;
+				b += (c >> 16) & 0xff;
+			}
+		}
+		u64 n = u64(x1 - x0) * u64(y1 - y0);
+		out[image_x * 3 + 0] = u8((r + n / 2) / n);
+		out[image_x * 3 + 1] = u8((g + n / 2) / n);
+		out[image_x * 3 + 2] = u8((b + n / 2) / n);
+	}
+}
+
+ivec2 worldImageRender(const u32* site_bits, ivec2 size, const WorldImagePalette* palette, int downsample, Bunch<u8>* rgb) {
+	WorldImageJob job;
+	job.site_bits = site_bits;
+	job.size = size;
+	job.palette = palette;
+	job.view = NativeWorldView();
+	job.view.site_bits = (unsigned int*)site_bits; // getColor only loads the site itself
+	job.view.size_x = size.x;
+	job.view.size_y = size.y;
+	job.downsample = max(downsample, 1);
+	job.image_size = (size + ivec2(job.downsample - 1)) / job.downsample;
+	rgb->setgarbage(s64(job.image_size.x) * job.image_size.y * 3);
+	job.rgb = rgb->ptr;
+	jobsParallelFor(job.image_size.y, renderRow, &job);
+	return job.image_size;
+}
+
+bool worldImageSave(const char* pathfile, const u32* site_bits, ivec2 size, const WorldImagePalette* palette, int downsample) {
+	static Bunch<u8> rgb;
+	ivec2 image_size = worldImageRender(site_bits, size, palette, downsample, &rgb);
+	if (image_size.x <= 0 || image_size.y <= 0) {
+		logError("IMAGE", 0, "Nothing to write to '%s', the world is empty", pathfile);
+		return false;
+	}
+	if (!stbi_write_png(pathfile, image_size.x, image_size.y, 3, rgb.ptr, image_size.x * 3)) {
+		logError("IMAGE", 0, "Couldn't write '%s'", pathfile);
+		return false;
+	}
+	return true;
+}
+
+int worldImageDownsample(ivec2 size, int max_side) {
+	if (max_side <= 0) return 1;
+	int side = max(size.x, size.y);
+	return max((side + max_side - 1) / max_side, 1);
+}
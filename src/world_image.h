@@ -0,0 +1,27 @@
+#pragma once
+#include "core/basic_types.h"
+#include "core/vec2.h"
+#include "core/container.h"
+
+struct ProgramInfo;
+struct NativeModule;
+
+// Renders site bits to an image on the cpu, with the colors STAGE_RENDER would give them, for runs without a gpu.
+// Every type gets its ElementInfo::color from the palette, or, with a native module in the palette, the element's
+// getColor of every site, for colors that depend on the atom's data. Big worlds are box filtered down by an integer
+// factor: a pixel is the average of downsample x downsample sites, fewer at the right and bottom edge. Rows of the
+// image are rendered in parallel.
+
+struct WorldImagePalette {
+	Bunch<u32> colors;                 // ABGR per type, so R,G,B,A in memory
+	const NativeModule* module = NULL; // colors come from its getColor for every site instead of the palette
+
+	void build(const ProgramInfo* info, const NativeModule* module = NULL);
+};
+
+// site_bits has 4 u32 per site, row major. 'rgb' gets the ceil(size / downsample) image, 3 bytes per pixel.
+ivec2 worldImageRender(const u32* site_bits, ivec2 size, const WorldImagePalette* palette, int downsample, Bunch<u8>* rgb);
+// renders the image and writes it as a png
+bool worldImageSave(const char* pathfile, const u32* site_bits, ivec2 size, const WorldImagePalette* palette, int downsample);
+// the smallest downsample that gets the larger side of the world down to max_side pixels or less
+int worldImageDownsample(ivec2 size, int max_side);
@@ -6,6 +6,9 @@
 #include "core/runprog.h"      // for calling compiler
 #include "core/container.h"    // for surface results
 #include "core/cpu_timer.h"
+#ifdef EVK_SHADERC
+#include <shaderc/shaderc.h>
+#endif
 
 static int getMinImageCountFromPresentMode(VkPresentModeKHR present_mode);
 static void destroyAllFramesAndSemaphores();
@@ -14,6 +17,9 @@ EasyVk evk;
 static bool swapchain_changed = false;
 static ivec2 new_swapchain_res = ivec2(0);
 static bool minimized = true;
+#ifdef EVK_SHADERC
+static shaderc_compiler_t shaderc = NULL; // thread safe, shaders compile on the job threads
+#endif
 
 const char* errorString(VkResult errorCode) {
 	switch (errorCode)
@@ -208,6 +214,11 @@ void evkInit(const char** extensions, uint32_t extensions_count) {
         err = vkCreateDescriptorPool(evk.dev, &pool_info, evk.alloc, &evk.desc_pool);
         check_vk_result(err);
     }
+
+#ifdef EVK_SHADERC
+	shaderc = shaderc_compiler_initialize();
+	assert(shaderc);
+#endif
 }
 void evkTerm() {
 	destroyAllFramesAndSemaphores();
@@ -223,6 +234,11 @@ void evkTerm() {
     vkDestroyDebugReportCallbackEXT(evk.inst, evk.debug, evk.alloc);
     vkDestroyDevice(evk.dev, evk.alloc);
     vkDestroyInstance(evk.inst, evk.alloc);
+
+#ifdef EVK_SHADERC
+	shaderc_compiler_release(shaderc);
+	shaderc = NULL;
+#endif
 }
 
 void evkNotifyOfWindow(ivec2 new_resolution) {
@@ -253,14 +269,12 @@ bool evkWindowIsMinimized() {
 
 
 VkShaderModule evkCreateShaderFromFile(const char* pathfile, String* output) {
-	VkResult err;
-
 	// Delete the previous compiled binary, if any. This ensures that if the shader is buggy, we're not left with a stale binary.
 	fileDelete(TempStr("%s.spv", pathfile));
 
 	s64 t_start = time_counter();
 	log("[SHADER COMPILER] Starting...\n");
-	runProg(TempStr("glslc -Os -o %s.spv %s", pathfile, pathfile), output);
+	runProg(TempStr("glslc " EVK_GLSLC_FLAGS " -o %s.spv %s", pathfile, pathfile), output);
 	s64 t_run = time_counter() - t_start;
 	if (output && output->len) {
 		log("--- Output ---\n\n");
@@ -279,17 +293,142 @@ VkShaderModule evkCreateShaderFromFile(const char* pathfile, String* output) {
 	//#TODO what about stale spv? or stale inputs?
 
 	VkShaderModule module = VK_NULL_HANDLE;
+	size_t code_size = 0;
+	char* code = fileReadBinaryIntoMem(TempStr("%s.spv", pathfile), &code_size);
+	if (code) {
+		module = evkCreateShaderFromSpirv(code, code_size);
+		free(code);
+	}
+
+	return module;
+}
+VkShaderModule evkCreateShaderFromSpirv(const void* code, size_t bytes) {
+	VkShaderModule module = VK_NULL_HANDLE;
     VkShaderModuleCreateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	info.pCode = (uint32_t*)fileReadBinaryIntoMem(TempStr("%s.spv", pathfile), &info.codeSize);
-	if (info.pCode) {
-		err = vkCreateShaderModule(evk.dev, &info, evk.alloc, &module);
-		check_vk_result(err);
-		free((void*)info.pCode);
+	info.codeSize = bytes;
+	info.pCode = (const uint32_t*)code;
+	VkResult err = vkCreateShaderModule(evk.dev, &info, evk.alloc, &module);
+	check_vk_result(err);
+	return module;
+}
+#ifdef EVK_SHADERC
+// the shaderc options that match EVK_GLSLC_FLAGS, so both backends make the same shaders
+static void setOptionsFromFlags(shaderc_compile_options_t options, const char* flags) {
+	const char* f = flags;
+	while (*f) {
+		while (*f == ' ') ++f;
+		const char* end = f;
+		while (*end && *end != ' ') ++end;
+		StringRange flag(f, size_t(end - f));
+		if (flag == StringRange("-O0")) shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_zero);
+		else if (flag == StringRange("-O")) shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+		else if (flag == StringRange("-Os")) shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_size);
+		else if (flag == StringRange("-g")) shaderc_compile_options_set_generate_debug_info(options);
+		else if (flag == StringRange("-w")) shaderc_compile_options_set_suppress_warnings(options);
+		else if (flag == StringRange("-Werror")) shaderc_compile_options_set_warnings_as_errors(options);
+		else if (flag.len > 2 && flag.str[0] == '-' && flag.str[1] == 'D') {
+			const char* name = flag.str + 2;
+			const char* eq = (const char*)memchr(name, '=', size_t(end - name));
+			if (eq) shaderc_compile_options_add_macro_definition(options, name, size_t(eq - name), eq + 1, size_t(end - eq - 1));
+			else shaderc_compile_options_add_macro_definition(options, name, size_t(end - name), NULL, 0);
+		} else if (flag.len) {
+			logError("EVK", 0, "libshaderc has no option for '%.*s' in EVK_GLSLC_FLAGS, it's left out", int(flag.len), flag.str);
+		}
+		f = end;
+	}
+}
+
+static const char* findIn(StringRange s, const char* needle) {
+	size_t n = strlen(needle);
+	for (size_t i = 0; i + n <= s.len; ++i)
+		if (!memcmp(s.str + i, needle, n))
+			return s.str + i;
+	return NULL;
+}
+// Splits shaderc's messages, lines like "name:12: error: 'x' : undeclared identifier", into diagnostics. The "2 errors
+// generated." at the end is left out, the counts come with the result.
+static void parseDiagnostics(const char* message, const char* name, Bunch<EvkShaderDiagnostic>* diagnostics) {
+	static const struct { const char* tag; EvkShaderSeverity severity; } tags[] = {
+		{ ": error: ", EvkShaderSeverity_error },
+		{ ": warning: ", EvkShaderSeverity_warning },
+	};
+	const char* l = message;
+	while (*l) {
+		const char* l_end = strchr(l, '\n');
+		if (!l_end) l_end = l + strlen(l);
+		StringRange line(l, size_t(l_end - l));
+		l = *l_end ? l_end + 1 : l_end;
+		while (line.len && (line.str[line.len - 1] == '\r' || line.str[line.len - 1] == ' '))
+			line.len -= 1;
+		if (!line.len || findIn(line, " generated."))
+			continue;
+
+		EvkShaderDiagnostic& d = diagnostics->push();
+		d = EvkShaderDiagnostic();
+		d.severity = EvkShaderSeverity_note;
+		StringRange file = StringRange(name);
+		StringRange text = line;
+		for (int t = 0; t < ARRSIZE(tags); ++t) {
+			const char* tag = findIn(line, tags[t].tag);
+			if (!tag) continue;
+			d.severity = tags[t].severity;
+			text = StringRange(tag + strlen(tags[t].tag), size_t(line.str + line.len - tag) - strlen(tags[t].tag));
+			// before the tag is "file:line", or just "file" for messages about the whole shader
+			const char* digits = tag;
+			while (digits > line.str && digits[-1] >= '0' && digits[-1] <= '9')
+				--digits;
+			if (digits < tag && digits > line.str && digits[-1] == ':') {
+				file = StringRange(line.str, size_t(digits - 1 - line.str));
+				for (const char* c = digits; c < tag; ++c)
+					d.line = d.line * 10 + (*c - '0');
+			} else {
+				file = StringRange(line.str, size_t(tag - line.str));
+			}
+			break;
+		}
+		d.file.set(file.str, file.len);
+		d.text.set(text.str, text.len);
+	}
+}
+
+VkShaderModule evkCreateShaderFromText(const char* name, const char* text, size_t text_len, Bunch<EvkShaderDiagnostic>* diagnostics, String* spirv) {
+	shaderc_shader_kind kind = shaderc_glsl_infer_from_source;
+	const char* ext = strrchr(name, '.');
+	if (ext) {
+		if (!strcmp(ext, ".vert")) kind = shaderc_glsl_vertex_shader;
+		else if (!strcmp(ext, ".frag")) kind = shaderc_glsl_fragment_shader;
+		else if (!strcmp(ext, ".comp")) kind = shaderc_glsl_compute_shader;
+		else if (!strcmp(ext, ".geom")) kind = shaderc_glsl_geometry_shader;
+		else if (!strcmp(ext, ".tesc")) kind = shaderc_glsl_tess_control_shader;
+		else if (!strcmp(ext, ".tese")) kind = shaderc_glsl_tess_evaluation_shader;
 	}
 
+	s64 t_start = time_counter();
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	setOptionsFromFlags(options, EVK_GLSLC_FLAGS);
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(shaderc, text, text_len, kind, name, "main", options);
+	shaderc_compile_options_release(options);
+	s64 t_run = time_counter() - t_start;
+
+	const char* message = shaderc_result_get_error_message(result);
+	if (diagnostics && message)
+		parseDiagnostics(message, name, diagnostics);
+	log("[SHADER COMPILER] %s done in process, %d errors, %d warnings (%.1f sec)\n", name,
+		int(shaderc_result_get_num_errors(result)), int(shaderc_result_get_num_warnings(result)), time_to_sec(t_run));
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success) {
+		const char* code = shaderc_result_get_bytes(result);
+		size_t code_size = shaderc_result_get_length(result);
+		module = evkCreateShaderFromSpirv(code, code_size);
+		if (spirv)
+			spirv->set(code, code_size);
+	}
+	shaderc_result_release(result);
 	return module;
 }
+#endif
 uint32_t evkMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits) {
     VkPhysicalDeviceMemoryProperties prop;
     vkGetPhysicalDeviceMemoryProperties(evk.phys_dev, &prop);
@@ -6,6 +6,7 @@
 #include "core/vec2.h"
 #include "core/basic_types.h"
 #include "core/string_range.h" // for shader compiler output
+#include "core/container.h"    // for shader diagnostics
 
 
 // Helper structure to hold the data needed by one rendering frame
@@ -80,7 +81,33 @@ void evkNotifyOfWindow(ivec2 new_resolution);
 bool evkCheckForSwapchainChanges();
 bool evkWindowIsMinimized();
 
+#define EVK_GLSLC_FLAGS "-Os" // the shader loader keys its spir-v cache on these, so the cache misses when they change
+#ifdef EVK_SHADERC
+#define EVK_SHADER_BACKEND "shaderc" // also in the cache key, the two can make different spir-v from the same flags
+#else
+#define EVK_SHADER_BACKEND "glslc"
+#endif
+// Compiles a glsl file with glslc, leaving the spir-v in '<pathfile>.spv'
 VkShaderModule evkCreateShaderFromFile(const char* pathfile, String* output = NULL);
+VkShaderModule evkCreateShaderFromSpirv(const void* code, size_t bytes);
+#ifdef EVK_SHADERC
+enum EvkShaderSeverity {
+	EvkShaderSeverity_error,
+	EvkShaderSeverity_warning,
+	EvkShaderSeverity_note, // any other line of the compiler's output
+};
+struct EvkShaderDiagnostic {
+	String file;
+	int line; // 0 if it isn't about a line
+	EvkShaderSeverity severity;
+	String text;
+	void free() { file.free(); text.free(); }
+};
+// Compiles glsl text in memory with libshaderc, no files or processes, with the options EVK_GLSLC_FLAGS stands for.
+// 'name' picks the stage by its extension like glslc does, 'diagnostics' gets the errors and warnings, 'spirv' the code.
+// The diagnostics are appended, their strings are the caller's to free.
+VkShaderModule evkCreateShaderFromText(const char* name, const char* text, size_t text_len, Bunch<EvkShaderDiagnostic>* diagnostics = NULL, String* spirv = NULL);
+#endif
 
 uint32_t evkMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits);
 int  evkMinImageCount();
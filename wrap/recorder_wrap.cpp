@@ -1,22 +1,22 @@
 #include "recorder_wrap.h"
 #include "imgui/imgui.h"
-//#include "jogif/jogif.h"
 #include "wrap/app_wrap.h"
 #include "core/maths.h"
 #include "core/file_stat.h"
+#include "core/dir.h"
+#include "core/log.h"
+#include "core/container.h"
 #include "stb/stb_image_write.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #include "evk.h"
 
-#define BPP 3
-
-void drawReadPixels(int x, int y, int width, int height, unsigned char* rgb_pixels) {
-	assert(false);
-	//glReadPixels(x,y,width,height, GL_RGB, GL_UNSIGNED_BYTE, rgb_pixels);
-}
-
 struct RecSource {
 	const char* name = 0;
 	int w = 0;
@@ -24,11 +24,15 @@ struct RecSource {
 };
 
 #define SCREENSHOT 0
-#define GIF 1
+#define PNG_SEQUENCE 1
+#define Y4M 2
 #define FILENAME_SIZE 64
-#define FILENAME_SUFFIX_SIZE (4+3) //.png/gif + _nn for number suffix
+#define FILENAME_SUFFIX_SIZE (4+6) //.png/.y4m + _nnnnn for number suffix
+#define PATHFILE_SIZE (FILENAME_SIZE + 16)
 #define IMG_DIRECTORY "screenshots"
 #define VID_DIRECTORY "videos"
+#define REC_RING_SIZE 4   // frames that can be copying or encoding at once
+#define REC_ENCODERS 2    // png encoding is what takes the time, so frames get encoded side by side
 
 #define MAX_SOURCES 8
 static RecSource sources[MAX_SOURCES];
@@ -39,57 +43,365 @@ static bool snap = false;
 static int mode = SCREENSHOT;
 static int source_idx = 0;
 static int source_count = 0;
-static unsigned char* frame = 0;
-static int frame_bytesize = 0;
-static bool frame_valid = false;
-//static jo_gif_t gif;
+static int video_fps = 60;
+static int rec_frame = 0;        // frames captured of the current recording
+static int rec_waits = 0;        // frames that had to wait for a free buffer
+static char rec_pathfile[PATHFILE_SIZE] = "";
+static bool video_close = false; // the video ends once the frames still in flight are queued
 
-void recFrame(const char* name, int x, int y, int w, int h) {
-	if (source_count >= MAX_SOURCES) return;
+enum RecSlotState {
+	RecSlot_free,
+	RecSlot_recorded,  // copy recorded into this frame's command buffer, no fence submitted yet
+	RecSlot_in_flight, // fence submitted, waiting for it to signal
+	RecSlot_encoding,  // with the encoders
+};
 
-	ivec2 res = ivec2(evk.win.Width, evk.win.Height);
+struct RecSlot {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize bytes = 0;
+	bool coherent = true;
+	const u8* mapped = NULL;   // persistently mapped
+	VkFence fence = VK_NULL_HANDLE;
+	RecSlotState state = RecSlot_free;
+	u64 seq = 0;               // capture order
+	int mode = SCREENSHOT;
+	ivec2 size;
+	char pathfile[PATHFILE_SIZE];
+};
 
-	x = max(0, min(res.x-1,x));
-	y = max(0, min(res.y-1,y));
-	w = min(res.x-x, w);
-	h = min(res.y-y, h);
+// slot -1 closes the video
+struct RecJob {
+	int slot;
+	u64 seq;
+};
 
-	RecSource& src = sources[source_count];
-	src.name = name;
-	src.w = w;
-	src.h = h;
-
-	if ((recording || snap) && source_idx == source_count) {
-		int size = src.w*src.h*BPP;
-		if (size > frame_bytesize) {
-			if (frame)  { free(frame); frame = NULL; }
-			frame = (unsigned char*)malloc(size);
-			if (frame)
-				frame_bytesize = size;
+// Slot states and the job queue are guarded by mutex. The y4m file is written in capture order, every job takes its
+// turn at write_seq once it's done converting, even those that don't write to it.
+struct RecEncoders {
+	std::thread threads[REC_ENCODERS];
+	bool started = false;
+	std::mutex mutex;
+	std::condition_variable cv;     // new jobs, freed slots and turns of write_seq
+	std::deque<RecJob> jobs;
+	bool quit = false;
+	u64 job_seq = 0;
+	u64 write_seq = 0;
+	FILE* y4m = NULL;
+	ivec2 y4m_size;
+	char y4m_pathfile[PATHFILE_SIZE] = "";
+};
+
+static RecSlot slots[REC_RING_SIZE];
+static RecEncoders enc;
+static u64 capture_seq = 0;
+
+static bool pathfileFree(const char* pathfile) {
+	FileStats buf;
+	return fileStat(pathfile, &buf) != 0;
+}
+
+// full range BT.601, planar 4:4:4
+static void convertYUV(const u8* rgba, int pixels, u8* yuv) {
+	u8* py = yuv;
+	u8* pu = yuv + pixels;
+	u8* pv = yuv + pixels * 2;
+	for (int i = 0; i < pixels; ++i) {
+		float r = rgba[i * 4 + 0], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
+		float y =          0.299f    * r + 0.587f    * g + 0.114f    * b;
+		float u = 128.f -  0.168736f * r - 0.331264f * g + 0.5f      * b;
+		float v = 128.f +  0.5f      * r - 0.418688f * g - 0.081312f * b;
+		py[i] = u8(clamp(y + 0.5f, 0.f, 255.f));
+		pu[i] = u8(clamp(u + 0.5f, 0.f, 255.f));
+		pv[i] = u8(clamp(v + 0.5f, 0.f, 255.f));
+	}
+}
+
+static void convertRGB(const u8* rgba, int pixels, u8* rgb) {
+	for (int i = 0; i < pixels; ++i) {
+		rgb[i * 3 + 0] = rgba[i * 4 + 0];
+		rgb[i * 3 + 1] = rgba[i * 4 + 1];
+		rgb[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+}
+
+static void closeVideo() {
+	if (!enc.y4m) return;
+	fclose(enc.y4m);
+	enc.y4m = NULL;
+	logInfo("REC", "Wrote '%s'", enc.y4m_pathfile);
+}
+
+static void encoderThread() {
+	Bunch<u8> scratch;
+	std::unique_lock<std::mutex> lock(enc.mutex);
+	for (;;) {
+		enc.cv.wait(lock, [] { return enc.quit || !enc.jobs.empty(); });
+		if (enc.jobs.empty()) break; // quitting, with every job done
+		RecJob job = enc.jobs.front();
+		enc.jobs.pop_front();
+		// the slot belongs to this thread until it's freed, what's needed after that is copied out
+		bool close = job.slot < 0;
+		RecSlot* s = close ? NULL : &slots[job.slot];
+		int slot_mode = close ? SCREENSHOT : s->mode;
+		ivec2 size = close ? ivec2(0, 0) : s->size;
+		char pathfile[PATHFILE_SIZE] = "";
+		if (s) memcpy(pathfile, s->pathfile, PATHFILE_SIZE);
+		lock.unlock();
+
+		if (s) {
+			int pixels = size.x * size.y;
+			scratch.setgarbage(s64(pixels) * 3);
+			if (slot_mode == Y4M)
+				convertYUV(s->mapped, pixels, scratch.ptr);
+			else
+				convertRGB(s->mapped, pixels, scratch.ptr);
+		}
+
+		lock.lock();
+		if (s) {
+			s->state = RecSlot_free;
+			enc.cv.notify_all();
+		}
+		enc.cv.wait(lock, [&] { return enc.write_seq == job.seq; });
+		if (close) {
+			closeVideo();
+		} else if (slot_mode == Y4M) {
+			if (enc.y4m && (strcmp(enc.y4m_pathfile, pathfile) != 0 || enc.y4m_size != size))
+				closeVideo();
+			if (!enc.y4m) {
+				snprintf(enc.y4m_pathfile, PATHFILE_SIZE, "%s", pathfile);
+				enc.y4m = fopen(enc.y4m_pathfile, "wb");
+				enc.y4m_size = size;
+				if (!enc.y4m)
+					logError("REC", 0, "Couldn't open '%s' for writing", enc.y4m_pathfile);
+				else
+					fprintf(enc.y4m, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 XCOLORRANGE=FULL\n", size.x, size.y, video_fps);
+			}
+			if (enc.y4m) {
+				fprintf(enc.y4m, "FRAME\n");
+				fwrite(scratch.ptr, 1, size_t(scratch.count), enc.y4m);
+			}
 		}
-		if (frame) {
-			drawReadPixels(x,y,w,h, frame);
-			
-			unsigned char t;
-			for (int j=0; j < h/2; ++j) {
-				unsigned char *p1 = frame +      j     *w*BPP;
-				unsigned char *p2 = frame + (h-1-j)*w*BPP;
-				for (int i=0; i < w*BPP; ++i) {
-					t = p1[i], p1[i] = p2[i], p2[i] = t;
+		// png files don't care about the order, so they're written after the turn is passed on
+		enc.write_seq++;
+		enc.cv.notify_all();
+		if (!close && slot_mode != Y4M) {
+			lock.unlock();
+			if (!stbi_write_png(pathfile, size.x, size.y, 3, scratch.ptr, size.x * 3))
+				logError("REC", 0, "Couldn't write '%s'", pathfile);
+			lock.lock();
+		}
+	}
+}
+
+static void pushJob(int slot) {
+	// called with enc.mutex held
+	RecJob job;
+	job.slot = slot;
+	job.seq = enc.job_seq++;
+	enc.jobs.push_back(job);
+	enc.cv.notify_all();
+}
+
+static void startEncoders() {
+	if (enc.started) return;
+	enc.quit = false;
+	for (int i = 0; i < REC_ENCODERS; ++i)
+		enc.threads[i] = std::thread(encoderThread);
+	enc.started = true;
+}
+
+static void destroySlot(RecSlot& s) {
+	if (s.mapped) { vkUnmapMemory(evk.dev, s.memory); s.mapped = NULL; }
+	if (s.buffer) { vkDestroyBuffer(evk.dev, s.buffer, evk.alloc); s.buffer = VK_NULL_HANDLE; }
+	if (s.memory) { vkFreeMemory(evk.dev, s.memory, evk.alloc); s.memory = VK_NULL_HANDLE; }
+	if (s.fence)  { vkDestroyFence(evk.dev, s.fence, evk.alloc); s.fence = VK_NULL_HANDLE; }
+	s.bytes = 0;
+}
+
+static bool resizeSlot(RecSlot& s, VkDeviceSize bytes) {
+	if (s.bytes >= bytes) return true;
+	destroySlot(s);
+	VkResult err;
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	err = vkCreateFence(evk.dev, &fence_info, evk.alloc, &s.fence);
+	evkCheckError(err);
+	if (err) { destroySlot(s); return false; }
+
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = bytes;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	err = vkCreateBuffer(evk.dev, &info, evk.alloc, &s.buffer);
+	evkCheckError(err);
+	if (err) { destroySlot(s); return false; }
+
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(evk.dev, s.buffer, &req);
+	// cached memory reads a lot faster on the cpu, coherent is what's always there
+	u32 type = evkMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, req.memoryTypeBits);
+	if (type == 0xFFFFFFFF)
+		type = evkMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+	if (type == 0xFFFFFFFF) {
+		logError("REC", 0, "No host visible memory to read frames back into");
+		destroySlot(s);
+		return false;
+	}
+	VkPhysicalDeviceMemoryProperties props;
+	vkGetPhysicalDeviceMemoryProperties(evk.phys_dev, &props);
+	s.coherent = (props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = req.size;
+	alloc_info.memoryTypeIndex = type;
+	err = vkAllocateMemory(evk.dev, &alloc_info, evk.alloc, &s.memory);
+	evkCheckError(err);
+	if (err) { destroySlot(s); return false; }
+	err = vkBindBufferMemory(evk.dev, s.buffer, s.memory, 0);
+	evkCheckError(err);
+	if (err) { destroySlot(s); return false; }
+	void* mapped = NULL;
+	err = vkMapMemory(evk.dev, s.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	evkCheckError(err);
+	if (err) { destroySlot(s); return false; }
+	s.mapped = (const u8*)mapped;
+	s.bytes = bytes;
+	return true;
+}
+
+// Hands the slots whose copy is done to the encoders, in capture order. With wait the oldest one is waited for.
+static void pollSlots(bool wait) {
+	for (;;) {
+		int oldest = -1;
+		{
+			std::lock_guard<std::mutex> lock(enc.mutex);
+			for (int i = 0; i < REC_RING_SIZE; ++i)
+				if (slots[i].state == RecSlot_in_flight && (oldest < 0 || slots[i].seq < slots[oldest].seq))
+					oldest = i;
+		}
+		if (oldest < 0) return;
+		RecSlot& s = slots[oldest];
+		VkResult res = wait ? vkWaitForFences(evk.dev, 1, &s.fence, VK_TRUE, UINT64_MAX) : vkGetFenceStatus(evk.dev, s.fence);
+		if (res != VK_SUCCESS) return;
+		wait = false;
+		if (!s.coherent) {
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = s.memory;
+			range.size = VK_WHOLE_SIZE;
+			vkInvalidateMappedMemoryRanges(evk.dev, 1, &range);
+		}
+		startEncoders();
+		std::lock_guard<std::mutex> lock(enc.mutex);
+		s.state = RecSlot_encoding;
+		pushJob(oldest);
+	}
+}
+
+// A free slot, waiting for the gpu or the encoders when there's none.
+static RecSlot* acquireSlot() {
+	bool waited = false;
+	for (;;) {
+		bool in_flight = false;
+		{
+			std::unique_lock<std::mutex> lock(enc.mutex);
+			bool encoding = false;
+			for (int i = 0; i < REC_RING_SIZE; ++i) {
+				if (slots[i].state == RecSlot_free) {
+					rec_waits += waited;
+					return &slots[i];
 				}
+				in_flight |= slots[i].state == RecSlot_in_flight;
+				encoding |= slots[i].state == RecSlot_encoding;
+			}
+			if (!in_flight) {
+				if (!encoding) return NULL; // all recorded this frame, can't happen with one capture per frame
+				waited = true;
+				enc.cv.wait(lock);
+				continue;
 			}
-			frame_valid = true;
 		}
+		waited = true;
+		pollSlots(true);
+	}
+}
+
+static void nextPathfile(char* pathfile) {
+	if (mode == SCREENSHOT) {
+		snprintf(pathfile, PATHFILE_SIZE, IMG_DIRECTORY"/%s.png", filename);
+		for (int suffix = 0; !pathfileFree(pathfile); ++suffix)
+			snprintf(pathfile, PATHFILE_SIZE, IMG_DIRECTORY"/%s_%02d.png", filename, suffix);
+	} else if (mode == PNG_SEQUENCE) {
+		snprintf(pathfile, PATHFILE_SIZE, "%s_%05d.png", rec_pathfile, rec_frame);
+	} else {
+		snprintf(pathfile, PATHFILE_SIZE, "%s.y4m", rec_pathfile);
 	}
+}
+
+void recFrame(VkCommandBuffer cb, const char* name, VkImage image, ivec2 size) {
+	if (source_count >= MAX_SOURCES) return;
+
+	RecSource& src = sources[source_count];
+	src.name = name;
+	src.w = size.x;
+	src.h = size.y;
+
+	bool want = (recording || snap) && source_idx == source_count;
 	source_count++;
+	if (!want || size.x <= 0 || size.y <= 0) return;
+	snap = false; // a recording takes the frame already
+
+	RecSlot* s = acquireSlot();
+	if (!s || !resizeSlot(*s, VkDeviceSize(size.x) * size.y * 4)) return;
+	s->mode = recording ? mode : SCREENSHOT;
+	s->size = size;
+	s->seq = capture_seq++;
+	nextPathfile(s->pathfile);
+	rec_frame += recording;
+
+	evkMemoryBarrier(cb, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent.width = size.x;
+	region.imageExtent.height = size.y;
+	region.imageExtent.depth = 1;
+	vkCmdCopyImageToBuffer(cb, image, VK_IMAGE_LAYOUT_GENERAL, s->buffer, 1, &region);
+	// the host reads the buffer, and the image isn't written again before the copy is done
+	evkMemoryBarrier(cb, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_HOST_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	std::lock_guard<std::mutex> lock(enc.mutex);
+	s->state = RecSlot_recorded;
 }
+
+static void stopRecording() {
+	recording = false;
+	video_close = true;
+	logInfo("REC", "Captured %d frames, %d waited for a free buffer", rec_frame, rec_waits);
+}
+
 void recUI(bool capture_req) {
 	if (ui_enable) {
 		if (gui::Begin("recorder")) {
-			gui::InputText("filename", filename, FILENAME_SIZE-FILENAME_SUFFIX_SIZE); // save space for .gif/.png
-			gui::Text("Mode: "); gui::SameLine();
-			gui::RadioButton("screenshot", &mode, SCREENSHOT); gui::SameLine();
-			gui::RadioButton("gif", &mode, GIF);
+			gui::InputText("filename", filename, FILENAME_SIZE-FILENAME_SUFFIX_SIZE); // save space for the suffix
+			if (!recording) { // the mode and fps stay put while recording
+				gui::Text("Mode: "); gui::SameLine();
+				gui::RadioButton("screenshot", &mode, SCREENSHOT); gui::SameLine();
+				gui::RadioButton("png sequence", &mode, PNG_SEQUENCE); gui::SameLine();
+				gui::RadioButton("y4m video", &mode, Y4M);
+				if (mode == Y4M) {
+					gui::SetNextItemWidth(100);
+					gui::InputInt("fps", &video_fps);
+					video_fps = max(1, video_fps);
+				}
+			}
 
 			gui::Text("Source:"); gui::SameLine();
 			for (int i = 0; i < source_count; ++i) {
@@ -98,25 +410,19 @@ void recUI(bool capture_req) {
 				if (i != source_count-1) gui::SameLine();
 			}
 			if (source_count) {
-				if (mode == GIF) {
+				if (mode != SCREENSHOT) {
 					if (recording) {
-						if (gui::Button("stop")) {
-							//jo_gif_end(&gif);
-							recording = false;
-						}
-						//gui::Text("frame %d", gif.frame);
+						if (gui::Button("stop"))
+							stopRecording();
+						gui::SameLine();
+						gui::Text("frame %d, %d waited", rec_frame, rec_waits);
 					} else {
 						if (gui::Button("start")) {
-							const RecSource& src = sources[source_idx];
-							char fname[FILENAME_SIZE];
-#ifdef _WIN32
-							sprintf_s(fname, FILENAME_SIZE, VID_DIRECTORY"/%s.gif", filename);
-#else
-							snprintf(fname, FILENAME_SIZE, VID_DIRECTORY"/%s.gif", filename);
-#endif
-							//gif = jo_gif_start(fname, src.w,src.h, 0, 32);
-							recording = true;							
-							frame_valid = false;
+							dirCreate(VID_DIRECTORY);
+							snprintf(rec_pathfile, PATHFILE_SIZE, VID_DIRECTORY"/%s", filename);
+							recording = true;
+							rec_frame = 0;
+							rec_waits = 0;
 						}
 					}
 				}
@@ -128,36 +434,35 @@ void recUI(bool capture_req) {
 		} gui::End();
 	}
 	snap |= capture_req;
+	if (snap)
+		dirCreate(IMG_DIRECTORY);
 
 	source_count = 0;
 }
 void recUpdate() {
-	if (recording && frame_valid) {
-		//jo_gif_frame(&gif, frame, 4, false);
+	// submitted after the frame's command buffer, so they signal once its copies are done
+	for (int i = 0; i < REC_RING_SIZE; ++i) {
+		RecSlot& s = slots[i];
+		if (s.state != RecSlot_recorded) continue;
+		vkResetFences(evk.dev, 1, &s.fence);
+		VkResult err = vkQueueSubmit(evk.que, 0, NULL, s.fence);
+		evkCheckError(err);
+		std::lock_guard<std::mutex> lock(enc.mutex);
+		s.state = err ? RecSlot_free : RecSlot_in_flight;
 	}
-	if (snap && frame_valid) {
-		char fname[FILENAME_SIZE];
-#ifdef _WIN32
-		sprintf_s(fname, IMG_DIRECTORY"/%s.png", filename);
-#else
-		sprintf(fname, IMG_DIRECTORY"/%s.png", filename);
-#endif
-		int suffix = 0;
-		FileStats buf;
-		int res = fileStat(fname, &buf);
-		while (res == 0) {
-#ifdef _WIN32
-			sprintf_s(fname, IMG_DIRECTORY"/%s_%02d.png", filename, suffix);
-#else
-			sprintf(fname, IMG_DIRECTORY"/%s_%02d.png", filename, suffix);
-#endif
-			res = fileStat(fname, &buf);
-			suffix++;
+	pollSlots(false);
+
+	if (video_close) {
+		std::lock_guard<std::mutex> lock(enc.mutex);
+		bool in_flight = false;
+		for (int i = 0; i < REC_RING_SIZE; ++i)
+			in_flight |= slots[i].state == RecSlot_in_flight;
+		if (!in_flight) {
+			if (enc.started)
+				pushJob(-1);
+			video_close = false;
 		}
-		stbi_write_png(fname, sources[source_idx].w, sources[source_idx].h, BPP, frame, 0);
-		snap = false;
 	}
-	frame_valid = false;
 }
 void recSetFilename(const char* name) {
 #ifdef _WIN32
@@ -168,4 +473,30 @@ void recSetFilename(const char* name) {
 }
 void recUIToggle() {
 	ui_enable = !ui_enable;
-}
\ No newline at end of file
+}
+void recTerm() {
+	if (recording)
+		stopRecording();
+	recUpdate();
+	for (;;) {
+		pollSlots(true);
+		bool in_flight = false;
+		std::lock_guard<std::mutex> lock(enc.mutex);
+		for (int i = 0; i < REC_RING_SIZE; ++i)
+			in_flight |= slots[i].state == RecSlot_in_flight;
+		if (!in_flight) break;
+	}
+	if (enc.started) {
+		{
+			std::lock_guard<std::mutex> lock(enc.mutex);
+			pushJob(-1);
+			enc.quit = true;
+			enc.cv.notify_all();
+		}
+		for (int i = 0; i < REC_ENCODERS; ++i)
+			enc.threads[i].join();
+		enc.started = false;
+	}
+	for (int i = 0; i < REC_RING_SIZE; ++i)
+		destroySlot(slots[i]);
+}
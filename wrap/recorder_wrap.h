@@ -1,7 +1,18 @@
 #pragma once
+#include <vulkan/vulkan.h>
+#include "core/vec2.h"
 
-void recFrame(const char* name, int x, int y, int w, int h);
+// Captures screenshots, png sequences and y4m videos of an image without stalling the frame: recFrame records a copy
+// of the image into one of a ring of host visible buffers, recUpdate hands the buffers whose fence has signaled (some
+// frames later) to the encoder threads. Only when every buffer is still busy does the frame wait.
+
+// Offers an image as a source, call it once its content for the frame is written. It has to be R8G8B8A8 in the
+// GENERAL layout and created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT. The copy goes into cb, outside of a render pass.
+void recFrame(VkCommandBuffer cb, const char* name, VkImage image, ivec2 size);
 void recUI(bool capture_req);
+// After the frame's command buffer was submitted.
 void recUpdate();
 void recSetFilename(const char* name);
-void recUIToggle();
\ No newline at end of file
+void recUIToggle();
+// Finishes the frames still in flight and the video being written. The device has to be idle.
+void recTerm();